@@ -0,0 +1,90 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#include <app/numberParser.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * @brief Time converting numbers with NumberParser and with strtod.
+ *
+ * The numbers look like typical csv columns: small integers, ids and
+ * decimals with a few places.
+ */
+
+static const int NUMBER_COUNT = 1000000;
+static const int REPEATS = 5;
+
+static std::vector<std::string> makeNumbers() {
+    std::vector<std::string> numbers;
+    srand(42);
+    for (int i = 0; i < NUMBER_COUNT; i++) {
+        char buf[40];
+        switch (i % 4) {
+        case 0:
+            snprintf(buf, sizeof(buf), "%d", rand() % 2);
+            break;
+        case 1:
+            snprintf(buf, sizeof(buf), "%d", rand());
+            break;
+        case 2:
+            snprintf(buf, sizeof(buf), "%.2f", (rand() % 100000) / 100.0);
+            break;
+        default:
+            snprintf(buf, sizeof(buf), "%.17g",
+                     static_cast<double>(rand()) / RAND_MAX);
+            break;
+        }
+        numbers.push_back(buf);
+    }
+    return numbers;
+}
+
+template <typename Convert>
+static double timeConversions(const std::vector<std::string>& numbers,
+                              Convert convert,
+                              double& sum) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (int r = 0; r < REPEATS; r++) {
+        for (size_t i = 0; i < numbers.size(); i++) {
+            sum += convert(numbers[i]);
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count() / (numbers.size() * REPEATS);
+}
+
+static double withParser(const std::string& str) {
+    double val = 0.0;
+    NumberParser::toDouble(str.c_str(), str.size(), val);
+    return val;
+}
+
+static double withStrtod(const std::string& str) {
+    char* end = nullptr;
+    return strtod(str.c_str(), &end);
+}
+
+int main() {
+    std::vector<std::string> numbers = makeNumbers();
+    double parserSum = 0.0;
+    double strtodSum = 0.0;
+    double parserTime = timeConversions(numbers, withParser, parserSum);
+    double strtodTime = timeConversions(numbers, withStrtod, strtodSum);
+
+    std::cout << "NumberParser: " << parserTime << " ns/number" << std::endl;
+    std::cout << "strtod:       " << strtodTime << " ns/number" << std::endl;
+    if (parserSum != strtodSum) {
+        std::cout << "Results differ" << std::endl;
+        return 1;
+    }
+    return 0;
+}
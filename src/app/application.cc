@@ -3,14 +3,17 @@
 //
 
 #include "application.h"
-#include "filterExpression/variant.h"
+#include "lineFilter.h"
+#include "parallelFilter.h"
 
 #include "configure.h"
 
 #include <iostream>
-#include <sstream>
 #include <algorithm>
-#include <assert.h>
+#include <unistd.h>
+
+// The size of the buffer the output is collected in before it is written.
+static const size_t OUTPUT_BUFFER_SIZE = 1024 * 1024;
 
 /**
  * @brief Constructor.
@@ -46,10 +49,14 @@ int Application::run(int argc, char* argv[]) {
             if (cmdOptions_->showHeaders()) {
                 headers_->printHeaders();
             } else if (parseExpression()) {
+                out_.reset(new OutputWriter(STDOUT_FILENO,
+                                            OUTPUT_BUFFER_SIZE,
+                                            cmdOptions_->lineBuffered()));
                 // print headers
                 printLine();
                 // process rest of file
                 processFile();
+                flushOutput();
             }
         }
     }
@@ -61,12 +68,13 @@ int Application::run(int argc, char* argv[]) {
  *
  * @brief Print an error message
  * Print the supplied error message and set the exit code to indicate there was
- * an error.
+ * an error. Any output so far is written first.
  *
  * @param errMsg  The error message.
  *
  */
 void Application::error(const std::string& errMsg) {
+    flushOutput();
     std::cerr << errMsg << std::endl;
     exitCode_ = 1;
 }
@@ -130,7 +138,10 @@ bool Application::parseCmdLine(int argc, char* argv[]) {
     
 bool Application::openFile() {
     bool ok = false;
-    fileReader_.reset(new FileReader(cmdOptions_->file()));
+    fileReader_.reset(new FileReader(cmdOptions_->file(),
+                                     cmdOptions_->useMmap(),
+                                     cmdOptions_->bufferSize(),
+                                     cmdOptions_->readAhead()));
     if (!fileReader_->ok()) {
         error(fileReader_->errText());
     } else {
@@ -141,12 +152,13 @@ bool Application::openFile() {
 
 bool Application::readHeader() {
     bool ok = false;
-    char* line;
-    if ((line = fileReader_->getLine()) == nullptr) {
+    const char* line;
+    size_t length = 0;
+    if ((line = fileReader_->getLine(length)) == nullptr) {
         if (!fileReader_->ok()) {
             error(fileReader_->errText());
         }
-    } else if (!lineParser_.parse(line)) {
+    } else if (!lineParser_.parse(line, length)) {
         error(lineParser_.errText());
     } else {
         expectedFieldCount_ = lineParser_.fieldCount();
@@ -171,6 +183,11 @@ bool Application::parseExpression() {
         filter_.reset(new Expression(cmdOptions_->filter(), *headers_));
         if (!filter_->ok()) {
             error(filter_->error());
+        } else if (filter_->resultType() != ParseTree::NODE_TYPE_BOOL) {
+            // only a boolean can decide whether a line is written
+            error(ParseError("The filter expression must be true or false, "
+                             "such as a comparison",
+                             Range(0, cmdOptions_->filter().size())));
         } else {
             ok = true;
         }
@@ -180,58 +197,74 @@ bool Application::parseExpression() {
 
 
 void Application::processFile() {
-    int lineCount = 1;
-    char* line = nullptr;
-    std::stringstream err;
-
-    while (exitCode_ == 0 &&
-           (line = fileReader_->getLine()) != nullptr) {
-        if (!lineParser_.parse(line)) {
-            error(lineParser_.errText());
-        } else if (lineParser_.fieldCount() !=
-                   expectedFieldCount_) {
-            err << "Line " << lineCount
-                << ": Incorrect number of entries. Expected "
-                << expectedFieldCount_ << ", got "
-                << lineParser_.fieldCount() << std::endl;
-            error(err.str());
-        } else {
-            if (!filter_) {
-                // no filter expression
-                printLine();
-            } else {
-                VariantRef result = filter_->eval(lineParser_);
-                if (result->type() ==Variant::ERROR) {
-                    err << "Line " << lineCount
-                        << ":  Failed to evaluate filter expression ("
-                        << result->charVal() << ")"
-                        << std::endl;
-                    error(err.str());
-                } else {
-                    assert(result->type() == Variant::BOOLEAN);
-                    if (result->booleanVal()) {
-                        printLine();
-                    }
-                }
-            }
-        }
-        lineCount++;
+    if (cmdOptions_->jobs() > 1) {
+        processChunks();
+    } else {
+        processLines();
     }
 
     if (exitCode_ == 0 && !fileReader_->ok()) {
         error(fileReader_->errText());
     }
+}
+
+void Application::processLines() {
+    LineFilter lineFilter(*headers_, filter_.get(), expectedFieldCount_);
+    int lineCount = 1;
+    const char* line = nullptr;
+    size_t length = 0;
+    std::string out;
+    int added = 0;
+
+    // lines are filtered in batches, which must be flushed before the reader
+    // moves on and the lines in them become invalid
+    while (exitCode_ == 0 && out_->ok() &&
+           (line = fileReader_->getLine(length)) != nullptr) {
+        added++;
+        if (!lineFilter.add(line, length) ||
+            !fileReader_->hasBufferedLine()) {
+            bool ok = lineFilter.flush(out);
+            if (!out.empty()) {
+                out_->write(out);
+                out.clear();
+            }
+            if (!ok) {
+                const LineFilter::LineError& err = lineFilter.error();
+                error(LineFilter::errText(err, lineCount + err.line));
+            }
+            lineCount += added;
+            added = 0;
+        }
+    }
+}
 
+void Application::processChunks() {
+    ParallelFilter parallelFilter(*fileReader_, *headers_, filter_.get(),
+                                  expectedFieldCount_, cmdOptions_->jobs(),
+                                  cmdOptions_->bufferSize(),
+                                  cmdOptions_->unordered());
+    if (!parallelFilter.run(*out_)) {
+        error(parallelFilter.errText());
+    }
 }
 
 
 void Application::printLine() {
-    for (int i = 0; i < headers_->outColCount(); i++) {
-        int colIdx = headers_->outColIdx(i);
-        if (i != 0) {
-            std::cout << ",";
-        }
-        std::cout << lineParser_.field(colIdx)->raw();
+    std::string out;
+    LineFilter::formatLine(lineParser_, *headers_, out);
+    out_->write(out);
+}
+
+/**
+ * @brief Write out any buffered output.
+ *
+ * If the output cannot be written, this is reported as an error.
+ *
+ */
+void Application::flushOutput() {
+    if (out_ && !out_->flush()) {
+        std::string errMsg = out_->errText();
+        out_.reset();
+        error(errMsg);
     }
-    std::cout << std::endl;
 }
@@ -9,6 +9,7 @@
 #include "fileReader.h"
 #include "lineParser.h"
 #include "headers.h"
+#include "outputWriter.h"
 #include "filterExpression/expression.h"
 #include "filterExpression/parseError.h"
 
@@ -39,13 +40,17 @@ private:
     bool parseExpression();
 
     void processFile();
+    void processLines();
+    void processChunks();
     void printLine();
+    void flushOutput();
 
     std::unique_ptr<CmdOptions> cmdOptions_;
     std::unique_ptr<FileReader> fileReader_;
     std::unique_ptr<Expression> filter_;
     LineParser lineParser_;
     std::unique_ptr<Headers> headers_;
+    std::unique_ptr<OutputWriter> out_;
     int expectedFieldCount_;
     int exitCode_;
 };
@@ -0,0 +1,53 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#include "arena.h"
+
+#include <assert.h>
+
+/**
+ * @brief Constructor
+ *
+ * @param blockSize  The initial size of the block, which must not be zero.
+ *                   It grows if lines need more than this.
+ *
+ */
+Arena::Arena(size_t blockSize)
+    :block_(new char[blockSize]),
+     size_(blockSize),
+     used_(0),
+     overflow_(),
+     overflowSize_(0) {
+    assert(blockSize > 0);
+}
+
+/**
+ * @brief Free everything that has been allocated.
+ *
+ * Any memory returned by Arena::alloc must not be used after this. In the
+ * usual case, where everything fitted in the block, this just moves the
+ * pointer back to the start of it.
+ *
+ */
+void Arena::reset() {
+    if (!overflow_.empty()) {
+        size_t newSize = size_;
+        while (newSize < used_ + overflowSize_) {
+            newSize *= 2;
+        }
+        block_.reset(new char[newSize]);
+        size_ = newSize;
+        overflow_.clear();
+        overflowSize_ = 0;
+    }
+    used_ = 0;
+}
+
+/**
+ * @brief  The size of the block.
+ *
+ */
+size_t Arena::capacity() const {
+    return size_;
+}
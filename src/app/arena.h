@@ -0,0 +1,68 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#ifndef CSVFILTER_ARENA_H
+#define CSVFILTER_ARENA_H
+
+#include <memory>
+#include <vector>
+#include <stddef.h>
+
+/**
+ * @brief Scratch memory for a single line.
+ *
+ * Strings that are worked out while a line is being filtered (unescaped
+ * fields, concatenated strings and so on) are carved off the front of one
+ * large block, and are all freed together by Arena::reset when the next line
+ * is started.
+ *
+ * If a line needs more than the block holds, the extra allocations are made
+ * separately, and the block is grown to fit them all at the next reset. Once
+ * the block is big enough for the longest line, filtering does not allocate
+ * any memory at all.
+ *
+ * Memory is handed out for characters only, so it is not aligned.
+ *
+ */
+class Arena {
+public:
+    explicit Arena(size_t blockSize);
+
+    char* alloc(size_t size);
+    void reset();
+
+    size_t capacity() const;
+private:
+    Arena(const Arena& other);
+    Arena& operator=(const Arena& other);
+
+    std::unique_ptr<char[]> block_;
+    size_t size_;
+    size_t used_;
+    std::vector<std::unique_ptr<char[]> > overflow_;
+    size_t overflowSize_;
+};
+
+/**
+ * @brief Allocate some memory.
+ *
+ * @param size  The number of bytes needed.
+ *
+ * @return  The memory, which is valid until the next call to Arena::reset.
+ *
+ */
+inline char* Arena::alloc(size_t size) {
+    char* ret = nullptr;
+    if (size <= size_ - used_) {
+        ret = block_.get() + used_;
+        used_ += size;
+    } else {
+        overflow_.push_back(std::unique_ptr<char[]>(new char[size]));
+        overflowSize_ += size;
+        ret = overflow_.back().get();
+    }
+    return ret;
+}
+
+#endif // CSVFILTER_ARENA_H
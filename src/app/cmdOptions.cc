@@ -6,10 +6,20 @@
 #include <sstream>
 #include <iostream>
 #include <string.h>
+#include <stdlib.h>
+#include <errno.h>
 
 #include "cmdOptions.h"
 #include "lineParser.h"
 
+static const size_t DEFAULT_BUFFER_SIZE = 4 * 1024 * 1024;
+// anything bigger is almost certainly a typo, and would fail to allocate
+static const unsigned long long MAX_BUFFER_SIZE = 1024ULL * 1024 * 1024;
+// each buffer read ahead is allocated up front, so this is bounded too
+static const int MAX_READ_AHEAD = 64;
+// each job is a thread with its own batches of lines
+static const int MAX_JOBS = 256;
+
 /**
  * @brief Constructor.
  *
@@ -25,6 +35,12 @@ CmdOptions::CmdOptions(int argc, const char** argv)
      version_(0),
      ok_(false),
      showHeaders_(false),
+     useMmap_(false),
+     readAhead_(0),
+     bufferSize_(DEFAULT_BUFFER_SIZE),
+     jobs_(1),
+     unordered_(false),
+     lineBuffered_(false),
      errMsg_(""),
      exeName_(argv[0]),
      file_(""),
@@ -32,6 +48,7 @@ CmdOptions::CmdOptions(int argc, const char** argv)
      columns_() {
     char* colArg = nullptr;
     char* filterArg = nullptr;
+    char* bufferSizeArg = nullptr;
 
     struct poptOption po[] = {  
          {"help", 'h', POPT_ARG_NONE, &help_, 0, "help", NULL},
@@ -41,6 +58,21 @@ CmdOptions::CmdOptions(int argc, const char** argv)
          {"filter", 'f', POPT_ARG_STRING, &filterArg, 0,
                                              "filer expression to apply", NULL},
          {"show-headers", 's', POPT_ARG_NONE, &showHeaders_, 0, "version", NULL},
+         {"mmap", 'm', POPT_ARG_NONE, &useMmap_, 0,
+                                             "memory-map the input file", NULL},
+         {"read-ahead", 'r', POPT_ARG_INT, &readAhead_, 0,
+                                  "buffers to read ahead in the background",
+                                  NULL},
+         {"buffer-size", 'b', POPT_ARG_STRING, &bufferSizeArg, 0,
+                                             "size of the input buffers", NULL},
+         {"jobs", 'j', POPT_ARG_INT, &jobs_, 0,
+                                           "number of threads to filter with",
+                                           NULL},
+         {"unordered", 'u', POPT_ARG_NONE, &unordered_, 0,
+                                "write output as soon as it is ready", NULL},
+         {"line-buffered", 'l', POPT_ARG_NONE, &lineBuffered_, 0,
+                                "write each line as soon as it is filtered",
+                                NULL},
          {NULL}  
      };  
        
@@ -80,6 +112,31 @@ CmdOptions::CmdOptions(int argc, const char** argv)
          ok_ = readCols(colArg);
      }
 
+     if (ok_ && bufferSizeArg) {
+         ok_ = readSize(bufferSizeArg);
+     }
+
+     if (ok_ && (readAhead_ < 0 || readAhead_ > MAX_READ_AHEAD)) {
+         std::stringstream msg;
+         msg << "Invalid read-ahead depth: " << readAhead_
+             << " (it must be between 0 and " << MAX_READ_AHEAD << ")";
+         errMsg_ = msg.str();
+         ok_ = false;
+     }
+
+     if (ok_ && (jobs_ < 1 || jobs_ > MAX_JOBS)) {
+         std::stringstream msg;
+         msg << "Invalid number of jobs: " << jobs_
+             << " (it must be between 1 and " << MAX_JOBS << ")";
+         errMsg_ = msg.str();
+         ok_ = false;
+     }
+
+     if (ok_ && unordered_ && jobs_ < 2) {
+         errMsg_ = "The unordered option needs more than one job (see -j)";
+         ok_ = false;
+     }
+
 
 }
 
@@ -124,6 +181,80 @@ bool CmdOptions::showHeaders() const {
     return showHeaders_;
 }
 
+/**
+ *
+ * @brief Was -m present?
+ *
+ * @return true if -m / --mmap was found in the command line options
+ *
+ */
+bool CmdOptions::useMmap() const {
+    return useMmap_;
+}
+
+/**
+ *
+ * @brief The read-ahead depth specified via -r.
+ *
+ * @return The number of input buffers that may be read ahead by a background
+ *         thread, or 0 if the input should be read on the main thread.
+ *
+ */
+int CmdOptions::readAhead() const {
+    return readAhead_;
+}
+
+/**
+ *
+ * @brief The input buffer size specified via -b.
+ *
+ * The size may be given in bytes, or with a k, m or g suffix.
+ *
+ * @return The size, in bytes, of each buffer used to read the input file.
+ *
+ */
+size_t CmdOptions::bufferSize() const {
+    return bufferSize_;
+}
+
+/**
+ *
+ * @brief The number of jobs specified via -j.
+ *
+ * @return The number of threads that should filter the input. If this is more
+ *         than 1 the input is filtered in chunks of the buffer size.
+ *
+ */
+int CmdOptions::jobs() const {
+    return jobs_;
+}
+
+/**
+ *
+ * @brief Was the -u option specified?
+ *
+ * @return true if, when filtering with more than one thread, the output for
+ *         each chunk should be written as soon as it is ready rather than in
+ *         the order of the input.
+ *
+ */
+bool CmdOptions::unordered() const {
+    return unordered_;
+}
+
+/**
+ *
+ * @brief Was the -l option specified?
+ *
+ * @return true if the output should be written as soon as each line (or, with
+ *         -j, each chunk) has been filtered, rather than collected in a large
+ *         buffer first.
+ *
+ */
+bool CmdOptions::lineBuffered() const {
+    return lineBuffered_;
+}
+
 /**
  * @brief The columns specified via -c.
  *
@@ -181,15 +312,24 @@ const std::string CmdOptions::errMsg() const {
  *
  */
 void CmdOptions::printUsage() const {
-    std::cout << "Usage: " << exeName_ << " -[hvs] "
+    std::cout << "Usage: " << exeName_ << " -[hvsmul] "
                                           "[-c <columns>] [-f <filter>] "
+              <<                          "[-r <depth>] [-b <size>] "
+              <<                          "[-j <jobs>] "
               <<                          "[<file>]\n"
               << "\n"
               << " -h: Print help message\n"
               << " -v: Print version information\n"
               << " -s: Show the headers and header aliases from the csv file\n"
               << " -c: A (comma-separated) list of output columns\n"
-              << " -f: A filter expression to apply to the rows"
+              << " -f: A filter expression to apply to the rows\n"
+              << " -m: Memory-map the input file, if it is a regular file\n"
+              << " -r: Read this many buffers ahead in a background thread\n"
+              << " -b: The size of the input buffers (e.g. 512k, 4m)\n"
+              << " -j: The number of threads to filter the input with\n"
+              << " -u: With -j, write lines as soon as they are filtered,\n"
+              << "     rather than in the order of the input\n"
+              << " -l: Write each line as soon as it is filtered"
               << std::endl;
 }
 
@@ -204,9 +344,56 @@ bool CmdOptions::readCols(const char* constCols) {
         errMsg_ = msg.str();
     } else {
         for (int i = 0; i < parser.fieldCount(); i++) {
-            columns_.push_back(std::string(parser.field(i)->asString()));
+            columns_.push_back(std::string(parser.field(i).asString()));
         }
     }
     free(cols);
     return ok;
 }
+
+bool CmdOptions::readSize(const char* size) {
+    char* end = const_cast<char*>(size);
+    unsigned long long val = 0;
+    unsigned long long multiplier = 1;
+
+    // strtoull would skip whitespace and accept (and wrap) a minus sign
+    if (*size >= '0' && *size <= '9') {
+        errno = 0;
+        val = strtoull(size, &end, 10);
+        if (errno == ERANGE) {
+            end = const_cast<char*>(size);
+        }
+    }
+
+    switch (*end) {
+    case 'k':
+    case 'K':
+        multiplier = 1024;
+        end++;
+        break;
+    case 'm':
+    case 'M':
+        multiplier = 1024 * 1024;
+        end++;
+        break;
+    case 'g':
+    case 'G':
+        multiplier = 1024 * 1024 * 1024;
+        end++;
+        break;
+    default:
+        break;
+    }
+
+    bool ok = (end != size && *end == '\0' && val > 0 &&
+               val <= MAX_BUFFER_SIZE / multiplier);
+    if (!ok) {
+        std::stringstream msg;
+        msg << "Invalid buffer size: " << size
+            << " (it must be between 1 and 1g)";
+        errMsg_ = msg.str();
+    } else {
+        bufferSize_ = val * multiplier;
+    }
+    return ok;
+}
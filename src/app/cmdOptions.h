@@ -7,6 +7,7 @@
 
 #include <string>
 #include <vector>
+#include <stddef.h>
 
 /**
  * @brief Command line parser.
@@ -26,6 +27,12 @@ public:
     bool help() const;
     bool version() const;
     bool showHeaders() const;
+    bool useMmap() const;
+    int readAhead() const;
+    size_t bufferSize() const;
+    int jobs() const;
+    bool unordered() const;
+    bool lineBuffered() const;
 
     const std::vector<std::string>& columns() const;
     const std::string& file() const;
@@ -38,6 +45,7 @@ private:
     CmdOptions& operator=(const CmdOptions& other);
 
     bool readCols(const char* cols);
+    bool readSize(const char* size);
 
     int help_;
     int version_;
@@ -45,6 +53,12 @@ private:
     // we'll use ints instead
     int ok_;
     int showHeaders_;
+    int useMmap_;
+    int readAhead_;
+    size_t bufferSize_;
+    int jobs_;
+    int unordered_;
+    int lineBuffered_;
     std::string errMsg_;
     std::string exeName_;
     std::string file_;
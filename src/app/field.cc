@@ -3,121 +3,73 @@
 //
 
 #include "field.h"
+#include "numberParser.h"
 
 #include <string.h>
 #include <stdlib.h>
 
 /**
- * @brief Constructor.
+ * @brief  Work out the value of the field as a string.
  *
- * Create a new field from the raw string value read from a csv file, including
- * any surrounding quotes and escaped characters (i.e. quote characters in a
- * quoted string will still be represented as "").
+ * The terminated, unescaped value is put in the arena, and cached in the span.
  *
- * Note that this class stores, but does not take ownership of, rawVal to
- * save a string copy. rawVal will typically be a piece of memory owned by
- * fileReader, and will only be valid until the next line is read.
- *
- * @param rawVal  The raw, potentially still quoted and unescaped, value of
- *                this field from the input file.
- */
-Field::Field(const char* rawVal)
-    :rawVal_(rawVal),
-     stringVal_(nullptr),
-     canBeNumber_(UNKNOWN),
-     doubleVal_(0) {
-
-}
-
-/**
- * @brief Destructor.
- *
- */
-Field::~Field() {
-    delete[] stringVal_;
-}
-
-
-/**
- *
- * @brief  Change the stored value
- *
- * Change the value that is being stored in this Field object. This is a
- * performance enhancement to allow reuse of this class rather than destroying
- * it and creating a new one.
- *
- * @see  Field::Field
- *
- * @param rawVal  The raw, potentially still quoted and unescaped, value of
- *                this field from the input file.
- */
-void Field::reset(const char* rawVal) {
-    rawVal_ = rawVal;
-    delete[] stringVal_;
-    stringVal_ = nullptr;
-    canBeNumber_ = UNKNOWN;
-    doubleVal_ = 0;
-}
-
-/**
- * @brief  The raw field value.
- *
- * The raw value of the field, as read from the input file. This will contain
- * any quoting end escaping that was present in the input file, so is suitable
- * for writing directly to the output.
- *
- * Note that this is the original char* passed in to the class, so ownership
- * remains with the original FileReader, and it is only valid until the next
- * line is read.
- *
- * @return  The raw value read for this field
  */
-const char* Field::raw() const {
-    return rawVal_;
-}
-
-/**
- * @brief  The value of the field
- *
- * @return  The string this field contains, with surrounding quotes (if any)
- *          removed, and escaped characters (if any) unescaped. Note that this
- *          is calculated from Field::raw, so the same rules apply about
- *          lifetime. 
- *
- */
-const char* Field::asString() {
-    const char* ret = nullptr;
-    if (*rawVal_ != '"') {
-        ret = rawVal_;
-    } else if (stringVal_ != nullptr) {
-        ret = stringVal_;
+void Field::unescape() const {
+    // the unescaped value is never longer than the raw one
+    char* value = arena_->alloc(span_->length + 1);
+    if ((span_->flags & FieldSpan::QUOTED) == 0) {
+        // the raw value is not terminated, so it must be copied
+        memcpy(value, raw(), span_->length);
+        value[span_->length] = '\0';
     } else {
-        int len = strlen(rawVal_);
-        stringVal_ = new char[len + 1];
-        ret = stringVal_;
-
         // copy across the string, dropping the surrounding quotes,
         // and unescaping any contained quotes.
-        char* dest = stringVal_;
-        const char* source = rawVal_ + 1; // ignore first quote
-        while (*(source + 1) != '\0') { // ignore last quote
-            *dest = *source;
+        const char* source = raw() + 1; // ignore first quote
+        const char* end = raw() + span_->length - 1; // ignore last quote
+        char* dest = value;
+        while (source < end) {
+            *dest++ = *source;
             if (*source == '"') { // must be an escaped quote
                 source++;
             }
             source++;
-            dest++;
         }
         *dest = '\0';
     }
+    span_->value = value;
+    span_->flags |= FieldSpan::UNESCAPED;
+}
 
-    return ret;
+/**
+ * @brief  Work out whether the field is a number, and if so which.
+ *
+ * The result is cached in the span.
+ *
+ */
+void Field::convertNumber() const {
+    span_->flags |= FieldSpan::NUMBER_KNOWN;
+    if ((span_->flags & FieldSpan::QUOTED) == 0) {
+        NumberParser::Result result =
+            NumberParser::parse(raw(), span_->length, span_->number);
+        if (result == NumberParser::USE_STRTOD) {
+            const char* str = asString();
+            char* end = nullptr;
+            span_->number = Number::real(strtod(str, &end));
+            if (end == str + span_->length) {
+                result = NumberParser::NUMBER;
+            }
+        }
+        if (result == NumberParser::NUMBER) {
+            span_->flags |= FieldSpan::IS_NUMBER;
+        }
+    }
 }
 
 /**
- * @brief  Return the field as a number.
+ * @brief  Return the field as a double.
  *
- * Attempt to convert the filed to a number, and return it.
+ * As Field::asNumber, but integers are converted to doubles, so may be
+ * rounded.
  *
  * @param val  This will be set to the number value of the field.
  *
@@ -125,18 +77,11 @@ const char* Field::asString() {
  *          will be set), or false otherwise.
  *
  */
-bool Field::asNumber(double& val) {
-    if (canBeNumber_ == UNKNOWN) {
-        if (*rawVal_ == '"') {
-            canBeNumber_ = NO;
-        } else {
-            char* end = nullptr;
-            doubleVal_ = strtod(rawVal_, &end);
-            canBeNumber_ = (*end == '\0') ? YES : NO;
-        }
+bool Field::asNumber(double& val) const {
+    Number number;
+    bool ret = asNumber(number);
+    if (ret) {
+        val = number.doubleVal();
     }
-    if (canBeNumber_ == YES) {
-        val = doubleVal_;
-    }
-    return (canBeNumber_ == YES);
+    return ret;
 }
@@ -4,39 +4,156 @@
 
 #ifndef CSVFILTER_FIELD_H
 #define CSVFILTER_FIELD_H
-#include <memory>
 
+#include "arena.h"
+#include "number.h"
+
+#include <stddef.h>
+
+/**
+ * @brief Where a field is in a line, and what is known about it.
+ *
+ * A parsed line is an array of these, one per field. The values worked out
+ * from the raw field are cached here, so they are only worked out once per
+ * line however many times the field is used.
+ *
+ */
+typedef struct FieldSpan {
+    /**
+     * @brief Values for FieldSpan::flags.
+     */
+    typedef enum {
+        QUOTED = 1,       /**< The raw value starts with a quote */
+        NUMBER_KNOWN = 2, /**< We know whether the field is a number */
+        IS_NUMBER = 4,    /**< The field is a number, see FieldSpan::number */
+        UNESCAPED = 8     /**< The terminated, unescaped value of the field
+                           *   has been worked out */
+    } Flag;
+
+    size_t offset;   ///< Where the raw value starts in the line
+    size_t length;   ///< The length of the raw value
+    unsigned flags;  ///< A combination of FieldSpan::Flag values
+    Number number;   ///< The value of the field, if it is a number
+    const char* value; ///< The terminated, unescaped value, if it has been
+                       ///< worked out
+} FieldSpan;
 
 /**
  *
  * @brief A single field from the CSV file.
  *
+ * This is a view of one of the fields in a line parsed by a LineParser, and
+ * is only valid until the next line is parsed. It is cheap to copy.
+ *
+ * The span is the cache for the line: the first time a field is used as a
+ * number or a string the value is worked out and kept in the span, and every
+ * other use of the field - from anywhere in the filter expression - just
+ * loads it. That part is inline, so only the first use makes a call.
+ *
  */
 class Field {
 public:
-    Field(const char* rawVal);
-    ~Field();
-
-    void reset(const char* rawVal);
+    Field(const char* line, FieldSpan& span, Arena& arena);
 
-    const char* asString();
-    bool asNumber(double& val);
+    const char* asString() const;
+    bool asNumber(Number& val) const;
+    bool asNumber(double& val) const;
     const char* raw() const;
+    size_t length() const;
 private:
-    typedef enum {
-        YES,
-        NO,
-        UNKNOWN
-    } Maybe;
-    Field(const Field& other);
-    Field& operator=(const Field& other);
-
-    const char* rawVal_;
-    char* stringVal_;
-    Maybe canBeNumber_;
-    double doubleVal_;
+    void unescape() const;
+    void convertNumber() const;
+
+    const char* line_;
+    FieldSpan* span_;
+    Arena* arena_;
 };
 
-typedef std::shared_ptr<Field> FieldRef;
+/**
+ * @brief Constructor.
+ *
+ * Create a view of a field in a line. The raw value includes any surrounding
+ * quotes and escaped characters (i.e. quote characters in a quoted string
+ * will still be represented as ""). It is not terminated.
+ *
+ * Note that nothing is copied or owned by this class. The line will typically
+ * be a piece of memory owned by a FileReader, and the span and arena are owned
+ * by the LineParser, so the field is only valid until the next line is parsed.
+ *
+ * @param line   The line the field is in.
+ * @param span   Where the field is in the line. Values worked out from the
+ *               field are cached in this.
+ * @param arena  Where the terminated, unescaped value of the field is stored.
+ */
+inline Field::Field(const char* line, FieldSpan& span, Arena& arena)
+    :line_(line),
+     span_(&span),
+     arena_(&arena) {
+
+}
+
+/**
+ * @brief  The raw field value.
+ *
+ * The raw value of the field, as read from the input file. This will contain
+ * any quoting end escaping that was present in the input file, so is suitable
+ * for writing directly to the output.
+ *
+ * Note that this points into the line, so ownership remains with the original
+ * FileReader, and it is only valid until the next line is read. It is not
+ * terminated - see Field::length.
+ *
+ * @return  The raw value read for this field
+ */
+inline const char* Field::raw() const {
+    return line_ + span_->offset;
+}
+
+/**
+ * @brief  The length of the raw field value.
+ *
+ */
+inline size_t Field::length() const {
+    return span_->length;
+}
+
+/**
+ * @brief  The value of the field
+ *
+ * @return  The string this field contains, with surrounding quotes (if any)
+ *          removed, and escaped characters (if any) unescaped. Note that this
+ *          is calculated from Field::raw, so the same rules apply about
+ *          lifetime.
+ *
+ */
+inline const char* Field::asString() const {
+    if ((span_->flags & FieldSpan::UNESCAPED) == 0) {
+        unescape();
+    }
+    return span_->value;
+}
+
+/**
+ * @brief  Return the field as a number.
+ *
+ * Attempt to convert the filed to a number, and return it. Fields that are
+ * written as integers are kept as integers (see Number).
+ *
+ * @param val  This will be set to the number value of the field.
+ *
+ * @return  true if the field can be converted to a number (in which case val
+ *          will be set), or false otherwise.
+ *
+ */
+inline bool Field::asNumber(Number& val) const {
+    if ((span_->flags & FieldSpan::NUMBER_KNOWN) == 0) {
+        convertNumber();
+    }
+    bool ret = ((span_->flags & FieldSpan::IS_NUMBER) != 0);
+    if (ret) {
+        val = span_->number;
+    }
+    return ret;
+}
 
 #endif //CSVFILTER_FIELD_H
@@ -5,10 +5,13 @@
 #include "fileReader.h"
 
 #include <sstream>
-#include <stdio.h>
+#include <algorithm>
 #include <string.h>
-
-static const int MAX_LINE_LENGTH = 1024 * 1024;
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /**
  * @brief Constructor
@@ -17,30 +20,71 @@ static const int MAX_LINE_LENGTH = 1024 * 1024;
  * check whether the file has been successfully opened, and FileReader::errText
  * to obtain an error message if the open fails.
  *
- * @param name  The name of the file that should be read.
+ * If useMmap is set and the file is a regular file then it is memory-mapped,
+ * otherwise (or if the mapping fails) it is read into a buffer.
+ *
+ * @param name            The name of the file that should be read, or a blank
+ *                        string to read from standard input.
+ * @param useMmap         true to memory-map the file where possible.
+ * @param blockSize       The amount of data to read (or scan, for mapped
+ *                        files) at a time.
+ * @param readAheadDepth  The number of blocks a background thread may read
+ *                        ahead of the caller, or 0 to read on the calling
+ *                        thread. This is ignored for mapped files.
  *
  */
-FileReader::FileReader(const std::string& name)
-    :line_(nullptr),
-     file_(nullptr),
+FileReader::FileReader(const std::string& name,
+                       bool useMmap,
+                       size_t blockSize,
+                       int readAheadDepth)
+    :fd_(-1),
+     blockSize_(blockSize),
+     readAhead_(),
+     buf_(nullptr),
+     block_(nullptr),
+     blockLength_(0),
+     blockPos_(0),
+     carry_(nullptr),
+     carrySize_(0),
+     carryLength_(0),
+     carryLineStart_(0),
+     carryState_(RecordScanner::OUTSIDE_QUOTES),
+     partialLine_(nullptr),
+     partialState_(RecordScanner::OUTSIDE_QUOTES),
+     map_(nullptr),
+     mapLength_(0),
+     mapPos_(0),
+     lines_(),
+     nextLine_(0),
+     chunking_(false),
      ok_(true),
      errText_("") {
-    line_ = new char[MAX_LINE_LENGTH];
 
     if (name == "") {
-        file_ = stdin;
+        fd_ = STDIN_FILENO;
     } else {
-        file_ = fopen(name.c_str(), "r");
-        if (file_ == nullptr) {
+        fd_ = open(name.c_str(), O_RDONLY);
+        if (fd_ < 0) {
             std::stringstream msg;
             msg << "Failed to open " << name << ": " << strerror(errno);
             setError(msg.str());
         }
     }
+
+    if (fd_ >= 0 && !(useMmap && mapFile())) {
+        if (readAheadDepth > 0) {
+            readAhead_.reset(new ReadAhead(fd_, blockSize_,
+                                            readAheadDepth + 1));
+        } else {
+            buf_ = new char[blockSize_];
+        }
+    }
 }
 
 FileReader::~FileReader() {
-    delete[] line_;
+    closeFile();
+    delete[] buf_;
+    delete[] carry_;
 }
 
 /**
@@ -69,42 +113,497 @@ const std::string& FileReader::errText() const {
 /**
  * @brief Get the next line from the file.
  *
- * Get the next line from the file. The returned char* is valid until the next
- * call to FileReader::getLine. Other classes (especially LineParser) will edit
- * the line in-place to save string copies.
+ * Get the next line from the file. The returned line is not terminated, and
+ * is valid until the next call to FileReader::getLine that has to read more of
+ * the file (see FileReader::hasBufferedLine). Lines are returned in place
+ * where possible, so consecutive lines are usually next to each other in
+ * memory, separated only by their newlines.
+ *
+ * @param length  Set to the length of the line, excluding its newline.
  *
  * @return  The next line from the file, or NULL if the end of the file has been
  *          reached.
  */
-char* FileReader::getLine() {
-    char* ret = nullptr;
-    if (file_ != nullptr) {
-        ret = fgets(line_, MAX_LINE_LENGTH, file_);
-        if (ret == nullptr) {
-            if (ferror(file_)) {
-                std::stringstream msg;
-                msg << "Error reading file" << ": " << strerror(errno);
-                setError(msg.str());
-            } else {
-                // eof
+const char* FileReader::getLine(size_t& length) {
+    const char* ret = nullptr;
+    if (nextLine_ == lines_.size()) {
+        readBatch();
+    }
+    if (nextLine_ < lines_.size()) {
+        ret = lines_[nextLine_].start;
+        length = lines_[nextLine_].length;
+        nextLine_++;
+    }
+    return ret;
+}
+
+/**
+ * @brief Can the next line be returned without reading more of the file?
+ *
+ * If so, the next call to FileReader::getLine leaves the lines it has already
+ * returned valid, so they can be kept and processed together.
+ *
+ * @return  true if the next line has already been read, false if the next
+ *          call to FileReader::getLine reads more of the file (or finds the
+ *          end of it).
+ *
+ */
+bool FileReader::hasBufferedLine() const {
+    return (nextLine_ < lines_.size());
+}
+
+/**
+ * @brief Get the next chunk of whole lines from the file.
+ *
+ * Copy at least size bytes of the file (unless the end of the file is reached
+ * first) into the chunk, extending it to the end of the line that it finishes
+ * in. Unlike FileReader::getLine the lines are not split up, so
+ * the chunk is exactly as it appears in the file. Because the chunk is a copy
+ * it remains valid after later calls, which lets chunks be processed in
+ * parallel.
+ *
+ * Any lines that have been read by FileReader::getLine but not yet returned
+ * are included at the start of the first chunk, so the header line can be read
+ * with getLine and the rest of the file in chunks. getLine must not be called
+ * once this function has been called.
+ *
+ * @param chunk  The buffer to copy the chunk into. This is grown as necessary,
+ *               and always has room for a terminator after the chunk.
+ * @param size   The minimum amount of data to return.
+ *
+ * @return  The length of the chunk, or 0 at the end of the file. If a read
+ *          fails then FileReader::ok will return false.
+ *
+ */
+size_t FileReader::readChunk(std::vector<char>& chunk, size_t size) {
+    size_t length = 0;
+    if (!chunking_) {
+        startChunks(chunk, length);
+    }
+
+    if (map_ != nullptr) {
+        readMappedChunk(chunk, length, size);
+    } else if (fd_ >= 0 || carryLength_ > 0) {
+        readBufferedChunk(chunk, length, size);
+    }
+    return length;
+}
+
+/**
+ * @brief Memory-map the open file.
+ *
+ * Attempt to memory-map the whole file instead of reading it into a buffer.
+ * This is only done for regular files, and if it is not possible for any
+ * reason we silently fall back to reading into a buffer.
+ *
+ * The mapping is read-only. Lines are returned in place and never written to,
+ * so the pages are shared with the page cache rather than copied.
+ *
+ * @return  true if the file was mapped, false otherwise.
+ *
+ */
+bool FileReader::mapFile() {
+    struct stat info;
+    if (fstat(fd_, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* map = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (map != MAP_FAILED) {
+            map_ = static_cast<const char*>(map);
+            mapLength_ = info.st_size;
+            madvise(map, mapLength_, MADV_SEQUENTIAL);
+        }
+    }
+    return map_ != nullptr;
+}
+
+/**
+ * @brief Replace the current batch of lines with the next one.
+ *
+ * Once this is called, all the lines from the previous batch are invalid. If
+ * the end of the file has been reached the new batch will be empty.
+ *
+ */
+void FileReader::readBatch() {
+    lines_.clear();
+    nextLine_ = 0;
+    if (map_ != nullptr) {
+        readMappedBatch();
+    } else if (fd_ >= 0) {
+        readBufferedBatch();
+    }
+}
+
+/**
+ * @brief Read the next block, and split it into lines.
+ *
+ * Any incomplete record at the end of the previous block is copied into the
+ * carry buffer first, and completed from the start of the new block. If the
+ * record doesn't finish in the new block the whole block is added to the carry
+ * buffer and we move on to the next one.
+ *
+ */
+void FileReader::readBufferedBatch() {
+    bool carrying = false;
+    if (blockPos_ < blockLength_) {
+        startCarry(block_ + blockPos_, blockLength_ - blockPos_);
+        carrying = true;
+    }
+    releaseBlock();
+
+    while (fd_ >= 0 && lines_.empty()) {
+        if (!acquireBlock()) {
+            closeFile();
+        } else if (blockLength_ == 0) {
+            // eof - anything left over is the last record of the file
+            if (carrying) {
+                pushCarriedLine();
             }
             closeFile();
         } else {
-            // we need to check we had enough room for the complete line, and
-            // strip the newline if necessary
-            int length = strlen(line_);
-            if (length == MAX_LINE_LENGTH - 1) {
-                ret = nullptr;
-                setError("Line too long");
-                closeFile();
+            const char* start = block_;
+            const char* end = block_ + blockLength_;
+            if (carrying) {
+                start = continueCarry(block_, end);
+                carrying = lines_.empty();
+            }
+            blockPos_ = splitLines(start, end) - block_;
+            if (lines_.empty()) {
+                // no complete record in this block - keep what there is and
+                // move on to the next one
+                if (!carrying) {
+                    startCarry(block_ + blockPos_, blockLength_ - blockPos_);
+                    carrying = true;
+                }
+                releaseBlock();
+            }
+        }
+    }
+}
+
+/**
+ * @brief Get the next block of data from the file.
+ *
+ * The block is either read directly into our buffer or, if reading ahead,
+ * taken from the ReadAhead ring.
+ *
+ * @return  true if the read succeeded (blockLength_ is zero at the end of the
+ *          file), false if it failed.
+ *
+ */
+bool FileReader::acquireBlock() {
+    bool ok = true;
+    int err = 0;
+    blockPos_ = 0;
+    if (readAhead_) {
+        ok = readAhead_->acquire(block_, blockLength_);
+        err = readAhead_->error();
+    } else {
+        ssize_t count = 0;
+        do {
+            count = read(fd_, buf_, blockSize_);
+        } while (count < 0 && errno == EINTR);
+        ok = (count >= 0);
+        err = errno;
+        block_ = buf_;
+        blockLength_ = ok ? count : 0;
+    }
+
+    if (!ok) {
+        std::stringstream msg;
+        msg << "Error reading file" << ": " << strerror(err);
+        setError(msg.str());
+    }
+    return ok;
+}
+
+/**
+ * @brief Finish with the current block.
+ *
+ * Nothing in the current block may be used after this is called.
+ *
+ */
+void FileReader::releaseBlock() {
+    if (readAhead_) {
+        readAhead_->release();
+    }
+    block_ = nullptr;
+    blockLength_ = 0;
+    blockPos_ = 0;
+}
+
+/**
+ * @brief Add data to the end of the carry buffer.
+ *
+ * The carry buffer holds lines that are split across blocks, and is grown as
+ * necessary to hold them.
+ *
+ * @param data    The data to add
+ * @param length  The amount of data to add
+ *
+ */
+void FileReader::appendToCarry(const char* data, size_t length) {
+    if (carryLength_ + length > carrySize_) {
+        size_t newSize = std::max(carrySize_ * 2, carryLength_ + length);
+        char* newCarry = new char[newSize];
+        memcpy(newCarry, carry_, carryLength_);
+        delete[] carry_;
+        carry_ = newCarry;
+        carrySize_ = newSize;
+    }
+    memcpy(carry_ + carryLength_, data, length);
+    carryLength_ += length;
+}
+
+/**
+ * @brief Start a new carry buffer.
+ *
+ * This is called with the incomplete record at the end of a block, just after
+ * the block has been split by FileReader::splitLines.
+ *
+ * @param data    The start of the record
+ * @param length  The amount of the record in the block
+ *
+ */
+void FileReader::startCarry(const char* data, size_t length) {
+    carryLength_ = 0;
+    appendToCarry(data, length);
+    carryLineStart_ = partialLine_ - data;
+    carryState_ = partialState_;
+}
+
+/**
+ * @brief Complete the record in the carry buffer.
+ *
+ * Lines from the start of the block are added to the carry buffer until one of
+ * them ends outside of quotes, at which point the record is added to the
+ * batch.
+ *
+ * @param start  The start of the block.
+ * @param end    The end of the block.
+ *
+ * @return  The first character after the record, or end if the record has not
+ *          finished in this block (in which case the whole block has been added
+ *          to the carry buffer).
+ *
+ */
+const char* FileReader::continueCarry(const char* start, const char* end) {
+    const char* pos = start;
+    bool complete = false;
+    while (!complete && pos < end) {
+        const char* newline =
+            static_cast<const char*>(memchr(pos, '\n', end - pos));
+        const char* lineEnd = (newline != nullptr) ? newline : end;
+        appendToCarry(pos, lineEnd - pos);
+        pos = lineEnd;
+        if (newline != nullptr) {
+            pos++;
+            carryState_ = RecordScanner::scanLine(carry_ + carryLineStart_,
+                                                  carry_ + carryLength_,
+                                                  carryState_);
+            if (carryState_ == RecordScanner::OUTSIDE_QUOTES) {
+                pushCarriedLine();
+                complete = true;
             } else {
-                if (line_[length - 1] == '\n') {
-                    line_[length - 1] = '\0';
+                // the newline is part of a quoted field
+                appendToCarry(newline, 1);
+                carryLineStart_ = carryLength_;
+            }
+        }
+    }
+    return pos;
+}
+
+/**
+ * @brief Add the contents of the carry buffer to the batch as a line.
+ *
+ */
+void FileReader::pushCarriedLine() {
+    LineSpan span = {carry_, carryLength_};
+    lines_.push_back(span);
+}
+
+/**
+ * @brief Switch from reading lines to reading chunks.
+ *
+ * The lines remaining in the current batch are copied into the chunk with
+ * their newlines restored, followed by the unsplit data after them.
+ *
+ */
+void FileReader::startChunks(std::vector<char>& chunk, size_t& length) {
+    for (; nextLine_ < lines_.size(); nextLine_++) {
+        appendToChunk(chunk, length, lines_[nextLine_].start,
+                      lines_[nextLine_].length);
+        appendToChunk(chunk, length, "\n", 1);
+    }
+    lines_.clear();
+    nextLine_ = 0;
+
+    // From here on the carry buffer holds the incomplete line at the end of
+    // the last chunk
+    carryLength_ = 0;
+    if (blockPos_ < blockLength_) {
+        appendToCarry(block_ + blockPos_, blockLength_ - blockPos_);
+    }
+    releaseBlock();
+    chunking_ = true;
+}
+
+/**
+ * @brief Read the next chunk into a buffer.
+ *
+ * Blocks are appended to the chunk until it is big enough and contains at
+ * least one newline. Whatever follows the last newline is kept in the carry
+ * buffer for the start of the next chunk.
+ *
+ */
+void FileReader::readBufferedChunk(std::vector<char>& chunk, size_t& length,
+                                   size_t size) {
+    appendToChunk(chunk, length, carry_, carryLength_);
+    carryLength_ = 0;
+
+    size_t lineEnd = length;
+    while (lineEnd > 0 && chunk[lineEnd - 1] != '\n') {
+        lineEnd--;
+    }
+
+    while (fd_ >= 0 && (length < size || lineEnd == 0)) {
+        if (!acquireBlock() || blockLength_ == 0) {
+            closeFile();
+        } else {
+            size_t blockStart = length;
+            appendToChunk(chunk, length, block_, blockLength_);
+            releaseBlock();
+            for (size_t i = length; i > blockStart; i--) {
+                if (chunk[i - 1] == '\n') {
+                    lineEnd = i;
+                    break;
                 }
             }
         }
     }
-    return ret;
+
+    if (fd_ >= 0) {
+        appendToCarry(&chunk[lineEnd], length - lineEnd);
+        length = lineEnd;
+    } else if (!ok_) {
+        // as with FileReader::getLine, an incomplete line before a failed
+        // read is dropped
+        length = lineEnd;
+    }
+}
+
+/**
+ * @brief Copy the next chunk out of the mapping.
+ *
+ */
+void FileReader::readMappedChunk(std::vector<char>& chunk, size_t& length,
+                                 size_t size) {
+    size_t end = std::min(mapPos_ + size, mapLength_);
+    if (end < mapLength_) {
+        const char* newline = static_cast<const char*>(
+            memchr(map_ + end, '\n', mapLength_ - end));
+        end = (newline != nullptr) ? newline + 1 - map_ : mapLength_;
+    }
+    appendToChunk(chunk, length, map_ + mapPos_, end - mapPos_);
+    mapPos_ = end;
+
+    if (mapPos_ == mapLength_) {
+        closeFile();
+    }
+}
+
+/**
+ * @brief Add data to the end of a chunk.
+ *
+ * The chunk is grown as necessary, always leaving room for a terminator.
+ *
+ */
+void FileReader::appendToChunk(std::vector<char>& chunk, size_t& length,
+                               const char* data, size_t count) {
+    if (length + count + 1 > chunk.size()) {
+        chunk.resize(std::max(chunk.size() * 2, length + count + 1));
+    }
+    if (count > 0) {
+        memcpy(&chunk[length], data, count);
+        length += count;
+    }
+}
+
+/**
+ * @brief Split the next window of the mapping into lines.
+ *
+ * Lines are returned in-place from the mapping, including the last line of a
+ * file that does not end in a newline.
+ *
+ */
+void FileReader::readMappedBatch() {
+    size_t window = blockSize_;
+    while (lines_.empty() && mapPos_ < mapLength_) {
+        size_t end = std::min(mapPos_ + window, mapLength_);
+        const char* rest = splitLines(map_ + mapPos_, map_ + end);
+        if (!lines_.empty()) {
+            mapPos_ = rest - map_;
+        } else if (end == mapLength_) {
+            LineSpan span = {map_ + mapPos_, mapLength_ - mapPos_};
+            lines_.push_back(span);
+            mapPos_ = mapLength_;
+        } else {
+            // no complete record in the window, so look further ahead
+            window *= 2;
+        }
+    }
+
+    if (lines_.empty()) {
+        closeFile();
+    }
+}
+
+/**
+ * @brief Split a block of data into lines.
+ *
+ * Find each newline in the data that is not inside a quoted field, and add the
+ * record it ends to the current batch. The data is not modified, so records
+ * that span several lines keep their newlines.
+ *
+ * Lines are only examined for quotes if they contain any, so a block without
+ * quotes is split with one pass of memchr for the quotes and one for the
+ * newlines.
+ *
+ * @param start  The start of the first record in the block.
+ * @param end    One past the end of the data.
+ *
+ * @return  The start of the incomplete record at the end of the block. If the
+ *          block ended with a complete record this will be end.
+ *
+ */
+const char* FileReader::splitLines(const char* start, const char* end) {
+    RecordScanner::State state = RecordScanner::OUTSIDE_QUOTES;
+    const char* recordStart = start;
+    const char* lineStart = start;
+    const char* quote =
+        static_cast<const char*>(memchr(start, '"', end - start));
+    const char* newline =
+        static_cast<const char*>(memchr(start, '\n', end - start));
+    while (newline != nullptr) {
+        if (quote != nullptr && quote < newline) {
+            state = RecordScanner::scanLine(lineStart, newline, state);
+            quote = static_cast<const char*>(
+                memchr(newline, '"', end - newline));
+        }
+
+        if (state == RecordScanner::OUTSIDE_QUOTES) {
+            LineSpan span = {recordStart,
+                             static_cast<size_t>(newline - recordStart)};
+            lines_.push_back(span);
+            recordStart = newline + 1;
+        }
+        lineStart = newline + 1;
+        newline = static_cast<const char*>(
+            memchr(lineStart, '\n', end - lineStart));
+    }
+
+    partialLine_ = lineStart;
+    partialState_ = state;
+    return recordStart;
 }
 
 void FileReader::setError(const std::string& msg) {
@@ -113,6 +612,15 @@ void FileReader::setError(const std::string& msg) {
 }
 
 void FileReader::closeFile() {
-    fclose(file_); // best effort - we'll ignore errors
-    file_ = nullptr;
+    // the background thread must stop before its file is closed
+    releaseBlock();
+    readAhead_.reset();
+    if (map_ != nullptr) {
+        munmap(const_cast<char*>(map_), mapLength_);
+        map_ = nullptr;
+    }
+    if (fd_ >= 0) {
+        close(fd_); // best effort - we'll ignore errors
+        fd_ = -1;
+    }
 }
@@ -5,34 +5,111 @@
 #ifndef CSVFILTER_FILE_READER_H
 #define CSVFILTER_FILE_READER_H
 
+#include "readAhead.h"
+#include "recordScanner.h"
+
 #include <string>
-#include <stdio.h>
+#include <vector>
+#include <memory>
+#include <stddef.h>
 
 /**
  * @brief Reads a file
  *
- * Class that reads the contents of a file, a line at a time.
+ * Class that reads the contents of a file, a line at a time. A line here is a
+ * whole csv record, which may span several lines of the file if a quoted field
+ * contains newlines (see RecordScanner).
+ *
+ * Internally the file is read in large blocks, and each block is split into a
+ * batch of lines in one pass. Lines are then handed out from the batch until it
+ * is exhausted, at which point the next block is read. A line that straddles
+ * two or more blocks is copied into a separate buffer and completed from the
+ * following blocks, so there is no limit on the length of a line. Lines within
+ * a block are returned in place, whether or not they contain newlines.
+ *
+ * Blocks may optionally be read ahead by a background thread (see ReadAhead),
+ * so that waiting for the file overlaps with processing the lines.
+ *
+ * Alternatively the file can be read in chunks of whole lines, which are left
+ * unsplit for the caller to process (see FileReader::readChunk).
+ *
+ * Regular files may optionally be memory-mapped, in which case the blocks are
+ * windows onto the mapping rather than copies in a buffer. Standard input,
+ * pipes and other special files are always read into a buffer.
  *
  */
 class FileReader {
 public:
-    FileReader(const std::string& name);
+    FileReader(const std::string& name,
+               bool useMmap,
+               size_t blockSize,
+               int readAheadDepth);
     ~FileReader();
-    
+
     bool ok() const;
     const std::string& errText() const;
 
-    char* getLine();
+    const char* getLine(size_t& length);
+    bool hasBufferedLine() const;
+    size_t readChunk(std::vector<char>& chunk, size_t size);
 
 private:
     // copy and assignment opterators
     FileReader(const FileReader& other);
     FileReader& operator=(const FileReader& other);
 
+    /**
+     * @brief A line within the current block.
+     */
+    typedef struct {
+        const char* start; ///< The first character of the line
+        size_t length;     ///< The length of the line, excluding its newline
+    } LineSpan;
+
     void setError(const std::string& msg);
     void closeFile();
-    char* line_;
-    FILE* file_;
+
+    bool mapFile();
+    void readBatch();
+    void readBufferedBatch();
+    void readMappedBatch();
+    const char* splitLines(const char* start, const char* end);
+
+    bool acquireBlock();
+    void releaseBlock();
+    void appendToCarry(const char* data, size_t length);
+    void startCarry(const char* data, size_t length);
+    const char* continueCarry(const char* start, const char* end);
+    void pushCarriedLine();
+
+    void startChunks(std::vector<char>& chunk, size_t& length);
+    void readBufferedChunk(std::vector<char>& chunk, size_t& length,
+                           size_t size);
+    void readMappedChunk(std::vector<char>& chunk, size_t& length,
+                         size_t size);
+    static void appendToChunk(std::vector<char>& chunk, size_t& length,
+                              const char* data, size_t count);
+
+    int fd_;
+    size_t blockSize_;
+    std::unique_ptr<ReadAhead> readAhead_;
+    char* buf_;
+    char* block_;
+    size_t blockLength_;
+    size_t blockPos_;
+    char* carry_;
+    size_t carrySize_;
+    size_t carryLength_;
+    size_t carryLineStart_;
+    RecordScanner::State carryState_;
+    const char* partialLine_;
+    RecordScanner::State partialState_;
+    const char* map_;
+    size_t mapLength_;
+    size_t mapPos_;
+    std::vector<LineSpan> lines_;
+    size_t nextLine_;
+    bool chunking_;
     bool ok_;
     std::string errText_;
 };
@@ -4,10 +4,39 @@
 
 #include "binaryOperator.h"
 
+#include <algorithm>
+#include <functional>
 #include <sstream>
+#include <limits>
+#include <math.h>
+#include <stdint.h>
 #include <string.h>
 #include <assert.h>
 
+/**
+ * @brief The most strings a line is searched for before it is parsed.
+ *
+ * Searching for many strings costs more than parsing the line, so long chains
+ * of '||' are not searched for at all.
+ */
+static const size_t MAX_NEEDLES = 4;
+
+/**
+ * @brief The length of the shortest string in a list.
+ *
+ * Longer strings occur in fewer lines, so this is used to pick the more
+ * selective of two lists of strings.
+ */
+static size_t shortestNeedle(const std::vector<std::string>& needles) {
+    size_t ret = 0;
+    for (size_t i = 0; i < needles.size(); i++) {
+        if (i == 0 || needles[i].size() < ret) {
+            ret = needles[i].size();
+        }
+    }
+    return ret;
+}
+
 /**
  *
  * @brief Constructor.
@@ -68,12 +97,12 @@ VariantRef NumericBinaryOperator::eval(const LineParser& line,
         ret = l;
     } else if (r->type() == Variant::ERROR) {
         ret = r;
-    } else if (l->type() != Variant::NUMBER) {
+    } else if (!l->isNumber()) {
         std::stringstream msg;
         msg << "Left hand side of operator at " << op_->position().begin
             << ": expected number, got " << l->type();
         result_->resetToError(msg.str());
-    } else if (r->type() != Variant::NUMBER) {
+    } else if (!r->isNumber()) {
         std::stringstream msg;
         msg << "Right hand side of operator at " << op_->position().begin
             << ": expected number, got " << r->type();
@@ -81,13 +110,13 @@ VariantRef NumericBinaryOperator::eval(const LineParser& line,
     } else {
         switch (op_->type()) {
         case LexToken::TYPE_MINUS:
-            result_->resetToNumber(l->numberVal() - r->numberVal());
+            result_->resetToNumber(l->asNumber().subtract(r->asNumber()));
             break;
         case LexToken::TYPE_TIMES:
-            result_->resetToNumber(l->numberVal() * r->numberVal());
+            result_->resetToNumber(l->asNumber().multiply(r->asNumber()));
             break;
         case LexToken::TYPE_DIVIDE:
-            result_->resetToNumber(l->numberVal() / r->numberVal());
+            result_->resetToNumber(l->asNumber().divide(r->asNumber()));
             break;
         default:
             // should never happen - this function only handles numeric
@@ -111,10 +140,126 @@ bool NumericBinaryOperator::canBeNumber(const LineParser& line) const {
     return true;
 }
 
+/**
+ * @copydoc ParseTree::compile
+ */
+int NumericBinaryOperator::compile(Program& program, NodeType typeHint) const {
+    int l = lhs_->compile(program, NODE_TYPE_NUMBER);
+    int r = rhs_->compile(program, NODE_TYPE_NUMBER);
+    int ret = program.addRegister();
+    Program::Opcode op = Program::OP_SUBTRACT;
+    switch (op_->type()) {
+    case LexToken::TYPE_MINUS:
+        op = Program::OP_SUBTRACT;
+        break;
+    case LexToken::TYPE_TIMES:
+        op = Program::OP_MULTIPLY;
+        break;
+    case LexToken::TYPE_DIVIDE:
+        op = Program::OP_DIVIDE;
+        break;
+    default:
+        // should never happen - this class only handles numeric operators
+        abort();
+        break;
+    }
+    program.emit(op, ret, l, r, op_->position().begin);
+    return ret;
+}
+
+/**
+ * @copydoc ParseTree::numberFields
+ */
+bool NumericBinaryOperator::numberFields(std::vector<int>& fields) const {
+    return true;
+}
+
 Range NumericBinaryOperator::position() const {
     return Range(lhs_->position().begin, rhs_->position().end);
 }
 
+/**
+ * @copydoc ParseTree::highestColumn
+ */
+int NumericBinaryOperator::highestColumn() const {
+    return std::max(lhs_->highestColumn(), rhs_->highestColumn());
+}
+
+/**
+ * @copydoc ParseTree::simplifyNode
+ */
+ParseTreeRef NumericBinaryOperator::simplifyNode() {
+    lhs_ = simplify(lhs_);
+    rhs_ = simplify(rhs_);
+    return fold();
+}
+
+/**
+ * @copydoc ParseTree::monotonicIn
+ *
+ * This is the case if one side is a constant, other than for a constant
+ * divided by something, or anything multiplied or divided by zero.
+ */
+ParseTreeRef NumericBinaryOperator::monotonicIn(int& direction) const {
+    ParseTreeRef ret;
+    Number constant;
+    double c = 0.0;
+    if (rhs_->numberConstant(constant) && isfinite(c = constant.doubleVal())) {
+        if (op_->type() == LexToken::TYPE_MINUS) {
+            direction = 1;
+            ret = lhs_;
+        } else if (c != 0.0) {
+            direction = (c > 0.0) ? 1 : -1;
+            ret = lhs_;
+        }
+    } else if (lhs_->numberConstant(constant) &&
+               isfinite(c = constant.doubleVal())) {
+        if (op_->type() == LexToken::TYPE_MINUS) {
+            direction = -1;
+            ret = rhs_;
+        } else if (op_->type() == LexToken::TYPE_TIMES && c != 0.0) {
+            direction = (c > 0.0) ? 1 : -1;
+            ret = rhs_;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @copydoc ParseTree::apply
+ */
+Number NumericBinaryOperator::apply(const Number& x) const {
+    Number l = x;
+    Number r = x;
+    if (!rhs_->numberConstant(r)) {
+        lhs_->numberConstant(l);
+    }
+
+    Number ret;
+    switch (op_->type()) {
+    case LexToken::TYPE_MINUS:
+        ret = l.subtract(r);
+        break;
+    case LexToken::TYPE_TIMES:
+        ret = l.multiply(r);
+        break;
+    default:
+        ret = l.divide(r);
+        break;
+    }
+    return ret;
+}
+
+/**
+ * @copydoc ParseTree::monotonicOperand
+ */
+void NumericBinaryOperator::monotonicOperand(Program::Operand& operand, int& pos) const {
+    Number c;
+    operand = rhs_->numberConstant(c) ? Program::OPERAND_LEFT
+                                      : Program::OPERAND_RIGHT;
+    pos = op_->position().begin;
+}
+
 ParseTree::NodeType NumericBinaryOperator::validateOperandType(
     ParseTreeRef op,
     ParseError& err) {
@@ -245,10 +390,124 @@ bool LogicalBinaryOperator::canBeNumber(const LineParser& line) const {
     return false;
 }
 
+/**
+ * @copydoc ParseTree::compile
+ *
+ * A chain of the same operator is compiled as a list of terms (see
+ * ParseTree::logicalTerms), in the order the program asks for. The rest of
+ * the chain is jumped over as soon as one of the terms decides the result.
+ */
+int LogicalBinaryOperator::compile(Program& program, NodeType typeHint) const {
+    std::vector<const ParseTree*> terms;
+    logicalTerms(op_->type(), terms);
+    std::vector<bool> canFail;
+    for (size_t i = 0; i < terms.size(); i++) {
+        canFail.push_back(terms[i]->canFail());
+    }
+
+    bool isAnd = (op_->type() == LexToken::TYPE_AND);
+    int pos = op_->position().begin;
+    size_t chain = program.beginChain(pos, isAnd, canFail);
+    const std::vector<int> order = program.termOrder(chain);
+    int ret = program.addRegister();
+    std::vector<size_t> skips;
+    for (size_t i = 0; i < order.size(); i++) {
+        program.beginTerm(chain);
+        int term = terms[order[i]]->compile(program, NODE_TYPE_BOOL);
+        if (i + 1 < order.size()) {
+            skips.push_back(program.emit(isAnd ? Program::OP_AND
+                                               : Program::OP_OR,
+                                         ret, term, -1, pos));
+        } else {
+            program.emit(Program::OP_RIGHT_BOOLEAN, ret, term, -1, pos);
+        }
+    }
+    program.endChain(chain);
+    for (size_t i = 0; i < skips.size(); i++) {
+        program.setTarget(skips[i]);
+    }
+    return ret;
+}
+
+/**
+ * @copydoc ParseTree::numberFields
+ */
+bool LogicalBinaryOperator::numberFields(std::vector<int>& fields) const {
+    return false;
+}
+
 Range LogicalBinaryOperator::position() const {
     return Range(lhs_->position().begin, rhs_->position().end);
 }
 
+/**
+ * @copydoc ParseTree::highestColumn
+ */
+int LogicalBinaryOperator::highestColumn() const {
+    return std::max(lhs_->highestColumn(), rhs_->highestColumn());
+}
+
+/**
+ * @copydoc ParseTree::simplifyNode
+ */
+ParseTreeRef LogicalBinaryOperator::simplifyNode() {
+    lhs_ = simplify(lhs_);
+    rhs_ = simplify(rhs_);
+    return ParseTreeRef();
+}
+
+/**
+ * @copydoc ParseTree::requiredText
+ *
+ * For '&&' either side's text will do, so the one that is likely to match
+ * fewer lines is used. For '||' a line must contain the text needed by one
+ * side or the other.
+ */
+bool LogicalBinaryOperator::requiredText(
+    std::vector<std::string>& needles) const {
+    std::vector<std::string> r;
+    bool ret = lhs_->requiredText(needles) && rhs_->requiredText(r);
+    if (!ret) {
+        needles.clear();
+    } else if (op_->type() == LexToken::TYPE_AND) {
+        if (needles.empty() ||
+            (!r.empty() &&
+             (shortestNeedle(r) > shortestNeedle(needles) ||
+              (shortestNeedle(r) == shortestNeedle(needles) &&
+               r.size() < needles.size())))) {
+            needles.swap(r);
+        }
+    } else if (needles.empty() || r.empty()) {
+        // either side can be true for a line without any particular text
+        needles.clear();
+    } else {
+        for (size_t i = 0; i < r.size(); i++) {
+            if (std::find(needles.begin(), needles.end(), r[i]) ==
+                needles.end()) {
+                needles.push_back(r[i]);
+            }
+        }
+        if (needles.size() > MAX_NEEDLES) {
+            needles.clear();
+        }
+    }
+    return ret;
+}
+
+/**
+ * @copydoc ParseTree::logicalTerms
+ */
+void LogicalBinaryOperator::logicalTerms(
+    LexToken::Type op,
+    std::vector<const ParseTree*>& terms) const {
+    if (op_->type() == op) {
+        lhs_->logicalTerms(op, terms);
+        rhs_->logicalTerms(op, terms);
+    } else {
+        terms.push_back(this);
+    }
+}
+
 ParseTree::NodeType LogicalBinaryOperator::validateOperandType(
     ParseTreeRef op,
     ParseError& err) {
@@ -279,7 +538,14 @@ ParseTree::NodeType LogicalBinaryOperator::validateOperandType(
 ComparisonBinaryOperator::ComparisonBinaryOperator(ConstLexTokenRef op,
                                                    ParseTreeRef lhs,
                                                    ParseTreeRef rhs)
-    :op_(op), lhs_(lhs), rhs_(rhs), result_(Variant::error("uninitialised")) {
+    :op_(op),
+     lhs_(lhs),
+     rhs_(rhs),
+     position_(lhs->position().begin, rhs->position().end),
+     leftOperand_(Program::OPERAND_LEFT),
+     leftPos_(op->position().begin),
+     comparisonType_(NODE_TYPE_UNKNOWN),
+     result_(Variant::error("uninitialised")) {
     assert(op_->type() == LexToken::TYPE_LT  ||
            op_->type() == LexToken::TYPE_LTE ||
            op_->type() == LexToken::TYPE_EQ  ||
@@ -356,7 +622,11 @@ bool ComparisonBinaryOperator::setType(NodeType t, ParseError& err) {
 VariantRef ComparisonBinaryOperator::eval(const LineParser& line,
                                           NodeType typeHint) const {
     VariantRef ret;
-    if (lhs_->canBeNumber(line) && rhs_->canBeNumber(line)) {
+    if (comparisonType_ == NODE_TYPE_NUMBER) {
+        ret = evalComparisonNumber(line, typeHint);
+    } else if (comparisonType_ == NODE_TYPE_STRING) {
+        ret = evalComparisonString(line, typeHint);
+    } else if (lhs_->canBeNumber(line) && rhs_->canBeNumber(line)) {
         ret = evalComparisonNumber(line, typeHint);
     } else {
         ret = evalComparisonString(line, typeHint);
@@ -376,8 +646,400 @@ bool ComparisonBinaryOperator::canBeNumber(const LineParser& line) const {
     return false;
 }
 
+/**
+ * @copydoc ParseTree::compile
+ *
+ * If the operands might be numbers, depending on the line, then both a
+ * numeric and a string comparison are compiled, and the fields are checked
+ * to pick one.
+ */
+int ComparisonBinaryOperator::compile(Program& program,
+                                      NodeType typeHint) const {
+    int ret = program.addRegister();
+    std::vector<int> fields;
+    if (!lhs_->numberFields(fields) || !rhs_->numberFields(fields)) {
+        compileComparison(program, NODE_TYPE_STRING, ret);
+    } else if (fields.empty()) {
+        compileComparison(program, NODE_TYPE_NUMBER, ret);
+    } else {
+        size_t toString = program.emitJumpUnlessNumbers(fields);
+        compileComparison(program, NODE_TYPE_NUMBER, ret);
+        size_t toEnd = program.emitJump();
+        program.setTarget(toString);
+        compileComparison(program, NODE_TYPE_STRING, ret);
+        program.setTarget(toEnd);
+    }
+    return ret;
+}
+
+/**
+ * @copydoc ParseTree::numberFields
+ */
+bool ComparisonBinaryOperator::numberFields(std::vector<int>& fields) const {
+    return false;
+}
+
+/**
+ * @copydoc ParseTree::position
+ *
+ * This is where the comparison was written, even if it has been simplified.
+ */
 Range ComparisonBinaryOperator::position() const {
-    return Range(lhs_->position().begin, rhs_->position().end);
+    return position_;
+}
+
+/**
+ * @copydoc ParseTree::highestColumn
+ */
+int ComparisonBinaryOperator::highestColumn() const {
+    return std::max(lhs_->highestColumn(), rhs_->highestColumn());
+}
+
+/**
+ * @copydoc ParseTree::simplifyNode
+ *
+ * Comparisons between a monotonic function of x (see ParseTree::monotonicIn)
+ * and a constant are rewritten as comparisons between x and a different
+ * constant, when there is one that gives exactly the same result for every x.
+ * The constant is put on the right hand side first. Comparisons between
+ * constants are left alone, as there are no boolean constants. If x is not a
+ * number, the error is reported as it would have been by the arithmetic that
+ * was applied to it (see ParseTree::monotonicOperand).
+ *
+ * If the types of both sides are known by now, the kind of comparison is
+ * fixed here rather than being worked out for every line.
+ */
+ParseTreeRef ComparisonBinaryOperator::simplifyNode() {
+    lhs_ = simplify(lhs_);
+    rhs_ = simplify(rhs_);
+
+    Number k;
+    int direction = 0;
+    if (lhs_->numberConstant(k) && rhs_->monotonicIn(direction) != nullptr) {
+        std::swap(lhs_, rhs_);
+        op_ = comparisonToken(mirror(op_->type()), op_->position());
+        leftOperand_ = Program::OPERAND_RIGHT;
+    }
+
+    ParseTreeRef x;
+    while (rhs_->numberConstant(k) &&
+           (x = lhs_->monotonicIn(direction)) != nullptr) {
+        LexToken::Type op = op_->type();
+        if (!solve(*lhs_, direction, op, k)) {
+            break;
+        }
+        lhs_->monotonicOperand(leftOperand_, leftPos_);
+        lhs_ = x;
+        rhs_ = makeConstant(k, rhs_->position());
+        op_ = comparisonToken(op, op_->position());
+    }
+
+    std::vector<int> fields;
+    if (!lhs_->numberFields(fields) || !rhs_->numberFields(fields)) {
+        comparisonType_ = NODE_TYPE_STRING;
+    } else if (fields.empty()) {
+        comparisonType_ = NODE_TYPE_NUMBER;
+    }
+    return ParseTreeRef();
+}
+
+/**
+ * @copydoc ParseTree::requiredText
+ *
+ * Numeric comparisons fail if a field is not a number. A field can only be
+ * equal to a non-empty string constant if the line contains that string.
+ */
+bool ComparisonBinaryOperator::requiredText(
+    std::vector<std::string>& needles) const {
+    std::vector<std::string> r;
+    bool ret = comparisonType_ != NODE_TYPE_NUMBER &&
+               lhs_->requiredText(needles) && rhs_->requiredText(r);
+    needles.clear();
+
+    std::string constant;
+    if (ret && comparisonType_ == NODE_TYPE_STRING &&
+        op_->type() == LexToken::TYPE_EQ &&
+        ((lhs_->fieldIndex() >= 0 && rhs_->stringConstant(constant)) ||
+         (rhs_->fieldIndex() >= 0 && lhs_->stringConstant(constant))) &&
+        !constant.empty()) {
+        needles.push_back(constant);
+    }
+    return ret;
+}
+
+/**
+ * @brief Swap the sides of a comparison operator.
+ *
+ * @param op  The operator.
+ *
+ * @return  The operator that gives the same result with its operands swapped
+ *          (so '<' becomes '>').
+ *
+ */
+LexToken::Type ComparisonBinaryOperator::mirror(LexToken::Type op) {
+    LexToken::Type ret = op;
+    switch (op) {
+    case LexToken::TYPE_LT:  ret = LexToken::TYPE_GT;  break;
+    case LexToken::TYPE_LTE: ret = LexToken::TYPE_GTE; break;
+    case LexToken::TYPE_GT:  ret = LexToken::TYPE_LT;  break;
+    case LexToken::TYPE_GTE: ret = LexToken::TYPE_LTE; break;
+    default:                                           break;
+    }
+    return ret;
+}
+
+/**
+ * @brief Make a token for a comparison operator.
+ *
+ * @param op   The operator.
+ * @param pos  Where the operator is in the expression.
+ *
+ * @return  The new token.
+ *
+ */
+ConstLexTokenRef ComparisonBinaryOperator::comparisonToken(LexToken::Type op,
+                                                           Range pos) {
+    const char* value = "";
+    switch (op) {
+    case LexToken::TYPE_LT:  value = "<";  break;
+    case LexToken::TYPE_LTE: value = "<="; break;
+    case LexToken::TYPE_EQ:  value = "=="; break;
+    case LexToken::TYPE_NEQ: value = "!="; break;
+    case LexToken::TYPE_GT:  value = ">";  break;
+    default:                 value = ">="; break;
+    }
+    return ConstLexTokenRef(new LexToken(op, pos, value));
+}
+
+/**
+ * @brief Move a monotonic function to the other side of a comparison.
+ *
+ * Find the comparison "x op2 k2" that gives the same result as "f(x) op k" for
+ * every x, including infinities and NaN. As f is monotonic, the values of x
+ * for which the comparison is true are all on one side of a threshold, so
+ * this searches for that threshold, trying f with every possible double
+ * rather than trusting the inverse of f (which would be thrown out by
+ * rounding). Integers are worked out with integer arithmetic, so the
+ * threshold is then checked against every possible integer too.
+ *
+ * @param f          The monotonic node. See ParseTree::monotonicIn.
+ * @param direction  The direction given by ParseTree::monotonicIn.
+ * @param op         The comparison operator. Updated to op2.
+ * @param k          The constant. Updated to k2, which is an integer if it is
+ *                   a whole number that a double can hold exactly.
+ *
+ * @return  true if the comparison was rewritten, false if there is no
+ *          equivalent comparison (e.g. f(x) == k holds for a range of x).
+ *
+ */
+bool ComparisonBinaryOperator::solve(const ParseTree& f,
+                                     int direction,
+                                     LexToken::Type& op,
+                                     Number& k) {
+    bool ret = isfinite(k.doubleVal());
+    if (ret && direction < 0) {
+        // -f(x) never decreases, and negation is exact
+        op = mirror(op);
+        k = k.negate();
+    }
+
+    // lo is the lowest x with f(x) >= k, and hi the highest with f(x) <= k
+    Number lo;
+    Number above;
+    double hi = 0.0;
+    bool haveLo = ret && firstAbove(&f, direction, k, false, false, lo);
+    bool haveHi = ret;
+    if (ret) {
+        if (!firstAbove(&f, direction, k, true, false, above)) {
+            hi = std::numeric_limits<double>::infinity();
+        } else if (above.doubleVal() ==
+                   -std::numeric_limits<double>::infinity()) {
+            haveHi = false;
+        } else {
+            hi = nextafter(above.doubleVal(),
+                           -std::numeric_limits<double>::infinity());
+        }
+    }
+
+    double threshold = 0.0;
+    switch (op) {
+    case LexToken::TYPE_LT:
+    case LexToken::TYPE_GTE:
+        ret = haveLo;
+        threshold = lo.doubleVal();
+        break;
+    case LexToken::TYPE_LTE:
+    case LexToken::TYPE_GT:
+        ret = haveHi;
+        threshold = hi;
+        break;
+    default:
+        // equality only has a single threshold if exactly one x matches
+        ret = haveLo && haveHi && lo.doubleVal() == hi;
+        threshold = lo.doubleVal();
+        break;
+    }
+
+    if (ret) {
+        Number k2 = Number::real(threshold);
+        if (threshold == floor(threshold) &&
+            fabs(threshold) <= 9007199254740992.0) {
+            // integer fields are compared with this without any conversion
+            k2 = Number::integer(static_cast<int64_t>(threshold));
+        }
+        ret = sameForIntegers(f, direction, op, k, k2);
+        k = k2;
+    }
+    return ret;
+}
+
+/**
+ * @brief Check a rewritten comparison for integers.
+ *
+ * Check that "x op k2" gives the same result as "f(x) op k" for every integer
+ * x, which may not be the case if f(x) is too big for a double. The values of
+ * x for which each comparison is true are found in the same way as in
+ * ComparisonBinaryOperator::solve.
+ *
+ * @param f          The monotonic node.
+ * @param direction  The direction given by ParseTree::monotonicIn.
+ * @param op         The comparison operator, after any mirroring.
+ * @param k          The constant, after any negation.
+ * @param k2         The constant the comparison has been rewritten to use.
+ *
+ * @return  true if the comparisons match for every integer.
+ *
+ */
+bool ComparisonBinaryOperator::sameForIntegers(const ParseTree& f,
+                                               int direction,
+                                               LexToken::Type op,
+                                               const Number& k,
+                                               const Number& k2) {
+    // the lowest integer where f(x) >= k, and where f(x) > k
+    Number lo;
+    Number above;
+    bool haveLo = firstAbove(&f, direction, k, false, true, lo);
+    bool haveAbove = firstAbove(&f, direction, k, true, true, above);
+
+    // the same for x compared with k2
+    Number lo2;
+    Number above2;
+    bool haveLo2 = firstAbove(nullptr, 1, k2, false, true, lo2);
+    bool haveAbove2 = firstAbove(nullptr, 1, k2, true, true, above2);
+
+    bool sameLo = (haveLo == haveLo2) &&
+                  (!haveLo || lo.integerVal() == lo2.integerVal());
+    bool sameAbove = (haveAbove == haveAbove2) &&
+                     (!haveAbove ||
+                      above.integerVal() == above2.integerVal());
+
+    bool ret = false;
+    switch (op) {
+    case LexToken::TYPE_LT:
+    case LexToken::TYPE_GTE:
+        ret = sameLo;
+        break;
+    case LexToken::TYPE_LTE:
+    case LexToken::TYPE_GT:
+        ret = sameAbove;
+        break;
+    default: {
+        // f(x) == k from lo up to (but not including) above
+        bool none = !haveLo ||
+                    (haveAbove && above.integerVal() <= lo.integerVal());
+        bool none2 = !haveLo2 ||
+                     (haveAbove2 && above2.integerVal() <= lo2.integerVal());
+        ret = (none && none2) || (!none && !none2 && sameLo && sameAbove);
+        break;
+    }
+    }
+    return ret;
+}
+
+/**
+ * @brief Find the lowest x where a monotonic function goes above a value.
+ *
+ * This is a binary search over every double from -infinity to infinity, or
+ * every integer, in order. It takes at most 64 steps.
+ *
+ * @param f          The monotonic node, or nullptr for x itself. See
+ *                   ParseTree::monotonicIn.
+ * @param direction  The direction given by ParseTree::monotonicIn. If this is
+ *                   -1, then -f(x) is used instead of f(x).
+ * @param k          The value.
+ * @param strict     Look for f(x) > k rather than f(x) >= k.
+ * @param integers   Search the integers rather than the doubles.
+ * @param x          Set to the lowest x.
+ *
+ * @return  false if f(x) is never above k, true otherwise.
+ *
+ */
+bool ComparisonBinaryOperator::firstAbove(const ParseTree* f,
+                                          int direction,
+                                          const Number& k,
+                                          bool strict,
+                                          bool integers,
+                                          Number& x) {
+    int64_t lo = std::numeric_limits<int64_t>::min();
+    int64_t hi = std::numeric_limits<int64_t>::max();
+    if (!integers) {
+        lo = orderedBits(-std::numeric_limits<double>::infinity());
+        hi = orderedBits(std::numeric_limits<double>::infinity());
+    }
+    x = integers ? Number::integer(hi) : Number::real(fromOrderedBits(hi));
+    bool ret = isAbove(f, direction, x, k, strict);
+    while (ret && lo < hi) {
+        // the range does not fit in an int64_t
+        int64_t mid = lo + static_cast<int64_t>(
+            (static_cast<uint64_t>(hi) - static_cast<uint64_t>(lo)) / 2);
+        x = integers ? Number::integer(mid)
+                     : Number::real(fromOrderedBits(mid));
+        if (isAbove(f, direction, x, k, strict)) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    x = integers ? Number::integer(lo) : Number::real(fromOrderedBits(lo));
+    return ret;
+}
+
+bool ComparisonBinaryOperator::isAbove(const ParseTree* f,
+                                       int direction,
+                                       const Number& x,
+                                       const Number& k,
+                                       bool strict) {
+    Number y = (f != nullptr) ? f->apply(x) : x;
+    if (direction < 0) {
+        y = y.negate();
+    }
+    return strict ? y.compare(k, std::greater<double>())
+                  : y.compare(k, std::greater_equal<double>());
+}
+
+/**
+ * @brief Map a double onto an integer with the same ordering.
+ *
+ * Both zeros map to 0. This must not be called with NaN.
+ *
+ */
+int64_t ComparisonBinaryOperator::orderedBits(double d) {
+    int64_t bits = 0;
+    memcpy(&bits, &d, sizeof(bits));
+    return (bits < 0) ? -(bits & std::numeric_limits<int64_t>::max()) : bits;
+}
+
+/**
+ * @brief The inverse of ComparisonBinaryOperator::orderedBits.
+ *
+ */
+double ComparisonBinaryOperator::fromOrderedBits(int64_t bits) {
+    if (bits < 0) {
+        bits = (-bits) | std::numeric_limits<int64_t>::min();
+    }
+    double ret = 0.0;
+    memcpy(&ret, &bits, sizeof(ret));
+    return ret;
 }
 
 /**
@@ -406,14 +1068,13 @@ VariantRef ComparisonBinaryOperator::evalComparisonString(
     } else if (r->type() == Variant::ERROR) {
         ret = r;
     } else if (l->type() != Variant::STRING) {
-        std::stringstream msg;
-        msg << "Left hand side of operator at " << op_->position().begin
-            << ": expected string, got " << l->type();
-        result_->resetToError(msg.str());
+        result_->resetToError(Program::operandError(leftOperand_, leftPos_,
+                                                    Variant::STRING,
+                                                    l->type()));
     } else if (r->type() != Variant::STRING) {
         std::stringstream msg;
         msg << "Right hand side of operator at " << op_->position().begin
-            << ": expected string, got " << l->type();
+            << ": expected string, got " << r->type();
         result_->resetToError(msg.str());
     } else {
         switch (op_->type()) {
@@ -444,6 +1105,73 @@ VariantRef ComparisonBinaryOperator::evalComparisonString(
     return ret;
 }
 
+/**
+ * @brief Compile a comparison of numbers or strings
+ *
+ * @param program  The program to add to.
+ * @param type     NODE_TYPE_NUMBER or NODE_TYPE_STRING.
+ * @param dest     The register to put the result in.
+ *
+ */
+void ComparisonBinaryOperator::compileComparison(Program& program,
+                                                 NodeType type,
+                                                 int dest) const {
+    bool number = (type == NODE_TYPE_NUMBER);
+    Program::Opcode op = Program::OP_STRING_EQ;
+    switch (op_->type()) {
+    case LexToken::TYPE_LT:
+        op = number ? Program::OP_NUMBER_LT : Program::OP_STRING_LT;
+        break;
+    case LexToken::TYPE_LTE:
+        op = number ? Program::OP_NUMBER_LTE : Program::OP_STRING_LTE;
+        break;
+    case LexToken::TYPE_EQ:
+        op = number ? Program::OP_NUMBER_EQ : Program::OP_STRING_EQ;
+        break;
+    case LexToken::TYPE_NEQ:
+        op = number ? Program::OP_NUMBER_NEQ : Program::OP_STRING_NEQ;
+        break;
+    case LexToken::TYPE_GT:
+        op = number ? Program::OP_NUMBER_GT : Program::OP_STRING_GT;
+        break;
+    case LexToken::TYPE_GTE:
+        op = number ? Program::OP_NUMBER_GTE : Program::OP_STRING_GTE;
+        break;
+    default:
+        // it's not a comparison operator
+        abort();
+        break;
+    }
+
+    // the left hand side is compiled first, so that if both sides fail it is
+    // the left hand side that is reported. Loading a field cannot fail, so the
+    // right hand side can be looked at first when the left is a field.
+    int field = lhs_->fieldIndex();
+    if (field >= 0) {
+        int r = rhs_->compile(program, type);
+        size_t in = 0;
+        if (program.isConstant(r, number ? Variant::NUMBER
+                                         : Variant::STRING)) {
+            // the field does not need to be loaded into a register first
+            int offset = number ? op - Program::OP_NUMBER_LT
+                                : op - Program::OP_STRING_LT;
+            Program::Opcode base = number ? Program::OP_FIELD_NUMBER_LT
+                                          : Program::OP_FIELD_STRING_LT;
+            in = program.emit(static_cast<Program::Opcode>(base + offset),
+                              dest, field, r, op_->position().begin);
+        } else {
+            int l = lhs_->compile(program, type);
+            in = program.emit(op, dest, l, r, op_->position().begin);
+        }
+        program.setLeftOperand(in, leftOperand_, leftPos_);
+    } else {
+        int l = lhs_->compile(program, type);
+        int r = rhs_->compile(program, type);
+        size_t in = program.emit(op, dest, l, r, op_->position().begin);
+        program.setLeftOperand(in, leftOperand_, leftPos_);
+    }
+}
+
 /**
  * @brief Evaluate a comparison operator using numbers
  *
@@ -467,35 +1195,42 @@ VariantRef ComparisonBinaryOperator::evalComparisonNumber(
         ret = l;
     } else if (r->type() == Variant::ERROR) {
         ret = r;
-    } else if (l->type() != Variant::NUMBER) {
-        std::stringstream msg;
-        msg << "Left hand side of operator at " << op_->position().begin
-            << ": expected number, got " << l->type();
-        result_->resetToError(msg.str());
-    } else if (r->type() != Variant::NUMBER) {
+    } else if (!l->isNumber()) {
+        result_->resetToError(Program::operandError(leftOperand_, leftPos_,
+                                                    Variant::NUMBER,
+                                                    l->type()));
+    } else if (!r->isNumber()) {
         std::stringstream msg;
         msg << "Right hand side of operator at " << op_->position().begin
-            << ": expected number, got " << l->type();
+            << ": expected number, got " << r->type();
         result_->resetToError(msg.str());
     } else {
+        Number lVal = l->asNumber();
+        Number rVal = r->asNumber();
         switch (op_->type()) {
         case LexToken::TYPE_LT:
-            result_->resetToBoolean(l->numberVal() < r->numberVal());
+            result_->resetToBoolean(
+                lVal.compare(rVal, std::less<double>()));
             break;
         case LexToken::TYPE_LTE:
-            result_->resetToBoolean(l->numberVal() <= r->numberVal());
+            result_->resetToBoolean(
+                lVal.compare(rVal, std::less_equal<double>()));
             break;
         case LexToken::TYPE_EQ:
-            result_->resetToBoolean(l->numberVal() == r->numberVal());
+            result_->resetToBoolean(
+                lVal.compare(rVal, std::equal_to<double>()));
             break;
         case LexToken::TYPE_NEQ:
-            result_->resetToBoolean(l->numberVal() != r->numberVal());
+            result_->resetToBoolean(
+                lVal.compare(rVal, std::not_equal_to<double>()));
             break;
         case LexToken::TYPE_GT:
-            result_->resetToBoolean(l->numberVal() > r->numberVal());
+            result_->resetToBoolean(
+                lVal.compare(rVal, std::greater<double>()));
             break;
         case LexToken::TYPE_GTE:
-            result_->resetToBoolean(l->numberVal() >= r->numberVal());
+            result_->resetToBoolean(
+                lVal.compare(rVal, std::greater_equal<double>()));
             break;
         default:
             // it's not a comparison operator
@@ -524,14 +1259,12 @@ PlusBinaryOperator::PlusBinaryOperator(ConstLexTokenRef op,
      lhs_(lhs),
      rhs_(rhs),
      calculatedType_(NODE_TYPE_UNKNOWN),
-     result_(Variant::error("Uninitialised")),
-     addBuf_(nullptr),
-     addBufLen_(0) {
+     result_(Variant::error("Uninitialised")) {
     assert(op_->type() == LexToken::TYPE_PLUS);
 }
 
 PlusBinaryOperator::~PlusBinaryOperator() {
-    delete[] addBuf_;
+
 }
 
 ParseTree::NodeType PlusBinaryOperator::validateTypes(
@@ -647,10 +1380,126 @@ bool PlusBinaryOperator::canBeNumber(const LineParser& line) const {
           rhs_->canBeNumber(line) );
 }
 
+/**
+ * @copydoc ParseTree::compile
+ *
+ * If the type could not be worked out when the expression was parsed, then
+ * both an addition and a concatenation are compiled, and the fields are
+ * checked to pick one.
+ */
+int PlusBinaryOperator::compile(Program& program, NodeType typeHint) const {
+    int ret = program.addRegister();
+    std::vector<int> fields;
+    if (calculatedType_ == NODE_TYPE_NUMBER ||
+        (calculatedType_ == NODE_TYPE_UNKNOWN &&
+         typeHint == NODE_TYPE_NUMBER)) {
+        compilePlus(program, NODE_TYPE_NUMBER, ret);
+    } else if (calculatedType_ == NODE_TYPE_STRING ||
+               !lhs_->numberFields(fields) ||
+               !rhs_->numberFields(fields)) {
+        compilePlus(program, NODE_TYPE_STRING, ret);
+    } else if (fields.empty()) {
+        compilePlus(program, NODE_TYPE_NUMBER, ret);
+    } else {
+        size_t toString = program.emitJumpUnlessNumbers(fields);
+        compilePlus(program, NODE_TYPE_NUMBER, ret);
+        size_t toEnd = program.emitJump();
+        program.setTarget(toString);
+        compilePlus(program, NODE_TYPE_STRING, ret);
+        program.setTarget(toEnd);
+    }
+    return ret;
+}
+
+/**
+ * @copydoc ParseTree::numberFields
+ */
+bool PlusBinaryOperator::numberFields(std::vector<int>& fields) const {
+    return (calculatedType_ == NODE_TYPE_NUMBER) ||
+        ( calculatedType_ == NODE_TYPE_UNKNOWN &&
+          lhs_->numberFields(fields) &&
+          rhs_->numberFields(fields) );
+}
+
 Range PlusBinaryOperator::position() const {
     return Range(lhs_->position().begin, rhs_->position().end);
 }
 
+/**
+ * @copydoc ParseTree::highestColumn
+ */
+int PlusBinaryOperator::highestColumn() const {
+    return std::max(lhs_->highestColumn(), rhs_->highestColumn());
+}
+
+/**
+ * @copydoc ParseTree::simplifyNode
+ */
+ParseTreeRef PlusBinaryOperator::simplifyNode() {
+    lhs_ = simplify(lhs_);
+    rhs_ = simplify(rhs_);
+    return fold();
+}
+
+/**
+ * @copydoc ParseTree::monotonicIn
+ *
+ * This is the case for numeric addition with a constant on one side.
+ */
+ParseTreeRef PlusBinaryOperator::monotonicIn(int& direction) const {
+    ParseTreeRef ret;
+    Number c;
+    if (calculatedType_ == NODE_TYPE_NUMBER) {
+        if (rhs_->numberConstant(c) && isfinite(c.doubleVal())) {
+            ret = lhs_;
+        } else if (lhs_->numberConstant(c) && isfinite(c.doubleVal())) {
+            ret = rhs_;
+        }
+        direction = 1;
+    }
+    return ret;
+}
+
+/**
+ * @copydoc ParseTree::apply
+ */
+Number PlusBinaryOperator::apply(const Number& x) const {
+    Number l = x;
+    Number r = x;
+    if (!rhs_->numberConstant(r)) {
+        lhs_->numberConstant(l);
+    }
+    return l.add(r);
+}
+
+/**
+ * @copydoc ParseTree::monotonicOperand
+ */
+void PlusBinaryOperator::monotonicOperand(Program::Operand& operand, int& pos) const {
+    Number c;
+    operand = rhs_->numberConstant(c) ? Program::OPERAND_LEFT
+                                      : Program::OPERAND_RIGHT;
+    pos = op_->position().begin;
+}
+
+/**
+ * @brief Compile an addition or concatenation
+ *
+ * @param program  The program to add to.
+ * @param type     NODE_TYPE_NUMBER or NODE_TYPE_STRING.
+ * @param dest     The register to put the result in.
+ *
+ */
+void PlusBinaryOperator::compilePlus(Program& program,
+                                     NodeType type,
+                                     int dest) const {
+    int l = lhs_->compile(program, type);
+    int r = rhs_->compile(program, type);
+    program.emit(type == NODE_TYPE_NUMBER ? Program::OP_ADD
+                                          : Program::OP_CONCAT,
+                 dest, l, r, op_->position().begin);
+}
+
 /**
  * @brief Apply a plus for strings.
  *
@@ -685,16 +1534,12 @@ VariantRef PlusBinaryOperator::evalPlusString(const LineParser& line,
             << ": expected string, got " << r->type();
         result_->resetToError(msg.str());
     } else {
-        int lLen = strlen(l->charVal());
-        int rLen = strlen(r->charVal());
-        int required = lLen + rLen + 1;
-        if (addBufLen_ < required) {
-            delete[] addBuf_;
-            addBuf_ = new char[required];
-        }
-        strcpy(addBuf_, l->charVal());
-        strcpy(addBuf_ + lLen, r->charVal());
-        result_->resetToString(addBuf_);
+        size_t lLen = strlen(l->charVal());
+        size_t rLen = strlen(r->charVal());
+        char* buf = line.arena().alloc(lLen + rLen + 1);
+        memcpy(buf, l->charVal(), lLen);
+        memcpy(buf + lLen, r->charVal(), rLen + 1);
+        result_->resetToStringView(buf);
     }
 
     return ret;
@@ -723,20 +1568,177 @@ VariantRef PlusBinaryOperator::evalPlusNumber(const LineParser& line,
         ret = l;
     } else if (r->type() == Variant::ERROR) {
         ret = r;
-    } else if (l->type() != Variant::NUMBER) {
+    } else if (!l->isNumber()) {
         std::stringstream msg;
         msg << "Left hand side of operator at " << op_->position().begin
             << ": expected number, got " << l->type();
         result_->resetToError(msg.str());
-    } else if (r->type() != Variant::NUMBER) {
+    } else if (!r->isNumber()) {
         std::stringstream msg;
         msg << "Right hand side of operator at " << op_->position().begin
             << ": expected number, got " << r->type();
         result_->resetToError(msg.str());
     } else {
-        result_->resetToNumber(l->numberVal() + r->numberVal());
+        result_->resetToNumber(l->asNumber().add(r->asNumber()));
+    }
+
+    return ret;
+}
+
+
+/**
+ *
+ * @brief Constructor.
+ *
+ * Create a new InOperator node for the parse tree.
+ *
+ * @param op   The token for the operator. Must be an 'in'
+ * @param lhs  The expression that was on the left hand of the operator
+ * @param set  The values on the right hand of the operator
+ *
+ */
+InOperator::InOperator(ConstLexTokenRef op,
+                       ParseTreeRef lhs,
+                       ValueSetRef set)
+    :op_(op),
+     lhs_(lhs),
+     set_(set),
+     result_(Variant::error("uninitialised")) {
+    assert(op_->type() == LexToken::TYPE_IN);
+}
+
+InOperator::~InOperator() {
+
+}
+
+ParseTree::NodeType InOperator::validateTypes(ParseError& err) {
+    NodeType setType = set_->numbers() ? NODE_TYPE_NUMBER : NODE_TYPE_STRING;
+    NodeType l = lhs_->validateTypes(err);
+    NodeType ret = NODE_TYPE_BOOL;
+    if (l == NODE_TYPE_ERROR) {
+        ret = NODE_TYPE_ERROR;
+    } else if (l == NODE_TYPE_UNKNOWN) {
+        if (!lhs_->setType(setType, err)) {
+            ret = NODE_TYPE_ERROR;
+        }
+    } else if (l != setType) {
+        std::stringstream msg;
+        msg << "'in' expects a " << setType << " to look up in a set of "
+            << setType << "s (got a " << l << ")";
+        err = ParseError(msg.str(), op_->position(), lhs_->position());
+        ret = NODE_TYPE_ERROR;
+    }
+    return ret;
+}
+
+bool InOperator::setType(NodeType t, ParseError& err) {
+    bool success = true;
+    if (t != NODE_TYPE_BOOL) {
+        success = false;
+        std::stringstream msg;
+        msg << "Cannot coerce expression into a " << t;
+        err = ParseError(msg.str(), position());
+    }
+    return success;
+}
+
+VariantRef InOperator::eval(const LineParser& line, NodeType typeHint) const {
+    bool numbers = set_->numbers();
+    VariantRef l = lhs_->eval(line, numbers ? NODE_TYPE_NUMBER
+                                            : NODE_TYPE_STRING);
+    VariantRef ret = result_;
+    if (l->type() == Variant::ERROR) {
+        ret = l;
+    } else if (numbers && !l->isNumber()) {
+        std::stringstream msg;
+        msg << "Left hand side of operator at " << op_->position().begin
+            << ": expected number, got " << l->type();
+        result_->resetToError(msg.str());
+    } else if (!numbers && l->type() != Variant::STRING) {
+        std::stringstream msg;
+        msg << "Left hand side of operator at " << op_->position().begin
+            << ": expected string, got " << l->type();
+        result_->resetToError(msg.str());
+    } else if (numbers) {
+        result_->resetToBoolean(set_->contains(l->asNumber()));
+    } else {
+        result_->resetToBoolean(set_->contains(l->charVal()));
     }
+    return ret;
+}
+
+void InOperator::stream(std::ostream& out) {
+    out << "(" << op_->value() << " ";
+    lhs_->stream(out);
+    out << " {";
+    for (size_t i = 0; i < set_->size(); i++) {
+        out << (i == 0 ? "" : ", ") << set_->text(i);
+    }
+    out << "}):" << NODE_TYPE_BOOL;
+}
+
+bool InOperator::canBeNumber(const LineParser& line) const {
+    return false;
+}
 
+/**
+ * @copydoc ParseTree::compile
+ */
+int InOperator::compile(Program& program, NodeType typeHint) const {
+    bool numbers = set_->numbers();
+    int l = lhs_->compile(program, numbers ? NODE_TYPE_NUMBER
+                                           : NODE_TYPE_STRING);
+    int ret = program.addRegister();
+    program.emit(numbers ? Program::OP_NUMBER_IN : Program::OP_STRING_IN,
+                 ret, l, program.addSet(set_), op_->position().begin);
     return ret;
 }
 
+/**
+ * @copydoc ParseTree::numberFields
+ */
+bool InOperator::numberFields(std::vector<int>& fields) const {
+    return false;
+}
+
+Range InOperator::position() const {
+    return Range(lhs_->position().begin, set_->position().end);
+}
+
+/**
+ * @copydoc ParseTree::highestColumn
+ */
+int InOperator::highestColumn() const {
+    return lhs_->highestColumn();
+}
+
+/**
+ * @copydoc ParseTree::simplifyNode
+ */
+ParseTreeRef InOperator::simplifyNode() {
+    lhs_ = simplify(lhs_);
+    return ParseTreeRef();
+}
+
+/**
+ * @copydoc ParseTree::requiredText
+ *
+ * Looking up a number fails if the field is not a number. A field can only be
+ * in a small set of non-empty strings if the line contains one of them, as
+ * for a chain of '=='s joined by '||'.
+ */
+bool InOperator::requiredText(std::vector<std::string>& needles) const {
+    bool ret = !set_->numbers() && lhs_->requiredText(needles);
+    needles.clear();
+
+    if (ret && lhs_->fieldIndex() >= 0 && set_->size() <= MAX_NEEDLES) {
+        for (size_t i = 0; i < set_->size(); i++) {
+            needles.push_back(set_->text(i));
+        }
+        if (shortestNeedle(needles) == 0) {
+            // every line contains the empty string
+            needles.clear();
+        }
+    }
+    return ret;
+}
@@ -7,6 +7,8 @@
 
 #include "parseTree.h"
 
+#include <stdint.h>
+
 /**
  *
  * @brief handles the '-', '*' and '/' operators.
@@ -30,7 +32,14 @@ public:
     
     virtual void stream(std::ostream& out);
     virtual bool canBeNumber(const LineParser& line) const;
+    virtual int compile(Program& program, NodeType typeHint) const;
+    virtual bool numberFields(std::vector<int>& fields) const;
     virtual Range position() const;
+    virtual int highestColumn() const;
+    virtual ParseTreeRef simplifyNode();
+    virtual ParseTreeRef monotonicIn(int& direction) const;
+    virtual Number apply(const Number& x) const;
+    virtual void monotonicOperand(Program::Operand& operand, int& pos) const;
 
 private:
     NumericBinaryOperator(const NumericBinaryOperator& other);
@@ -68,7 +77,14 @@ public:
     
     virtual void stream(std::ostream& out);
     virtual bool canBeNumber(const LineParser& line) const;
+    virtual int compile(Program& program, NodeType typeHint) const;
+    virtual bool numberFields(std::vector<int>& fields) const;
     virtual Range position() const;
+    virtual int highestColumn() const;
+    virtual ParseTreeRef simplifyNode();
+    virtual bool requiredText(std::vector<std::string>& needles) const;
+    virtual void logicalTerms(LexToken::Type op,
+                              std::vector<const ParseTree*>& terms) const;
 
 private:
     LogicalBinaryOperator(const LogicalBinaryOperator& other);
@@ -104,7 +120,12 @@ public:
     
     virtual void stream(std::ostream& out);
     virtual bool canBeNumber(const LineParser& line) const;
+    virtual int compile(Program& program, NodeType typeHint) const;
+    virtual bool numberFields(std::vector<int>& fields) const;
     virtual Range position() const;
+    virtual int highestColumn() const;
+    virtual ParseTreeRef simplifyNode();
+    virtual bool requiredText(std::vector<std::string>& needles) const;
 
 private:
     ComparisonBinaryOperator(const ComparisonBinaryOperator& other);
@@ -114,10 +135,42 @@ private:
                                     NodeType typeHint) const;
     VariantRef evalComparisonString(const LineParser& line,
                                     NodeType typeHint) const;
+    void compileComparison(Program& program, NodeType type, int dest) const;
+
+    static LexToken::Type mirror(LexToken::Type op);
+    static ConstLexTokenRef comparisonToken(LexToken::Type op, Range pos);
+    static bool solve(const ParseTree& f,
+                      int direction,
+                      LexToken::Type& op,
+                      Number& k);
+    static bool sameForIntegers(const ParseTree& f,
+                                int direction,
+                                LexToken::Type op,
+                                const Number& k,
+                                const Number& k2);
+    static bool firstAbove(const ParseTree* f,
+                           int direction,
+                           const Number& k,
+                           bool strict,
+                           bool integers,
+                           Number& x);
+    static bool isAbove(const ParseTree* f,
+                        int direction,
+                        const Number& x,
+                        const Number& k,
+                        bool strict);
+    static int64_t orderedBits(double d);
+    static double fromOrderedBits(int64_t bits);
 
     ConstLexTokenRef op_;
     ParseTreeRef lhs_;
     ParseTreeRef rhs_;
+    Range position_;
+    // how the left hand side is reported if it is the wrong type, which
+    // changes when arithmetic is moved across the comparison
+    Program::Operand leftOperand_;
+    int leftPos_;
+    NodeType comparisonType_;
     VariantRef result_;
 };
 
@@ -143,7 +196,14 @@ public:
     
     virtual void stream(std::ostream& out);
     virtual bool canBeNumber(const LineParser& line) const;
+    virtual int compile(Program& program, NodeType typeHint) const;
+    virtual bool numberFields(std::vector<int>& fields) const;
     virtual Range position() const;
+    virtual int highestColumn() const;
+    virtual ParseTreeRef simplifyNode();
+    virtual ParseTreeRef monotonicIn(int& direction) const;
+    virtual Number apply(const Number& x) const;
+    virtual void monotonicOperand(Program::Operand& operand, int& pos) const;
 
 private:
     PlusBinaryOperator(const PlusBinaryOperator& other);
@@ -153,15 +213,51 @@ private:
                                     NodeType typeHint) const;
     VariantRef evalPlusString(const LineParser& line,
                                     NodeType typeHint) const;
+    void compilePlus(Program& program, NodeType type, int dest) const;
 
     ConstLexTokenRef op_;
     ParseTreeRef lhs_;
     ParseTreeRef rhs_;
     NodeType calculatedType_;
     VariantRef result_;
-    mutable char* addBuf_;
-    mutable int addBufLen_;
 };
 
+/**
+ * @brief handles the 'in' operator
+ *
+ * The InOperator class checks whether a string or number is one of a set of
+ * values, such as 'code in ("A1", "B7")'. The right hand side is a ValueSet,
+ * which is built when the expression is parsed, so the lookup takes the same
+ * time however many values there are. The result is a boolean.
+ *
+ */
+class InOperator : public ParseTree {
+public:
+    InOperator(ConstLexTokenRef op, ParseTreeRef lhs, ValueSetRef set);
+    virtual ~InOperator();
+
+    virtual NodeType validateTypes(ParseError& err);
+    virtual bool setType(NodeType t, ParseError& err);
+
+    virtual VariantRef eval(const LineParser& line, NodeType typeHint) const;
+
+    virtual void stream(std::ostream& out);
+    virtual bool canBeNumber(const LineParser& line) const;
+    virtual int compile(Program& program, NodeType typeHint) const;
+    virtual bool numberFields(std::vector<int>& fields) const;
+    virtual Range position() const;
+    virtual int highestColumn() const;
+    virtual ParseTreeRef simplifyNode();
+    virtual bool requiredText(std::vector<std::string>& needles) const;
+
+private:
+    InOperator(const InOperator& other);
+    InOperator& operator=(const InOperator& other);
+
+    ConstLexTokenRef op_;
+    ParseTreeRef lhs_;
+    ValueSetRef set_;
+    VariantRef result_;
+};
 
 #endif // CSVFILTER_BINARY_OPERATOR_H
@@ -6,8 +6,20 @@
 #include "lexer.h"
 
 #include <assert.h>
+#include <stdlib.h>
 #include <iostream>
 
+/**
+ * @brief How many batches are profiled before the terms of each '&&' and '||'
+ *        are put in order.
+ */
+static const size_t PROFILED_BATCHES = 4;
+
+/**
+ * @brief How often, in batches, the order of the terms is worked out again.
+ */
+static const size_t REORDER_INTERVAL = 256;
+
 /**
  * @brief Constructor
  *
@@ -23,10 +35,37 @@
  */
 Expression::Expression(const std::string& expression,
                        const Headers& headers)
-    :ok_(true),
+    :Expression(expression, headers, std::vector<ValueSetRef>()) {
+
+}
+
+/**
+ * @brief Constructor
+ *
+ * As the public constructor, but the sets of values read from files are taken
+ * from another parse of the same expression rather than being read again.
+ *
+ * @param expression  The filter expression to parse.
+ * @param headers     The headers from the csv file.
+ * @param fileSets    The sets read from files by the other parse, in the order
+ *                    they appear in the expression.
+ *
+ */
+Expression::Expression(const std::string& expression,
+                       const Headers& headers,
+                       const std::vector<ValueSetRef>& fileSets)
+    :expression_(expression),
+     headers_(headers),
+     ok_(true),
      error_(),
      tree_(nullptr),
-     resultType_(ParseTree::NODE_TYPE_UNKNOWN) {
+     resultType_(ParseTree::NODE_TYPE_UNKNOWN),
+     program_(),
+     batchProgram_(),
+     batches_(0),
+     result_(Variant::error("Uninitialised")),
+     requiredText_(),
+     fileSets_(fileSets) {
 
     ParseState state(expression, headers);
     if (!state.lexer_.ok()) {
@@ -75,27 +114,185 @@ const ParseError Expression::error() const {
     return error_;
 }
 
+/**
+ * @brief The type the expression evaluates to.
+ *
+ * @return The type of the expression, as far as it could be worked out when
+ *         it was parsed. This is only meaningful if Expression::ok is true.
+ *
+ */
+ParseTree::NodeType Expression::resultType() const {
+    return resultType_;
+}
+
 /**
  * @brief  Evaluate the expression.
  *
- * Evaluate the expression, using the current row as context.
+ * Evaluate the expression, using the current row as context. This runs the
+ * compiled version of the expression.
  *
  * @param l  The current line
  *
  * @return  Either the result, or a variant containing an error if the
- *          expression could not be parsed.
+ *          expression could not be evaluated. This is reused by the next call
+ *          to eval.
  *
  */
 VariantRef Expression::eval(const LineParser& l) {
+    assert(ok_);
+    if (!program_->run(l)) {
+        result_->resetToError(program_->errText());
+    } else {
+        switch (program_->resultType()) {
+        case Variant::NUMBER:
+            result_->resetToNumber(program_->numberResult());
+            break;
+        case Variant::BOOLEAN:
+            result_->resetToBoolean(program_->booleanResult());
+            break;
+        case Variant::STRING:
+            result_->resetToStringView(program_->stringResult());
+            break;
+        default:
+            // errors stop the program instead
+            abort();
+            break;
+        }
+    }
+    return result_;
+}
+
+/**
+ * @brief  Evaluate the expression with the parse tree.
+ *
+ * Evaluate the expression by walking the parse tree. This is slower than
+ * Expression::eval, but gives the same results, so it is useful for checking
+ * the compiled program.
+ *
+ * @param l  The current line
+ *
+ * @return  Either the result, or a variant containing an error if the
+ *          expression could not be evaluated.
+ *
+ */
+VariantRef Expression::evalTree(const LineParser& l) {
     assert(ok_);
     return tree_->eval(l, ParseTree::NODE_TYPE_UNKNOWN);
 }
 
+/**
+ * @brief  Filter a batch of lines.
+ *
+ * Evaluate the expression for each line in a batch, which gives the same
+ * results as Expression::eval but is quicker. See Program::runBatch.
+ *
+ * The terms of an '&&' or '||' may be run in a different order to the one
+ * they were written in. That can fail for a line that the original order
+ * would have decided without failing, so the line is then run again in the
+ * original order.
+ *
+ * @param batch    The lines.
+ * @param matches  Set to whether the expression was true, for each line that
+ *                 it was evaluated for.
+ *
+ * @return  The number of lines the expression was evaluated for. If this is
+ *          less than the size of the batch then it could not be evaluated
+ *          for the next line, see Expression::evalErrText.
+ *
+ */
+size_t Expression::evalBatch(const LineBatch& batch,
+                             std::vector<unsigned char>& matches) {
+    assert(ok_);
+    Program& program = batchProgram_ ? *batchProgram_ : *program_;
+    size_t phase = batches_ % REORDER_INTERVAL;
+    program.setProfiling(phase < PROFILED_BATCHES);
+
+    size_t ret = program.runBatch(batch, 0, matches);
+    while (ret < batch.size() && batchProgram_ &&
+           program_->run(batch.row(ret))) {
+        matches[ret] = (program_->resultType() == Variant::BOOLEAN &&
+                        program_->booleanResult());
+        ret = batchProgram_->runBatch(batch, ret + 1, matches);
+    }
+
+    if (phase == PROFILED_BATCHES - 1) {
+        reorderTerms();
+    }
+    batches_++;
+    return ret;
+}
+
+/**
+ * @brief  Why a line in a batch could not be evaluated.
+ *
+ * @return  The error for the line that stopped the last call to
+ *          Expression::evalBatch.
+ *
+ */
+const std::string& Expression::evalErrText() const {
+    // lines that fail are always run through the original program
+    return program_->errText();
+}
+
+/**
+ * @brief  Make an independent copy of the expression.
+ *
+ * Evaluating an expression is not thread-safe, as the parse tree keeps
+ * scratch buffers between calls. Each thread that evaluates the expression
+ * needs its own copy, which this function creates by parsing the expression
+ * again. Sets of values read from files are shared with the copy rather than
+ * read again, as a file such as a pipe can only be read once, so the copy
+ * parses successfully whenever the original did.
+ *
+ * @return  A new expression, owned by the caller. This refers to the same
+ *          Headers as the original, which must outlive it.
+ *
+ */
+Expression* Expression::clone() const {
+    return new Expression(expression_, headers_, fileSets_);
+}
+
+/**
+ * @brief  The last csv field the expression reads.
+ *
+ * @return  The highest field index referenced by the expression, or -1 if it
+ *          does not reference any fields.
+ *
+ */
+int Expression::highestColumn() const {
+    int ret = -1;
+    if (tree_ != nullptr) {
+        ret = tree_->highestColumn();
+    }
+    return ret;
+}
+
+/**
+ * @brief  Text a line must contain to match.
+ *
+ * Lines that cannot match can be rejected without parsing them, if the
+ * expression can only be true for lines that contain one of a few strings
+ * (e.g. the expression 'name == "fred"' needs the line to contain "fred").
+ * This only applies to lines that do not contain any quotes, and is only
+ * worked out for expressions that cannot fail to evaluate, so skipping a line
+ * never hides an error.
+ *
+ * @see ParseTree::requiredText
+ *
+ * @return  The strings, at least one of which must be in a line without
+ *          quotes for the expression to be true, or an empty list if there is
+ *          no such requirement.
+ *
+ */
+const std::vector<std::string>& Expression::requiredText() const {
+    return requiredText_;
+}
+
 /**
  * @brief  A string representation of the parse tree
  *
- * A string representation of the parse tree. This is purely for debugging
- * purposes.
+ * A string representation of the parse tree, after it has been simplified
+ * (see ParseTree::simplify). This is purely for debugging purposes.
  *
  * @return A string representation of the parse tree.
  *
@@ -125,16 +322,51 @@ void Expression::makeParseTree(ParseState& state) {
         resultType_ = tree_->validateTypes(error_);
         if (resultType_ == ParseTree::NODE_TYPE_ERROR) {
             ok_ = false;
+        } else {
+            tree_ = ParseTree::simplify(tree_);
+            program_.reset(new Program());
+            program_->finish(
+                tree_->compile(*program_, ParseTree::NODE_TYPE_UNKNOWN));
+            if (!tree_->requiredText(requiredText_)) {
+                requiredText_.clear();
+            }
         }
     }
 }
 
 
+/**
+ * @brief  Compile the batch program again if its terms are in a slow order.
+ *
+ * @see Program::reorder
+ *
+ */
+void Expression::reorderTerms() {
+    Program& program = batchProgram_ ? *batchProgram_ : *program_;
+    Program::TermOrders orders;
+    if (program.reorder(orders)) {
+        std::unique_ptr<Program> reordered(new Program());
+        reordered->setTermOrders(orders);
+        reordered->finish(
+            tree_->compile(*reordered, ParseTree::NODE_TYPE_UNKNOWN));
+        if (reordered->reordered()) {
+            batchProgram_.swap(reordered);
+        } else {
+            batchProgram_.reset();
+        }
+    }
+}
+
 void Expression::processOperator(ParseState& state) {
     ConstLexTokenRef token = state.lexer_.pop();
     if (!token->isOperator()) {
         error_ = ParseError("Unexpected operand", token->position());
         ok_ = false;
+    } else if (token->type() == LexToken::TYPE_COMMA ||
+               token->type() == LexToken::TYPE_FILE) {
+        // these only appear in sets
+        error_ = ParseError("Unexpected operator", token->position());
+        ok_ = false;
     } else {
         if (token->type() == LexToken::TYPE_CLOSE_BRACKET) {
             endBracketedExpression(token, state);
@@ -154,6 +386,11 @@ void Expression::processOperator(ParseState& state) {
                                         remainingToken->position());
                 }
                 state.done_ = true;
+            } else if (token->type() == LexToken::TYPE_IN) {
+                // the set takes the place of the right hand operand, so an
+                // operator comes next
+                state.operators_.push(token);
+                processSet(state);
             } else {
                 state.operators_.push(token);
                 state.expectedToken_ = EXPECT_OPERAND;
@@ -198,11 +435,118 @@ void Expression::processOperand(ParseState& state) {
 }
 
 
+/**
+ * @brief  Read the set of values after an 'in'.
+ *
+ * This is either a file of values (see ValueSet::readFile), or a bracketed
+ * list of string or number constants separated by commas. The set is kept
+ * until the 'in' is applied. Files that have already been read for a clone's
+ * original (see Expression::clone) are not read again.
+ *
+ */
+void Expression::processSet(ParseState& state) {
+    std::shared_ptr<ValueSet> set(new ValueSet());
+    ValueSetRef fileSet;
+    ConstLexTokenRef token = state.lexer_.pop();
+    Range position = token->position();
+
+    if (token->type() == LexToken::TYPE_FILE &&
+        state.fileSetCount_ < fileSets_.size()) {
+        fileSet = fileSets_[state.fileSetCount_++];
+    } else if (token->type() == LexToken::TYPE_FILE) {
+        std::string err;
+        if (!set->readFile(token->value(), err)) {
+            error_ = ParseError(err, token->position());
+            ok_ = false;
+        } else {
+            set->setPosition(position);
+            fileSet = set;
+            fileSets_.push_back(fileSet);
+            state.fileSetCount_++;
+        }
+    } else if (token->type() == LexToken::TYPE_OPEN_BRACKET) {
+        bool more = true;
+        while (ok_ && more) {
+            ok_ = addSetValue(state.lexer_.pop(), state, *set);
+            if (ok_) {
+                token = state.lexer_.pop();
+                if (token->type() == LexToken::TYPE_CLOSE_BRACKET) {
+                    position.end = token->position().end;
+                    more = false;
+                } else if (token->type() != LexToken::TYPE_COMMA) {
+                    error_ = ParseError("Expected ',' or ')'",
+                                        token->position());
+                    ok_ = false;
+                }
+            }
+        }
+    } else {
+        error_ = ParseError("Expected a bracketed list of values, or a file, "
+                            "after 'in'", token->position());
+        ok_ = false;
+    }
+
+    if (ok_ && fileSet) {
+        state.sets_.push(fileSet);
+    } else if (ok_) {
+        set->setPosition(position);
+        state.sets_.push(set);
+    }
+}
+
+/**
+ * @brief  Add a value from a bracketed list to a set.
+ *
+ * @param token  The first token of the value. Negative numbers take a second
+ *               token, which is popped from the lexer.
+ * @param state  The parse state.
+ * @param set    The set to add to.
+ *
+ * @return  true if the value was added, false otherwise (in which case error_
+ *          is set).
+ *
+ */
+bool Expression::addSetValue(ConstLexTokenRef token,
+                             ParseState& state,
+                             ValueSet& set) {
+    bool ok = true;
+    bool negative = (token->type() == LexToken::TYPE_MINUS);
+    Range position = token->position();
+    if (negative) {
+        token = state.lexer_.pop();
+        position.end = token->position().end;
+    }
+
+    bool number = (token->type() == LexToken::TYPE_NUMBER);
+    if (!number && (negative || token->type() != LexToken::TYPE_STRING)) {
+        error_ = ParseError("Expected a string or number constant",
+                            token->position());
+        ok = false;
+    } else if (set.size() > 0 && set.numbers() != number) {
+        error_ = ParseError("The values in a set must all be strings, or all "
+                            "be numbers", position);
+        ok = false;
+    } else if (number) {
+        Number val = token->numberValue();
+        set.add(negative ? val.negate() : val,
+                (negative ? "-" : "") + token->value());
+    } else {
+        set.add(token->value());
+    }
+    return ok;
+}
+
 void Expression::applyLastOperator(ParseState& state) {
     ConstLexTokenRef op = state.operators_.top();
     state.operators_.pop();
 
-    if (op->isUnary()) {
+    if (op->type() == LexToken::TYPE_IN) {
+        ParseTreeRef lhs = state.operands_.top();
+        state.operands_.pop();
+        ValueSetRef set = state.sets_.top();
+        state.sets_.pop();
+        state.operands_.push(ParseTree::makeInOperator(op, lhs, set));
+    } else if (op->isUnary()) {
         ParseTreeRef operand = state.operands_.top();
         state.operands_.pop();
         // our only unary operator is '-'
@@ -241,7 +585,7 @@ void Expression::endBracketedExpression(ConstLexTokenRef closeBrace,
 
 Expression::ParseState::ParseState(const std::string& input,
                                          const Headers& headers)
-    :lexer_(input), headers_(headers), operators_(), operands_(),
-     expectedToken_(EXPECT_OPERAND), done_(false) {
+    :lexer_(input), headers_(headers), operators_(), operands_(), sets_(),
+     fileSetCount_(0), expectedToken_(EXPECT_OPERAND), done_(false) {
 
 }
@@ -6,6 +6,7 @@
 #define CSVFILTER_EXPRESSION_PARSER_H
 
 #include "parseTree.h"
+#include "program.h"
 #include "lexer.h"
 #include "../headers.h"
 #include "variant.h"
@@ -13,6 +14,8 @@
 #include <sstream>
 #include <string>
 #include <stack>
+#include <memory>
+#include <vector>
 
 /**
  * @brief  Parse and evaluate a filter expression
@@ -21,6 +24,17 @@
  * at construction time, and assuming it parses successfully it can be used to
  * evaluate it in the context of a line from the csv file.
  *
+ * Once it has been parsed and its types checked, the parse tree is simplified
+ * and then compiled into a Program, which is what Expression::eval runs. Expression::evalTree
+ * evaluates the parse tree directly, and is kept as a reference for checking
+ * the compiled version. Expression::evalBatch runs the program on a batch of
+ * lines at a time.
+ *
+ * The program is profiled while it runs the first few batches, and then every
+ * so often. If it would be quicker to run the terms of an '&&' or '||' in a
+ * different order (see Program::reorder), then batches are run with a copy of
+ * the program compiled in that order.
+ *
  */
 class Expression {
 public:
@@ -29,14 +43,26 @@ public:
 
     bool ok() const;
     const ParseError error() const;
+    ParseTree::NodeType resultType() const;
 
     VariantRef eval(const LineParser& l);
+    VariantRef evalTree(const LineParser& l);
+    size_t evalBatch(const LineBatch& batch,
+                     std::vector<unsigned char>& matches);
+    const std::string& evalErrText() const;
+
+    Expression* clone() const;
+    int highestColumn() const;
+    const std::vector<std::string>& requiredText() const;
 
     const std::string treeString() const;
 
 private:
     Expression(const Expression& other);
     Expression& operator=(const Expression& other);
+    Expression(const std::string& expression,
+               const Headers& headers,
+               const std::vector<ValueSetRef>& fileSets);
 
     typedef enum {
         EXPECT_OPERATOR,
@@ -60,6 +86,8 @@ private:
         const Headers& headers_;
         std::stack<ConstLexTokenRef> operators_;
         std::stack<ParseTreeRef> operands_;
+        std::stack<ValueSetRef> sets_;
+        size_t fileSetCount_;
         ExpectedToken expectedToken_;
         bool done_;
     } ParseState;
@@ -67,14 +95,28 @@ private:
     void makeParseTree(ParseState& state);
     void processOperator(ParseState& state);
     void processOperand(ParseState& state);
+    void processSet(ParseState& state);
+    bool addSetValue(ConstLexTokenRef token,
+                     ParseState& state,
+                     ValueSet& set);
     
     void applyLastOperator(ParseState& state);
     void endBracketedExpression(ConstLexTokenRef closeBrace, ParseState& state);
+
+    void reorderTerms();
     
+    std::string expression_;
+    const Headers& headers_;
     bool ok_;
     ParseError error_;
     ParseTreeRef tree_;
     ParseTree::NodeType resultType_;
+    std::unique_ptr<Program> program_;
+    std::unique_ptr<Program> batchProgram_;
+    size_t batches_;
+    VariantRef result_;
+    std::vector<std::string> requiredText_;
+    std::vector<ValueSetRef> fileSets_;
 };
 
 #endif // CSVFILTER_EXPRESSION_PARSER_H
@@ -3,6 +3,7 @@
 //
 
 #include "lexToken.h"
+#include "../numberParser.h"
 
 #include <assert.h>
 #include <stdlib.h>
@@ -69,20 +70,23 @@ const std::string& LexToken::value() const {
  * Return the numeric value of this token. This can only be called if the type
  * of this token is TYPE_NUMBER.
  *
- * @return  The numeric value of this token.
+ * @return  The numeric value of this token, which is an integer if the token
+ *          is written as one.
  */
-double LexToken::numberValue() const {
+Number LexToken::numberValue() const {
     assert(type_ == TYPE_NUMBER);
-    return atof(value_.c_str());
+    Number ret;
+    NumberParser::toNumber(value_.c_str(), value_.size(), ret);
+    return ret;
 }
 
 /**
  * @brief Is this token an operator?
  *
  * Checks whether this operator is a token. For these purposes an operator is
- * anything that isn't an identifier, string or number, so brackets count as
- * operators, although they aren't strictly treated as operators by the
- * expression parser.
+ * anything that isn't an identifier, string or number, so brackets (and the
+ * commas and files that make up sets) count as operators, although they
+ * aren't strictly treated as operators by the expression parser.
  *
  * @return  true if the token is an operator, false otherwise.
  *
@@ -101,7 +105,8 @@ bool LexToken::isOperator() const {
  *
  * This function can only be called on tokens that are operators.
  *
- * This precedence order is the same as that implemented by C.
+ * This precedence order is the same as that implemented by C. 'in', which C
+ * does not have, binds like the relational operators.
  *
  * @return  The operator precedence.
  *
@@ -129,6 +134,7 @@ int LexToken::operatorPrecedence() const {
     case TYPE_LTE:
     case TYPE_GT:
     case TYPE_GTE:
+    case TYPE_IN:
         precedence = 5;
         break;
     case TYPE_EQ:
@@ -240,6 +246,9 @@ std::ostream& operator<< (std::ostream &out, LexToken::Type t)
     case LexToken::TYPE_OR:
         label = "TYPE_OR";
         break;
+    case LexToken::TYPE_IN:
+        label = "TYPE_IN";
+        break;
     case LexToken::TYPE_EOF:
         label = "TYPE_EOF";
         break;
@@ -249,6 +258,9 @@ std::ostream& operator<< (std::ostream &out, LexToken::Type t)
     case LexToken::TYPE_CLOSE_BRACKET:
         label = "TYPE_CLOSE_BRACKET";
         break;
+    case LexToken::TYPE_COMMA:
+        label = "TYPE_COMMA";
+        break;
     case LexToken::TYPE_IDENTIFIER:
         label = "TYPE_IDENTIFIER";
         break;
@@ -258,6 +270,9 @@ std::ostream& operator<< (std::ostream &out, LexToken::Type t)
     case LexToken::TYPE_NUMBER:
         label = "TYPE_NUMBER";
         break;
+    case LexToken::TYPE_FILE:
+        label = "TYPE_FILE";
+        break;
     }
     out << label;
 
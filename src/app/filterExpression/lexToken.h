@@ -6,6 +6,7 @@
 #define CSVFILTER_LEXTOKEN_H
 
 #include "parseError.h"
+#include "../number.h"
 
 #include <string>
 #include <ostream>
@@ -42,15 +43,20 @@ public:
         TYPE_GTE, /**< '>=' */
         TYPE_AND, /**< '&&' */
         TYPE_OR, /**< '||' */
+        TYPE_IN, /**< 'in', which is followed by a set of values */
         TYPE_OPEN_BRACKET, /**< '(' */
         TYPE_CLOSE_BRACKET,  /**< ')' */
+        TYPE_COMMA, /**< ',', which separates the values in a set */
         TYPE_IDENTIFIER, /**< An identifier, for example a variable name */
         TYPE_STRING, /**< A string constant - this will have been surrounded
                       * with double quotes. */
         TYPE_NUMBER, /**< A numeric constant. We do not differentiate between
                       * ints and doubles, and it will be positive - negative
                       * numbers will appear as a minus token then a number
-                      * token */
+                      * token (other than in constants worked out by
+                      * ParseTree::simplify) */
+        TYPE_FILE, /**< A file of values, written as '@' followed by the
+                    * path. The value of the token is the path. */
         TYPE_EOF /**< The end of the token stream */
     } Type;
 
@@ -60,7 +66,7 @@ public:
     Type type() const;
     Range position() const;
     const std::string& value() const;
-    double numberValue() const;
+    Number numberValue() const;
 
     bool isOperator() const;
     int operatorPrecedence() const;
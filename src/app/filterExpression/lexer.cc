@@ -106,7 +106,7 @@ bool Lexer::isIdentifier(const std::string& token) {
         isToken = isIdentifierContinuedChar(token.at(i));
     }
 
-    return isToken;
+    return isToken && !isKeyword(token);
 }
 
 /**
@@ -114,7 +114,8 @@ bool Lexer::isIdentifier(const std::string& token) {
  * @brief Convert a string into an identifier.
  *
  * Convert the supplied string into one that can be used as an identifier. This
- * is done by replacing all unsuitable characters with underscores.
+ * is done by replacing all unsuitable characters with underscores, and putting
+ * an underscore in front of keywords.
  *
  * @param token  The string to convert
  *
@@ -143,7 +144,11 @@ std::string Lexer::makeValidIdentifier(const std::string& token) {
         }
     }
 
-    return identifier.str();
+    std::string ret = identifier.str();
+    if (isKeyword(ret)) {
+        ret = "_" + ret;
+    }
+    return ret;
 }
 
 void Lexer::consumeWhitespace(const std::string& input, size_t& pos) {
@@ -187,6 +192,13 @@ bool Lexer::consumeToken(const std::string& input, size_t& pos) {
             push(LexToken::TYPE_CLOSE_BRACKET, Range(pos, pos + 1), ")");
             pos++;
             break;
+        case ',':
+            push(LexToken::TYPE_COMMA, Range(pos, pos + 1), ",");
+            pos++;
+            break;
+        case '@':
+            consumed = consumeFile(input, pos);
+            break;
         case '<':
             consumeLtToken(input, pos);
             break;
@@ -267,15 +279,77 @@ void Lexer::consumeIdentifier(const std::string& input, size_t& pos) {
            isIdentifierContinuedChar(input.at(pos))) {
         pos++;
     }
-    push(LexToken::TYPE_IDENTIFIER,
+    std::string token = input.substr(start, pos - start);
+    push(isKeyword(token) ? LexToken::TYPE_IN : LexToken::TYPE_IDENTIFIER,
          Range(start, pos),
-         input.substr(start, pos - start));
+         token);
 }
 
 bool Lexer::consumeString(const std::string& input, size_t& pos) {
+    int start = pos;
+    std::string val;
+    bool success = readString(input, pos, val);
+    if (success) {
+        push(LexToken::TYPE_STRING, Range(start, pos), val);
+    }
+    return success;
+}
+
+/**
+ * @brief Consume a file of values, such as '@codes.txt'.
+ *
+ * The path runs up to the next space, comma or bracket, unless it is quoted
+ * like a string constant.
+ *
+ */
+bool Lexer::consumeFile(const std::string& input, size_t& pos) {
+    bool success = true;
+    int start = pos;
+    std::string path;
+
+    assert(input.at(pos) == '@');
+    pos++;
+
+    if (pos < input.length() && input.at(pos) == '"') {
+        success = readString(input, pos, path);
+    } else {
+        size_t end = input.find_first_of(" \t\n,()", pos);
+        if (end == std::string::npos) {
+            end = input.length();
+        }
+        path = input.substr(pos, end - pos);
+        pos = end;
+    }
+
+    if (success && path.empty()) {
+        err_ = ParseError("Expected a file name after '@'",
+                          Range(start, pos));
+        success = false;
+    }
+    if (success) {
+        push(LexToken::TYPE_FILE, Range(start, pos), path);
+    }
+    return success;
+}
+
+/**
+ * @brief Read a quoted string.
+ *
+ * @param input  The expression.
+ * @param pos    The position of the opening quote. This is moved past the
+ *               closing quote.
+ * @param val    Set to the string, without the quotes or escapes.
+ *
+ * @return  true if the string was terminated, false otherwise (in which case
+ *          err_ is set).
+ *
+ */
+bool Lexer::readString(const std::string& input,
+                       size_t& pos,
+                       std::string& val) {
     bool success = false;
     int start = pos;
-    std::stringstream val;
+    std::stringstream s;
 
     assert(input.at(pos) == '"');
     pos++;
@@ -286,7 +360,7 @@ bool Lexer::consumeString(const std::string& input, size_t& pos) {
             input.at(pos + 1) == '"') {
             pos++;
         }
-        val << input.at(pos);
+        s << input.at(pos);
         pos++;
     }
 
@@ -297,7 +371,7 @@ bool Lexer::consumeString(const std::string& input, size_t& pos) {
         // consume closing quote
         pos++;
         success = true;
-        push(LexToken::TYPE_STRING, Range(start, pos), val.str());
+        val = s.str();
     }
     return success;
 }
@@ -339,6 +413,17 @@ bool Lexer::isDigit(char c) {
     return c >= '0' && c <= '9';
 }
 
+/**
+ * @brief Is a word reserved for an operator?
+ *
+ * The only keyword is 'in'. Headers that are keywords get an alias, like
+ * any other header that cannot be used as an identifier.
+ *
+ */
+bool Lexer::isKeyword(const std::string& token) {
+    return token == "in";
+}
+
 bool Lexer::isIdentifierStartChar(char c) {
     return ( (c >= 'A' && c <= 'Z') ||
              (c >= 'a' && c <= 'z') ||
@@ -47,12 +47,17 @@ private:
                       LexToken::Type type);
     void consumeIdentifier(const std::string& input, size_t& pos);
     bool consumeString(const std::string& input, size_t& pos);
+    bool consumeFile(const std::string& input, size_t& pos);
+    bool readString(const std::string& input,
+                    size_t& pos,
+                    std::string& val);
     bool consumeNumber(const std::string& input, size_t& pos);
 
     bool skipDigits(const std::string& input, size_t& pos);
     bool isDigit(char c);
     void push(LexToken::Type type, Range pos, const std::string& token);
 
+    static bool isKeyword(const std::string& token);
     static bool isIdentifierStartChar(char c);
     static bool isIdentifierContinuedChar(char c);
 
@@ -104,12 +104,13 @@ VariantRef Operand::eval(const LineParser& line, NodeType typeHint) const {
         // result is pre-populated
     } else {
         assert(token_->type() == LexToken::TYPE_IDENTIFIER);
-        double lineVal = 0.0;
+        Number lineVal;
         if (typeHint == NODE_TYPE_NUMBER &&
-            line.field(identifierIndex_)->asNumber(lineVal)) {
+            line.field(identifierIndex_).asNumber(lineVal)) {
             result_->resetToNumber(lineVal);
         } else {
-            result_->resetToString(line.field(identifierIndex_)->asString());
+            result_->resetToStringView(
+                line.field(identifierIndex_).asString());
         }
     }
     return result_;
@@ -119,18 +120,103 @@ VariantRef Operand::eval(const LineParser& line, NodeType typeHint) const {
  * @copydoc ParseTree::canBeNumber
  */
 bool Operand::canBeNumber(const LineParser& line) const {
-    double dummy = 0.0;
+    Number dummy;
     return
         ( nodeType_ == NODE_TYPE_NUMBER ) ||
         ( nodeType_ == NODE_TYPE_UNKNOWN &&
-          line.field(identifierIndex_)->asNumber(dummy) );
+          line.field(identifierIndex_).asNumber(dummy) );
 }
 
 
+/**
+ * @copydoc ParseTree::compile
+ */
+int Operand::compile(Program& program, NodeType typeHint) const {
+    int ret = -1;
+    if (token_->type() == LexToken::TYPE_NUMBER) {
+        ret = program.addConstant(token_->numberValue());
+    } else if (token_->type() == LexToken::TYPE_STRING) {
+        ret = program.addConstant(token_->value());
+    } else {
+        assert(token_->type() == LexToken::TYPE_IDENTIFIER);
+        ret = program.addRegister();
+        program.emit(typeHint == NODE_TYPE_NUMBER ? Program::OP_LOAD_NUMBER
+                                                  : Program::OP_LOAD_STRING,
+                     ret, identifierIndex_, -1, token_->position().begin);
+    }
+    return ret;
+}
+
+/**
+ * @copydoc ParseTree::numberFields
+ */
+bool Operand::numberFields(std::vector<int>& fields) const {
+    if (nodeType_ == NODE_TYPE_UNKNOWN) {
+        fields.push_back(identifierIndex_);
+    }
+    return (nodeType_ != NODE_TYPE_STRING);
+}
+
 Range Operand::position() const {
     return token_->position();
 }
 
+/**
+ * @copydoc ParseTree::highestColumn
+ */
+int Operand::highestColumn() const {
+    // constants have an identifierIndex_ of -1
+    return identifierIndex_;
+}
+
+/**
+ * @copydoc ParseTree::simplifyNode
+ */
+ParseTreeRef Operand::simplifyNode() {
+    // operands are as simple as it gets
+    return ParseTreeRef();
+}
+
+/**
+ * @copydoc ParseTree::numberConstant
+ */
+bool Operand::numberConstant(Number& val) const {
+    bool ret = (token_->type() == LexToken::TYPE_NUMBER);
+    if (ret) {
+        val = token_->numberValue();
+    }
+    return ret;
+}
+
+/**
+ * @copydoc ParseTree::stringConstant
+ */
+bool Operand::stringConstant(std::string& val) const {
+    bool ret = (token_->type() == LexToken::TYPE_STRING);
+    if (ret) {
+        val = token_->value();
+    }
+    return ret;
+}
+
+/**
+ * @copydoc ParseTree::requiredText
+ */
+bool Operand::requiredText(std::vector<std::string>& needles) const {
+    // loading a field or a constant cannot fail, and says nothing about the
+    // line on its own
+    needles.clear();
+    return true;
+}
+
+/**
+ * @copydoc ParseTree::fieldIndex
+ */
+int Operand::fieldIndex() const {
+    // constants have an identifierIndex_ of -1
+    return identifierIndex_;
+}
+
 /**
  * @copydoc ParseTree::stream
  */
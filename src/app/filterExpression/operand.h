@@ -22,8 +22,16 @@ public:
 
     virtual VariantRef eval(const LineParser& line, NodeType typeHint) const;
     virtual bool canBeNumber(const LineParser& line) const;
+    virtual int compile(Program& program, NodeType typeHint) const;
+    virtual bool numberFields(std::vector<int>& fields) const;
 
     virtual Range position() const;
+    virtual int highestColumn() const;
+    virtual ParseTreeRef simplifyNode();
+    virtual bool requiredText(std::vector<std::string>& needles) const;
+    virtual bool numberConstant(Number& val) const;
+    virtual bool stringConstant(std::string& val) const;
+    virtual int fieldIndex() const;
 
     virtual void stream(std::ostream& out);
 
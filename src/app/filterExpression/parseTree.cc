@@ -9,6 +9,9 @@
 
 #include <sstream>
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <iostream>
 
 /**
@@ -46,6 +49,201 @@ std::string ParseTree::toString() {
     return s.str();
 }
 
+/**
+ * @brief  Is this node a numeric constant?
+ *
+ * @param val  Set to the value of the constant, if it is one.
+ *
+ * @return  true if the node is a numeric constant, false otherwise.
+ *
+ */
+bool ParseTree::numberConstant(Number& val) const {
+    return false;
+}
+
+/**
+ * @brief  Is this node a string constant?
+ *
+ * @param val  Set to the value of the constant, if it is one.
+ *
+ * @return  true if the node is a string constant, false otherwise.
+ *
+ */
+bool ParseTree::stringConstant(std::string& val) const {
+    return false;
+}
+
+/**
+ * @brief  Is this node a field from the line?
+ *
+ * @return  The index of the field, or -1 if this node is not a field.
+ *
+ */
+int ParseTree::fieldIndex() const {
+    return -1;
+}
+
+/**
+ * @brief  Is this node a unary minus?
+ *
+ * @return  The operand of the unary minus, or nullptr if this node is not
+ *          one.
+ *
+ */
+ParseTreeRef ParseTree::negatedOperand() const {
+    return ParseTreeRef();
+}
+
+/**
+ * @brief  Is this node a monotonic function of one of its children?
+ *
+ * Nodes like "x + 3", "x * -2" and "- x" are a function of one operand (with
+ * the rest of the node being constant) that only ever moves in one direction
+ * as the operand increases. This is used to move the arithmetic across to the
+ * constant side of a comparison. See ParseTree::apply.
+ *
+ * @param direction  Set to 1 if the node never decreases as the operand
+ *                   increases, or -1 if it never increases.
+ *
+ * @return  The operand, or nullptr if the node is not a monotonic function of
+ *          one of its children.
+ *
+ */
+ParseTreeRef ParseTree::monotonicIn(int& direction) const {
+    return ParseTreeRef();
+}
+
+/**
+ * @brief  Work out the value of this node for a given operand.
+ *
+ * This can only be called if ParseTree::monotonicIn returns an operand. The
+ * value is calculated in exactly the same way as ParseTree::eval would,
+ * including using integer arithmetic if x is an integer.
+ *
+ * @param x  The value of the operand returned by ParseTree::monotonicIn.
+ *
+ * @return  The value of the node.
+ *
+ */
+Number ParseTree::apply(const Number& x) const {
+    // only monotonic nodes can be applied
+    abort();
+    return x;
+}
+
+/**
+ * @brief  How this node reports its operand being the wrong type.
+ *
+ * This can only be called if ParseTree::monotonicIn returns an operand. When
+ * the node is moved across a comparison, the comparison reports the operand
+ * in the same way, so the error is the same as it would have been.
+ *
+ * @param operand  Set to how the operand returned by ParseTree::monotonicIn
+ *                 is used.
+ * @param pos      Set to the position of this node's operator.
+ *
+ */
+void ParseTree::monotonicOperand(Program::Operand& operand, int& pos) const {
+    // only monotonic nodes have an operand
+    abort();
+}
+
+/**
+ * @brief  Text a line must contain for this node to be true.
+ *
+ * This lets lines be rejected without parsing them, see
+ * Expression::requiredText. It only applies to lines without any quoted
+ * fields, where the value of every field is exactly the text in the line.
+ *
+ * By default a node might fail to evaluate, which the lines that are rejected
+ * without being parsed would never report.
+ *
+ * @param needles  Set to a list of strings, at least one of which must be in
+ *                 a line for the node to be true. This is left empty if there
+ *                 is no such list.
+ *
+ * @return  true if the node, and its children, can be evaluated for every
+ *          line, false if they might fail.
+ *
+ */
+bool ParseTree::requiredText(std::vector<std::string>& needles) const {
+    return false;
+}
+
+/**
+ * @brief  The terms of a chain of '&&' or '||'.
+ *
+ * Chains like "a && b && c" are compiled as a single list of terms, rather
+ * than as nested operators, so that the terms can be put in any order (see
+ * Program::reorder).
+ *
+ * @param op     The operator of the chain.
+ * @param terms  This node is added to the end, unless it is itself a chain of
+ *               op, in which case its terms are.
+ *
+ */
+void ParseTree::logicalTerms(LexToken::Type op,
+                             std::vector<const ParseTree*>& terms) const {
+    terms.push_back(this);
+}
+
+/**
+ * @brief  Can this node fail to evaluate for some lines?
+ *
+ * @see ParseTree::requiredText
+ *
+ */
+bool ParseTree::canFail() const {
+    std::vector<std::string> unused;
+    return !requiredText(unused);
+}
+
+/**
+ * @brief  Simplify a parse tree.
+ *
+ * Rewrite a parse tree that has had its types validated so that it is quicker
+ * to evaluate. Constant parts of the tree are worked out up front, double
+ * negatives are removed, and arithmetic is moved away from fields in
+ * comparisons with constants (so "x + 1 < 1.5" becomes a comparison of x
+ * with a constant) where that gives exactly the same result for every value
+ * of x.
+ *
+ * @param tree  The tree to simplify. This may be modified.
+ *
+ * @return  The simplified tree.
+ *
+ */
+ParseTreeRef ParseTree::simplify(ParseTreeRef tree) {
+    ParseTreeRef ret = tree->simplifyNode();
+    if (ret == nullptr) {
+        ret = tree;
+    }
+    return ret;
+}
+
+/**
+ * @brief  Work out the value of a constant node.
+ *
+ * @return  A constant operand holding the value of this node, or nullptr if
+ *          the node refers to fields, or is a boolean (which cannot be
+ *          written as an operand).
+ *
+ */
+ParseTreeRef ParseTree::fold() const {
+    ParseTreeRef ret;
+    if (highestColumn() == -1) {
+        // constants do not look at the line
+        LineParser line;
+        VariantRef val = eval(line, NODE_TYPE_UNKNOWN);
+        if (val->isNumber()) {
+            ret = makeConstant(val->asNumber(), position());
+        } else if (val->type() == Variant::STRING) {
+            ret = makeConstant(std::string(val->charVal()), position());
+        }
+    }
+    return ret;
+}
+
 
 /**
  *
@@ -61,6 +259,62 @@ ParseTreeRef ParseTree::makeOperand(ConstLexTokenRef op) {
     return ParseTreeRef(new Operand(op));
 }
 
+/**
+ *
+ * Create a parse tree node representing a numeric constant that was worked
+ * out while simplifying the tree, rather than written in the expression.
+ *
+ * @param val  The value of the constant. Doubles are written so that they are
+ *             read back as doubles, even if they are whole numbers.
+ * @param pos  The part of the expression the constant replaces
+ *
+ * @return  The new node
+ *
+ */
+ParseTreeRef ParseTree::makeConstant(const Number& val, Range pos) {
+    char buf[32];
+    if (val.isInteger()) {
+        snprintf(buf, sizeof(buf), "%lld",
+                 static_cast<long long>(val.integerVal()));
+    } else {
+        // use the shortest representation that gives back the same number
+        double d = val.doubleVal();
+        for (int precision = 15; precision <= 17; precision++) {
+            snprintf(buf, sizeof(buf), "%.*g", precision, d);
+            if (atof(buf) == d) {
+                break;
+            }
+        }
+        if (strspn(buf, "-0123456789") == strlen(buf)) {
+            strcat(buf, ".0");
+        }
+    }
+    ParseTreeRef ret = makeOperand(ConstLexTokenRef(
+        new LexToken(LexToken::TYPE_NUMBER, pos, buf)));
+    ParseError err;
+    ret->validateTypes(err);
+    return ret;
+}
+
+/**
+ *
+ * Create a parse tree node representing a string constant that was worked
+ * out while simplifying the tree, rather than written in the expression.
+ *
+ * @param val  The value of the constant
+ * @param pos  The part of the expression the constant replaces
+ *
+ * @return  The new node
+ *
+ */
+ParseTreeRef ParseTree::makeConstant(const std::string& val, Range pos) {
+    ParseTreeRef ret = makeOperand(ConstLexTokenRef(
+        new LexToken(LexToken::TYPE_STRING, pos, val)));
+    ParseError err;
+    ret->validateTypes(err);
+    return ret;
+}
+
 /**
  *
  * Create an parse tree node representing a variable operand - i.e. a reference
@@ -136,6 +390,23 @@ ParseTreeRef ParseTree::makeBinaryOperator(ConstLexTokenRef op,
     return ret;
 }
 
+/**
+ *
+ * Create an parse tree node representing an 'in' operator
+ *
+ * @param op   The operator
+ * @param lhs  The expression to look up
+ * @param set  The values to look it up in
+ *
+ * @return  The new node
+ *
+ */
+ParseTreeRef ParseTree::makeInOperator(ConstLexTokenRef op,
+                                       ParseTreeRef lhs,
+                                       ValueSetRef set) {
+    return ParseTreeRef(new InOperator(op, lhs, set));
+}
+
 std::ostream& operator<< (std::ostream &out, ParseTree::NodeType t)
 {
     const char* label = "UNKNOWN";
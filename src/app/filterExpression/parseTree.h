@@ -7,10 +7,14 @@
 
 #include "lexToken.h"
 #include "variant.h"
+#include "program.h"
+#include "valueSet.h"
 #include "../lineParser.h"
 
 #include <ostream>
 #include <memory>
+#include <string>
+#include <vector>
 
 class ParseTree;
 
@@ -109,7 +113,8 @@ public:
      *                  calling externally.
      *
      * @return  The result of the expression. Note that this Variant may contain
-     *          an error if the expression could not be evaluated
+     *          an error if the expression could not be evaluated. String
+     *          results may refer to the line, so are only valid while it is.
      */
     virtual VariantRef eval(const LineParser& line,
                             NodeType typeHint) const = 0;
@@ -127,6 +132,35 @@ public:
      */
     virtual bool canBeNumber(const LineParser& line) const = 0;
 
+    /**
+     * @brief  Compile the parse tree into bytecode.
+     *
+     * Add the instructions that evaluate this node, and its children, to the
+     * end of a program. Running them has the same result as
+     * ParseTree::eval.
+     *
+     * @param program   The program to add to.
+     * @param typeHint  As for ParseTree::eval.
+     *
+     * @return  The register the result will be in.
+     *
+     */
+    virtual int compile(Program& program, NodeType typeHint) const = 0;
+
+    /**
+     * @brief  Which fields decide whether this node can be a number?
+     *
+     * This is the part of ParseTree::canBeNumber that can be worked out
+     * without a line - the node can be a number if all the fields added to
+     * fields are numbers.
+     *
+     * @param fields  The fields that must be numbers are added to this.
+     *
+     * @return  false if the node can never be a number, true otherwise.
+     *
+     */
+    virtual bool numberFields(std::vector<int>& fields) const = 0;
+
     /**
      *
      * Stream a string representation of this parse tree, for debugging
@@ -153,8 +187,48 @@ public:
      */
     virtual Range position() const = 0;
 
+    /**
+     * @brief The last csv field this tree reads.
+     *
+     * Fields after this one do not need to be parsed to evaluate the tree.
+     *
+     * @return  The highest field index referenced by this node or its
+     *          children, or -1 if it does not reference any fields.
+     *
+     */
+    virtual int highestColumn() const = 0;
+
+    /**
+     * @brief  Simplify this node.
+     *
+     * Simplify the children of this node (see ParseTree::simplify), and then
+     * work out whether the node itself can be replaced by something that is
+     * quicker to evaluate, but gives the same result for every line.
+     *
+     * This is called once the types have been validated.
+     *
+     * @return  The node to use in place of this one, or nullptr if this node
+     *          should be kept.
+     *
+     */
+    virtual ParseTreeRef simplifyNode() = 0;
+
+    virtual bool numberConstant(Number& val) const;
+    virtual bool stringConstant(std::string& val) const;
+    virtual int fieldIndex() const;
+    virtual ParseTreeRef negatedOperand() const;
+    virtual ParseTreeRef monotonicIn(int& direction) const;
+    virtual Number apply(const Number& x) const;
+    virtual void monotonicOperand(Program::Operand& operand, int& pos) const;
+    virtual bool requiredText(std::vector<std::string>& needles) const;
+    virtual void logicalTerms(LexToken::Type op,
+                              std::vector<const ParseTree*>& terms) const;
+
+    bool canFail() const;
     std::string toString();
 
+    static ParseTreeRef simplify(ParseTreeRef tree);
+
 
     static ParseTreeRef makeOperand(ConstLexTokenRef op);
     static ParseTreeRef makeOperand(ConstLexTokenRef op, int pos);
@@ -165,8 +239,16 @@ public:
     static ParseTreeRef makeBinaryOperator(ConstLexTokenRef op,
                                            ParseTreeRef lhs,
                                            ParseTreeRef rhs);
+
+    static ParseTreeRef makeInOperator(ConstLexTokenRef op,
+                                       ParseTreeRef lhs,
+                                       ValueSetRef set);
+
+    static ParseTreeRef makeConstant(const Number& val, Range pos);
+    static ParseTreeRef makeConstant(const std::string& val, Range pos);
 protected:
-    
+    ParseTreeRef fold() const;
+
 private:
     ParseTree(const ParseTree& other);
     ParseTree& operator=(const ParseTree& other);
@@ -0,0 +1,1060 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#include "program.h"
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <functional>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+
+/**
+ * @brief Constructor
+ *
+ * Create an empty program. Instructions are added by ParseTree::compile, and
+ * the program must then be finished with Program::finish before it is run.
+ *
+ */
+Program::Program()
+    :code_(),
+     fieldLists_(),
+     registers_(),
+     strings_(),
+     sets_(),
+     result_(-1),
+     error_(""),
+     orders_(),
+     chains_(),
+     profiling_(false),
+     runs_(),
+     trues_(),
+     times_(),
+     batchRegisters_(),
+     next_(),
+     active_(),
+     waiting_(),
+     merged_(),
+     numbers_(),
+     results_() {
+
+}
+
+/**
+ * @brief Set the order to compile chains of '&&' and '||' in.
+ *
+ * This must be called before the program is compiled. Chains that are not
+ * listed keep their terms in their original order.
+ *
+ * @param orders  The orders, as given by Program::reorder.
+ *
+ */
+void Program::setTermOrders(const TermOrders& orders) {
+    orders_ = orders;
+}
+
+/**
+ * @brief Add a register.
+ *
+ * @return  The index of the new register.
+ *
+ */
+int Program::addRegister() {
+    Register r = {Variant::ERROR, Number(), false, nullptr};
+    registers_.push_back(r);
+    strings_.push_back(std::string());
+    return registers_.size() - 1;
+}
+
+/**
+ * @brief Add a register holding a constant number.
+ *
+ * @param val  The value of the constant.
+ *
+ * @return  The index of the new register.
+ *
+ */
+int Program::addConstant(const Number& val) {
+    int reg = addRegister();
+    registers_[reg].type = Variant::NUMBER;
+    registers_[reg].number = val;
+    return reg;
+}
+
+/**
+ * @brief Add a register holding a constant string.
+ *
+ * @param val  The value of the constant.
+ *
+ * @return  The index of the new register.
+ *
+ */
+int Program::addConstant(const std::string& val) {
+    int reg = addRegister();
+    registers_[reg].type = Variant::STRING;
+    // the string is pointed at in Program::finish, once strings_ has stopped
+    // moving
+    strings_[reg] = val;
+    return reg;
+}
+
+/**
+ * @brief Add a set of values, for the right hand side of an 'in'.
+ *
+ * @param set  The set.
+ *
+ * @return  The index of the set, which is the b operand of OP_NUMBER_IN and
+ *          OP_STRING_IN.
+ *
+ */
+int Program::addSet(ValueSetRef set) {
+    sets_.push_back(set);
+    return sets_.size() - 1;
+}
+
+/**
+ * @brief Add an instruction.
+ *
+ * @param op    The instruction.
+ * @param dest  The register the instruction writes to.
+ * @param a     The first operand, or -1 if there isn't one.
+ * @param b     The second operand, or -1 if there isn't one.
+ * @param pos   The position of the operator in the expression.
+ *
+ * @return  The index of the instruction.
+ *
+ */
+size_t Program::emit(Opcode op, int dest, int a, int b, int pos) {
+    Instruction in = {op, dest, a, b, pos, OPERAND_LEFT, 0};
+    code_.push_back(in);
+    return code_.size() - 1;
+}
+
+/**
+ * @brief Change how the first operand of an instruction is reported if it is
+ *        the wrong type.
+ *
+ * This also moves the position of the instruction's operator, so the second
+ * operand must not be able to fail (it is a constant, for example).
+ *
+ * @param instruction  The index of the instruction.
+ * @param operand      How the operand is reported.
+ * @param pos          The position of the operator to report it against.
+ *
+ */
+void Program::setLeftOperand(size_t instruction, Operand operand, int pos) {
+    code_[instruction].left = operand;
+    code_[instruction].pos = pos;
+}
+
+/**
+ * @brief Add a branch on whether fields are numbers.
+ *
+ * The target is set later with Program::setTarget.
+ *
+ * @param fields  The fields that must all be numbers to carry on, rather than
+ *                taking the branch.
+ *
+ * @return  The index of the instruction.
+ *
+ */
+size_t Program::emitJumpUnlessNumbers(const std::vector<int>& fields) {
+    size_t ret = emit(OP_JUMP_UNLESS_NUMBERS, -1, fieldLists_.size(),
+                      fields.size(), 0);
+    fieldLists_.insert(fieldLists_.end(), fields.begin(), fields.end());
+    return ret;
+}
+
+/**
+ * @brief Add an unconditional jump.
+ *
+ * The target is set later with Program::setTarget.
+ *
+ * @return  The index of the instruction.
+ *
+ */
+size_t Program::emitJump() {
+    return emit(OP_JUMP, -1, -1, -1, 0);
+}
+
+/**
+ * @brief Point a jump at the next instruction to be added.
+ *
+ * @param instruction  The index of the jump.
+ *
+ */
+void Program::setTarget(size_t instruction) {
+    code_[instruction].target = code_.size();
+}
+
+/**
+ * @brief Start compiling a chain of '&&' or '||'.
+ *
+ * Each term of the chain is compiled in the order given by
+ * Program::termOrder, starting with a call to Program::beginTerm, and ending
+ * with an instruction that decides whether the rest of the chain is skipped.
+ * The chain is then ended with Program::endChain.
+ *
+ * @param id       Identifies the chain, across compilations of the same
+ *                 expression.
+ * @param isAnd    true for '&&', false for '||'.
+ * @param canFail  Whether each term, in its original order, can fail to
+ *                 evaluate.
+ *
+ * @return  The index of the chain.
+ *
+ */
+size_t Program::beginChain(int id,
+                           bool isAnd,
+                           const std::vector<bool>& canFail) {
+    Chain chain = {id, isAnd, canFail, std::vector<int>(),
+                   std::vector<size_t>()};
+    TermOrders::const_iterator order = orders_.find(id);
+    if (order != orders_.end() && order->second.size() == canFail.size()) {
+        chain.order = order->second;
+    } else {
+        for (size_t i = 0; i < canFail.size(); i++) {
+            chain.order.push_back(i);
+        }
+    }
+    chains_.push_back(chain);
+    return chains_.size() - 1;
+}
+
+/**
+ * @brief The order to compile the terms of a chain in.
+ *
+ * @param chain  The index of the chain.
+ *
+ * @return  The original index of the term to compile in each place.
+ *
+ */
+const std::vector<int>& Program::termOrder(size_t chain) const {
+    return chains_[chain].order;
+}
+
+/**
+ * @brief Start compiling the next term of a chain.
+ *
+ * @param chain  The index of the chain.
+ *
+ */
+void Program::beginTerm(size_t chain) {
+    chains_[chain].starts.push_back(code_.size());
+}
+
+/**
+ * @brief Finish compiling a chain.
+ *
+ * @param chain  The index of the chain.
+ *
+ */
+void Program::endChain(size_t chain) {
+    chains_[chain].starts.push_back(code_.size());
+}
+
+/**
+ * @brief Finish compiling the program.
+ *
+ * @param result  The register holding the result of the expression.
+ *
+ */
+void Program::finish(int result) {
+    result_ = result;
+    for (size_t i = 0; i < registers_.size(); i++) {
+        if (registers_[i].type == Variant::STRING) {
+            registers_[i].string = strings_[i].c_str();
+        }
+    }
+    runs_.assign(code_.size(), 0);
+    trues_.assign(code_.size(), 0);
+    times_.assign(code_.size(), std::chrono::steady_clock::duration::zero());
+}
+
+/**
+ * @brief Is a register a constant?
+ *
+ * @param reg   The register.
+ * @param type  The type of constant wanted.
+ *
+ * @return  true if the register holds a constant of that type.
+ *
+ */
+bool Program::isConstant(int reg, Variant::Type type) const {
+    // registers written by instructions start off as errors
+    return (registers_[reg].type == type);
+}
+
+/**
+ * @brief Run a single instruction.
+ *
+ * @param line  The current line, either a LineParser or a LineBatch::Row.
+ * @param regs  The registers for the line.
+ * @param ip    The index of the instruction. This is moved on to the next
+ *              instruction to run.
+ *
+ * @return  true if the instruction was run, false if it failed (in which case
+ *          error_ is set).
+ *
+ */
+template <typename Line>
+inline bool Program::step(const Line& line, Register* regs, size_t& ip) {
+    bool ok = true;
+    const Instruction& in = code_[ip];
+    Register& dest = regs[in.dest >= 0 ? in.dest : 0];
+    int cmp = 0;
+    ip++;
+
+    switch (in.op) {
+    case OP_LOAD_NUMBER: {
+        Field f = line.field(in.a);
+        if (f.asNumber(dest.number)) {
+            dest.type = Variant::NUMBER;
+        } else {
+            dest.type = Variant::STRING;
+            dest.string = f.asString();
+        }
+        break;
+    }
+    case OP_LOAD_STRING:
+        dest.type = Variant::STRING;
+        dest.string = line.field(in.a).asString();
+        break;
+    case OP_NEGATE:
+        if (regs[in.a].type != Variant::NUMBER) {
+            setError(in, OPERAND_UNARY, Variant::NUMBER, regs[in.a].type);
+            ok = false;
+        } else {
+            dest.type = Variant::NUMBER;
+            dest.number = regs[in.a].number.negate();
+        }
+        break;
+    case OP_ADD:
+        if ((ok = expect(regs, in, Variant::NUMBER))) {
+            dest.type = Variant::NUMBER;
+            dest.number = regs[in.a].number.add(regs[in.b].number);
+        }
+        break;
+    case OP_SUBTRACT:
+        if ((ok = expect(regs, in, Variant::NUMBER))) {
+            dest.type = Variant::NUMBER;
+            dest.number = regs[in.a].number.subtract(regs[in.b].number);
+        }
+        break;
+    case OP_MULTIPLY:
+        if ((ok = expect(regs, in, Variant::NUMBER))) {
+            dest.type = Variant::NUMBER;
+            dest.number = regs[in.a].number.multiply(regs[in.b].number);
+        }
+        break;
+    case OP_DIVIDE:
+        if ((ok = expect(regs, in, Variant::NUMBER))) {
+            dest.type = Variant::NUMBER;
+            dest.number = regs[in.a].number.divide(regs[in.b].number);
+        }
+        break;
+    case OP_CONCAT:
+        if ((ok = expect(regs, in, Variant::STRING))) {
+            size_t lLen = strlen(regs[in.a].string);
+            size_t rLen = strlen(regs[in.b].string);
+            char* buf = line.arena().alloc(lLen + rLen + 1);
+            memcpy(buf, regs[in.a].string, lLen);
+            memcpy(buf + lLen, regs[in.b].string, rLen + 1);
+            dest.type = Variant::STRING;
+            dest.string = buf;
+        }
+        break;
+    case OP_NUMBER_LT:
+        if ((ok = expect(regs, in, Variant::NUMBER))) {
+            dest.type = Variant::BOOLEAN;
+            dest.boolean = regs[in.a].number.compare(
+                regs[in.b].number, std::less<double>());
+        }
+        break;
+    case OP_NUMBER_LTE:
+        if ((ok = expect(regs, in, Variant::NUMBER))) {
+            dest.type = Variant::BOOLEAN;
+            dest.boolean = regs[in.a].number.compare(
+                regs[in.b].number, std::less_equal<double>());
+        }
+        break;
+    case OP_NUMBER_EQ:
+        if ((ok = expect(regs, in, Variant::NUMBER))) {
+            dest.type = Variant::BOOLEAN;
+            dest.boolean = regs[in.a].number.compare(
+                regs[in.b].number, std::equal_to<double>());
+        }
+        break;
+    case OP_NUMBER_NEQ:
+        if ((ok = expect(regs, in, Variant::NUMBER))) {
+            dest.type = Variant::BOOLEAN;
+            dest.boolean = regs[in.a].number.compare(
+                regs[in.b].number, std::not_equal_to<double>());
+        }
+        break;
+    case OP_NUMBER_GT:
+        if ((ok = expect(regs, in, Variant::NUMBER))) {
+            dest.type = Variant::BOOLEAN;
+            dest.boolean = regs[in.a].number.compare(
+                regs[in.b].number, std::greater<double>());
+        }
+        break;
+    case OP_NUMBER_GTE:
+        if ((ok = expect(regs, in, Variant::NUMBER))) {
+            dest.type = Variant::BOOLEAN;
+            dest.boolean = regs[in.a].number.compare(
+                regs[in.b].number, std::greater_equal<double>());
+        }
+        break;
+    case OP_STRING_LT:
+    case OP_STRING_LTE:
+    case OP_STRING_EQ:
+    case OP_STRING_NEQ:
+    case OP_STRING_GT:
+    case OP_STRING_GTE:
+        if ((ok = expect(regs, in, Variant::STRING))) {
+            cmp = strcmp(regs[in.a].string, regs[in.b].string);
+            dest.type = Variant::BOOLEAN;
+            switch (in.op) {
+            case OP_STRING_LT:  dest.boolean = (cmp < 0);  break;
+            case OP_STRING_LTE: dest.boolean = (cmp <= 0); break;
+            case OP_STRING_EQ:  dest.boolean = (cmp == 0); break;
+            case OP_STRING_NEQ: dest.boolean = (cmp != 0); break;
+            case OP_STRING_GT:  dest.boolean = (cmp > 0);  break;
+            default:            dest.boolean = (cmp >= 0); break;
+            }
+        }
+        break;
+    case OP_FIELD_NUMBER_LT:
+        ok = fieldNumber(line, regs, in, std::less<double>());
+        break;
+    case OP_FIELD_NUMBER_LTE:
+        ok = fieldNumber(line, regs, in, std::less_equal<double>());
+        break;
+    case OP_FIELD_NUMBER_EQ:
+        ok = fieldNumber(line, regs, in, std::equal_to<double>());
+        break;
+    case OP_FIELD_NUMBER_NEQ:
+        ok = fieldNumber(line, regs, in, std::not_equal_to<double>());
+        break;
+    case OP_FIELD_NUMBER_GT:
+        ok = fieldNumber(line, regs, in, std::greater<double>());
+        break;
+    case OP_FIELD_NUMBER_GTE:
+        ok = fieldNumber(line, regs, in, std::greater_equal<double>());
+        break;
+    case OP_FIELD_STRING_LT:
+        ok = fieldString(line, regs, in, std::less<int>());
+        break;
+    case OP_FIELD_STRING_LTE:
+        ok = fieldString(line, regs, in, std::less_equal<int>());
+        break;
+    case OP_FIELD_STRING_EQ:
+        ok = fieldString(line, regs, in, std::equal_to<int>());
+        break;
+    case OP_FIELD_STRING_NEQ:
+        ok = fieldString(line, regs, in, std::not_equal_to<int>());
+        break;
+    case OP_FIELD_STRING_GT:
+        ok = fieldString(line, regs, in, std::greater<int>());
+        break;
+    case OP_FIELD_STRING_GTE:
+        ok = fieldString(line, regs, in, std::greater_equal<int>());
+        break;
+    case OP_NUMBER_IN:
+        if (regs[in.a].type != Variant::NUMBER) {
+            setError(in, in.left, Variant::NUMBER, regs[in.a].type);
+            ok = false;
+        } else {
+            dest.type = Variant::BOOLEAN;
+            dest.boolean = sets_[in.b]->contains(regs[in.a].number);
+        }
+        break;
+    case OP_STRING_IN:
+        if (regs[in.a].type != Variant::STRING) {
+            setError(in, in.left, Variant::STRING, regs[in.a].type);
+            ok = false;
+        } else {
+            dest.type = Variant::BOOLEAN;
+            dest.boolean = sets_[in.b]->contains(regs[in.a].string);
+        }
+        break;
+    case OP_AND:
+    case OP_OR:
+        if (regs[in.a].type != Variant::BOOLEAN) {
+            setError(in, in.left, Variant::BOOLEAN, regs[in.a].type);
+            ok = false;
+        } else {
+            dest = regs[in.a];
+            if (dest.boolean == (in.op == OP_OR)) {
+                ip = in.target;
+            }
+        }
+        break;
+    case OP_RIGHT_BOOLEAN:
+        if (regs[in.a].type != Variant::BOOLEAN) {
+            setError(in, OPERAND_RIGHT, Variant::BOOLEAN, regs[in.a].type);
+            ok = false;
+        } else {
+            dest = regs[in.a];
+        }
+        break;
+    case OP_JUMP:
+        ip = in.target;
+        break;
+    case OP_JUMP_UNLESS_NUMBERS: {
+        Number dummy;
+        for (int i = in.a; i < in.a + in.b; i++) {
+            if (!line.field(fieldLists_[i]).asNumber(dummy)) {
+                ip = in.target;
+                break;
+            }
+        }
+        break;
+    }
+    default:
+        // every instruction is handled above
+        abort();
+        break;
+    }
+
+    return ok;
+}
+
+/**
+ * @brief Run the program.
+ *
+ * Evaluate the expression in the context of a line. The fields it uses must
+ * have been split out of the line.
+ *
+ * @param line  The current line.
+ *
+ * @return  true if the expression was evaluated, in which case the result is
+ *          available from Program::resultType and friends, or false if it
+ *          could not be (in which case see Program::errText).
+ *
+ */
+bool Program::run(const LineParser& line) {
+    return runLine(line);
+}
+
+/**
+ * @brief Run the program on a line from a batch.
+ *
+ * @copydetails Program::run(const LineParser&)
+ *
+ */
+bool Program::run(const LineBatch::Row& line) {
+    return runLine(line);
+}
+
+template <typename Line>
+bool Program::runLine(const Line& line) {
+    bool ok = true;
+    Register* regs = registers_.data();
+    size_t ip = 0;
+    size_t end = code_.size();
+
+    while (ok && ip < end) {
+        ok = step(line, regs, ip);
+    }
+
+    return ok;
+}
+
+/**
+ * @brief Run the program on a batch of lines.
+ *
+ * This gives the same results as running the program on each line in turn,
+ * but runs each instruction for all the lines that reach it before moving on
+ * to the next. Jumps only ever go forwards, so one pass through the program
+ * is enough. The lines that run an instruction are kept in a list, which
+ * each instruction hands on to the next: the lines that carry on stay in it,
+ * and the lines that jump wait to be added back in at their target (see
+ * Program::handOn). So a branch that only some of the lines take (such as
+ * the right hand side of an '&&') only ever looks at those lines, and the
+ * fields it uses are not found in the others.
+ *
+ * Comparisons between a field and a constant are run as loops down the
+ * column: the fields are all converted first, and then compared.
+ *
+ * @param batch    The lines. The fields the expression uses must have been
+ *                 kept (see LineBatch::setFieldLimit).
+ * @param start    The first line to run the program on. The ones before it
+ *                 are left alone.
+ * @param matches  Set to whether the result was true, for each line that the
+ *                 expression was evaluated for.
+ *
+ * @return  The number of lines the expression was evaluated for. If this is
+ *          less than the size of the batch then it could not be evaluated
+ *          for the next line (see Program::errText), and the lines after
+ *          that were not looked at.
+ *
+ */
+size_t Program::runBatch(const LineBatch& batch,
+                         size_t start,
+                         std::vector<unsigned char>& matches) {
+    size_t rows = batch.size();
+    if (batchRegisters_.empty()) {
+        // every line starts off with its own copy of the constants
+        batchRegisters_.reserve(registers_.size() * LineBatch::CAPACITY);
+        for (size_t row = 0; row < LineBatch::CAPACITY; row++) {
+            batchRegisters_.insert(batchRegisters_.end(),
+                                   registers_.begin(), registers_.end());
+        }
+    }
+
+    next_.assign(rows, 0);
+    waiting_.resize(code_.size() + 1);
+    for (size_t ip = 0; ip < waiting_.size(); ip++) {
+        waiting_[ip].clear();
+    }
+    active_.clear();
+    for (size_t row = start; row < rows; row++) {
+        active_.push_back(row);
+    }
+
+    size_t failed = rows;
+    for (size_t ip = 0; ip < code_.size(); ip++) {
+        const Instruction& in = code_[ip];
+        std::chrono::steady_clock::time_point begin;
+        if (profiling_) {
+            begin = std::chrono::steady_clock::now();
+        }
+        joinWaiting(ip, failed);
+
+        switch (in.op) {
+        case OP_FIELD_NUMBER_LT:
+            batchFieldNumber(batch, in, std::less<double>(), failed);
+            break;
+        case OP_FIELD_NUMBER_LTE:
+            batchFieldNumber(batch, in, std::less_equal<double>(), failed);
+            break;
+        case OP_FIELD_NUMBER_EQ:
+            batchFieldNumber(batch, in, std::equal_to<double>(), failed);
+            break;
+        case OP_FIELD_NUMBER_NEQ:
+            batchFieldNumber(batch, in, std::not_equal_to<double>(), failed);
+            break;
+        case OP_FIELD_NUMBER_GT:
+            batchFieldNumber(batch, in, std::greater<double>(), failed);
+            break;
+        case OP_FIELD_NUMBER_GTE:
+            batchFieldNumber(batch, in, std::greater_equal<double>(), failed);
+            break;
+        case OP_FIELD_STRING_LT:
+            batchFieldString(batch, in, std::less<int>());
+            break;
+        case OP_FIELD_STRING_LTE:
+            batchFieldString(batch, in, std::less_equal<int>());
+            break;
+        case OP_FIELD_STRING_EQ:
+            batchFieldString(batch, in, std::equal_to<int>());
+            break;
+        case OP_FIELD_STRING_NEQ:
+            batchFieldString(batch, in, std::not_equal_to<int>());
+            break;
+        case OP_FIELD_STRING_GT:
+            batchFieldString(batch, in, std::greater<int>());
+            break;
+        case OP_FIELD_STRING_GTE:
+            batchFieldString(batch, in, std::greater_equal<int>());
+            break;
+        default:
+            for (size_t i = 0; i < active_.size() && active_[i] < failed;
+                 i++) {
+                size_t row = active_[i];
+                if (!step(batch.row(row), batchRegisters(row), next_[row])) {
+                    // the lines after this one do not matter any more
+                    failed = row;
+                }
+            }
+            break;
+        }
+
+        if (profiling_) {
+            profile(ip, begin);
+        }
+        handOn(ip, failed);
+    }
+
+    matches.resize(rows);
+    for (size_t row = start; row < failed; row++) {
+        const Register& result = batchRegisters(row)[result_];
+        matches[row] = (result.type == Variant::BOOLEAN && result.boolean);
+    }
+    return failed;
+}
+
+/**
+ * @brief Add the lines waiting for an instruction to the ones that run it.
+ *
+ * @param ip      The instruction about to be run.
+ * @param failed  The first line that failed. It and the lines after it are
+ *                dropped.
+ *
+ */
+void Program::joinWaiting(size_t ip, size_t failed) {
+    std::vector<size_t>& waiting = waiting_[ip];
+    if (!waiting.empty()) {
+        if (!std::is_sorted(waiting.begin(), waiting.end())) {
+            // lines jumped here from more than one place
+            std::sort(waiting.begin(), waiting.end());
+        }
+        merged_.clear();
+        std::merge(active_.begin(), active_.end(),
+                   waiting.begin(), waiting.end(),
+                   std::back_inserter(merged_));
+        active_.swap(merged_);
+    }
+    while (!active_.empty() && active_.back() >= failed) {
+        active_.pop_back();
+    }
+}
+
+/**
+ * @brief Hand the lines that ran an instruction on to what they run next.
+ *
+ * The lines that carry on to the next instruction are left in active_, in
+ * order, and the lines that jumped are put aside until their target.
+ *
+ * @param ip      The instruction that was run.
+ * @param failed  The first line that failed. It and the lines after it are
+ *                dropped.
+ *
+ */
+void Program::handOn(size_t ip, size_t failed) {
+    size_t kept = 0;
+    for (size_t i = 0; i < active_.size() && active_[i] < failed; i++) {
+        size_t row = active_[i];
+        if (next_[row] == ip + 1) {
+            active_[kept++] = row;
+        } else {
+            waiting_[next_[row]].push_back(row);
+        }
+    }
+    active_.resize(kept);
+}
+
+/**
+ * @brief Turn profiling of Program::runBatch on or off.
+ *
+ * While it is on, the lines that reach each instruction, and the time it
+ * takes, are added up for Program::reorder.
+ *
+ */
+void Program::setProfiling(bool profiling) {
+    profiling_ = profiling;
+}
+
+/**
+ * @brief Work out a quicker order for the terms of each chain.
+ *
+ * The terms of a chain of '&&' can be run in any order without changing the
+ * result, as long as none of them can fail - and likewise for '||'. The
+ * quickest order runs the terms that are cheap, and likely to decide the
+ * result, first. This uses the profile of the batches run so far to rank
+ * each term by the time it takes for each line, divided by the fraction of
+ * lines it decides the result for.
+ *
+ * A term that can fail must still be run before any of the terms that follow
+ * it, so that a line that it fails for is not decided by one of them
+ * instead. It can be moved ahead of the terms that cannot fail though. When
+ * that happens the program can fail for a line that the original order would
+ * have decided first, so the caller must check any failure by running the
+ * line through the program compiled in the original order.
+ *
+ * The profile is cleared.
+ *
+ * @param orders  Set to the order for each chain, to compile the program
+ *                with again (see Program::setTermOrders).
+ *
+ * @return  true if this is different from the order the program was
+ *          compiled in, false otherwise.
+ *
+ */
+bool Program::reorder(TermOrders& orders) {
+    bool changed = false;
+    orders.clear();
+    for (size_t c = 0; c < chains_.size(); c++) {
+        std::vector<int> order = bestOrder(chains_[c]);
+        changed = changed || (order != chains_[c].order);
+        orders[chains_[c].id] = order;
+    }
+
+    runs_.assign(code_.size(), 0);
+    trues_.assign(code_.size(), 0);
+    times_.assign(code_.size(), std::chrono::steady_clock::duration::zero());
+    return changed;
+}
+
+/**
+ * @brief Was the program compiled with any terms out of their original
+ *        order?
+ *
+ */
+bool Program::reordered() const {
+    bool ret = false;
+    for (size_t c = 0; !ret && c < chains_.size(); c++) {
+        for (size_t i = 0; !ret && i < chains_[c].order.size(); i++) {
+            ret = (chains_[c].order[i] != static_cast<int>(i));
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Add an instruction that has just been run to the profile.
+ *
+ * @param ip     The instruction.
+ * @param begin  When it started.
+ *
+ */
+void Program::profile(size_t ip, std::chrono::steady_clock::time_point begin) {
+    const Instruction& in = code_[ip];
+    runs_[ip] += active_.size();
+    times_[ip] += std::chrono::steady_clock::now() - begin;
+    if (in.op == OP_AND || in.op == OP_OR || in.op == OP_RIGHT_BOOLEAN) {
+        for (size_t i = 0; i < active_.size(); i++) {
+            const Register& dest = batchRegisters(active_[i])[in.dest];
+            trues_[ip] += (dest.type == Variant::BOOLEAN && dest.boolean);
+        }
+    }
+}
+
+/**
+ * @brief The quickest order for the terms of a chain.
+ *
+ * @see Program::reorder
+ *
+ * @return  The original index of the term to run in each place. This is the
+ *          current order if some of the terms have not been profiled.
+ *
+ */
+std::vector<int> Program::bestOrder(const Chain& chain) const {
+    size_t terms = chain.order.size();
+    const double never = std::numeric_limits<double>::infinity();
+    std::vector<double> rank(terms, never);
+    bool profiled = true;
+    for (size_t i = 0; profiled && i < terms; i++) {
+        size_t first = chain.starts[i];
+        size_t last = chain.starts[i + 1] - 1;
+        profiled = (runs_[first] > 0);
+        if (profiled) {
+            std::chrono::steady_clock::duration time =
+                std::chrono::steady_clock::duration::zero();
+            for (size_t ip = first; ip <= last; ip++) {
+                time += times_[ip];
+            }
+            uint64_t decided = chain.isAnd ? runs_[last] - trues_[last]
+                                           : trues_[last];
+            if (decided > 0) {
+                rank[chain.order[i]] = static_cast<double>(time.count()) /
+                                       static_cast<double>(decided);
+            }
+        }
+    }
+
+    std::vector<int> ret;
+    if (!profiled) {
+        ret = chain.order;
+    } else {
+        // repeatedly pick the best term that is not stuck behind a term that
+        // can fail
+        std::vector<bool> placed(terms, false);
+        while (ret.size() < terms) {
+            int best = -1;
+            bool blocked = false;
+            for (size_t t = 0; !blocked && t < terms; t++) {
+                if (!placed[t] && (best < 0 || rank[t] < rank[best])) {
+                    best = t;
+                }
+                blocked = (!placed[t] && chain.canFail[t]);
+            }
+            placed[best] = true;
+            ret.push_back(best);
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Compare a column of fields with a constant number.
+ *
+ * This runs a OP_FIELD_NUMBER_* instruction for the lines in active_.
+ *
+ * @param batch    The lines.
+ * @param in       The instruction.
+ * @param compare  The comparison, e.g. std::less<double>.
+ * @param failed   If the field in one of the lines is not a number, this is
+ *                 set to that line (and error_ is set), and the lines after
+ *                 it are not compared.
+ *
+ */
+template <typename Compare>
+void Program::batchFieldNumber(const LineBatch& batch,
+                               const Instruction& in,
+                               Compare compare,
+                               size_t& failed) {
+    numbers_.resize(active_.size());
+    results_.resize(active_.size());
+
+    size_t count = 0;
+    while (count < active_.size() && active_[count] < failed) {
+        if (batch.field(in.a, active_[count]).asNumber(numbers_[count])) {
+            count++;
+        } else {
+            failed = active_[count];
+            setError(in, in.left, Variant::NUMBER, Variant::STRING);
+        }
+    }
+
+    const Number constant = registers_[in.b].number;
+    for (size_t i = 0; i < count; i++) {
+        results_[i] = numbers_[i].compare(constant, compare);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        size_t row = active_[i];
+        Register& dest = batchRegisters(row)[in.dest];
+        dest.type = Variant::BOOLEAN;
+        dest.boolean = results_[i];
+        next_[row]++;
+    }
+}
+
+/**
+ * @brief Compare a column of fields with a constant string.
+ *
+ * This runs a OP_FIELD_STRING_* instruction for the lines in active_, which
+ * cannot fail.
+ *
+ * @param batch    The lines.
+ * @param in       The instruction.
+ * @param compare  How the result of strcmp is compared with 0, e.g.
+ *                 std::less<int>.
+ *
+ */
+template <typename Compare>
+void Program::batchFieldString(const LineBatch& batch,
+                               const Instruction& in,
+                               Compare compare) {
+    results_.resize(active_.size());
+
+    const char* constant = registers_[in.b].string;
+    for (size_t i = 0; i < active_.size(); i++) {
+        int cmp = strcmp(batch.field(in.a, active_[i]).asString(), constant);
+        results_[i] = compare(cmp, 0);
+    }
+
+    for (size_t i = 0; i < active_.size(); i++) {
+        size_t row = active_[i];
+        Register& dest = batchRegisters(row)[in.dest];
+        dest.type = Variant::BOOLEAN;
+        dest.boolean = results_[i];
+        next_[row]++;
+    }
+}
+
+/**
+ * @brief The registers for a line in the batch being run.
+ *
+ */
+inline Program::Register* Program::batchRegisters(size_t row) {
+    return &batchRegisters_[row * registers_.size()];
+}
+
+/**
+ * @brief The type of the result.
+ *
+ * @return  The type of the result of the last successful Program::run.
+ *
+ */
+Variant::Type Program::resultType() const {
+    return registers_[result_].type;
+}
+
+/**
+ * @brief The result, if it is a number.
+ *
+ */
+Number Program::numberResult() const {
+    return registers_[result_].number;
+}
+
+/**
+ * @brief The result, if it is a boolean.
+ *
+ */
+bool Program::booleanResult() const {
+    return registers_[result_].boolean;
+}
+
+/**
+ * @brief The result, if it is a string.
+ *
+ * This is only valid until the program is run again, or the next line is
+ * parsed.
+ *
+ */
+const char* Program::stringResult() const {
+    return registers_[result_].string;
+}
+
+/**
+ * @brief  Error description
+ *
+ * @return  A description of the error, if the last call to Program::run
+ *          returned false.
+ *
+ */
+const std::string& Program::errText() const {
+    return error_;
+}
+
+/**
+ * @brief  The number of instructions in the program.
+ *
+ */
+size_t Program::size() const {
+    return code_.size();
+}
+
+/**
+ * @brief  Describe an operand of the wrong type.
+ *
+ * This gives the same message as ParseTree::eval does.
+ *
+ * @param operand   How the operand is used.
+ * @param pos       The position of its operator in the expression.
+ * @param expected  The type the operator needed.
+ * @param actual    The type the operand was.
+ *
+ */
+std::string Program::operandError(Operand operand,
+                                  int pos,
+                                  Variant::Type expected,
+                                  Variant::Type actual) {
+    std::stringstream msg;
+    if (operand == OPERAND_UNARY) {
+        msg << "The unary operator at " << pos
+            << " expects arguments of type " << expected
+            << " (got " << actual << ")";
+    } else {
+        msg << (operand == OPERAND_LEFT ? "Left" : "Right")
+            << " hand side of operator at " << pos
+            << ": expected " << expected << ", got " << actual;
+    }
+    return msg.str();
+}
+
+void Program::setError(const Instruction& in,
+                       Operand operand,
+                       Variant::Type expected,
+                       Variant::Type actual) {
+    error_ = operandError(operand, in.pos, expected, actual);
+}
@@ -0,0 +1,366 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#ifndef CSVFILTER_PROGRAM_H
+#define CSVFILTER_PROGRAM_H
+
+#include "variant.h"
+#include "valueSet.h"
+#include "../lineParser.h"
+#include "../lineBatch.h"
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief A filter expression compiled into bytecode.
+ *
+ * The parse tree for an expression is compiled into a flat list of
+ * instructions (see ParseTree::compile), which work on a file of registers.
+ * Each node of the tree writes its result to its own register, and the
+ * registers hold unboxed numbers, booleans and strings, so evaluating a line
+ * does not make any virtual calls. Strings either point at the line or at the
+ * constants, or (for strings built while running) are allocated from the
+ * line's arena (see LineParser::arena), so no memory is allocated either.
+ *
+ * Comparisons between a field and a constant, which are the most common
+ * filters, are compiled into a single instruction that reads the field and
+ * compares it without going through a register (see Program::fieldNumber).
+ *
+ * The type of a csv field is not always known when the expression is parsed
+ * (see ParseTree::NodeType). Where the parse tree would decide at run time
+ * whether to treat part of the expression as numbers or strings, both versions
+ * are compiled, and a branch picks between them depending on which fields are
+ * numbers. The results, including any errors, are the same as those from
+ * ParseTree::eval.
+ *
+ * A program can also be run on a whole LineBatch at once (see
+ * Program::runBatch). Each instruction is then run for every line that has
+ * reached it before moving on to the next instruction, and comparisons
+ * between fields and constants become loops down a column of the batch.
+ *
+ * Chains of '&&' or '||' are compiled as a list of terms, each of which can
+ * decide the result for the rest (see Program::beginChain). A program can
+ * time how long each term takes over a batch and how often it decides the
+ * result (see Program::setProfiling), and from that work out a quicker order
+ * to compile the terms in (see Program::reorder).
+ *
+ */
+class Program {
+public:
+    /**
+     * @brief The instructions.
+     *
+     * Unless stated otherwise, instructions write to the dest register. Those
+     * that take operands read them from registers a and b, and report type
+     * errors at the position in the expression given by pos.
+     */
+    typedef enum {
+        OP_LOAD_NUMBER,   /**< Load field a as a number if it is one, or as a
+                           *   string if it is not */
+        OP_LOAD_STRING,   /**< Load field a as a string */
+        OP_NEGATE,        /**< Number -a */
+        OP_ADD,           /**< Number a + b */
+        OP_SUBTRACT,      /**< Number a - b */
+        OP_MULTIPLY,      /**< Number a * b */
+        OP_DIVIDE,        /**< Number a / b */
+        OP_CONCAT,        /**< String a + b */
+        OP_NUMBER_LT,     /**< Number a < b */
+        OP_NUMBER_LTE,    /**< Number a <= b */
+        OP_NUMBER_EQ,     /**< Number a == b */
+        OP_NUMBER_NEQ,    /**< Number a != b */
+        OP_NUMBER_GT,     /**< Number a > b */
+        OP_NUMBER_GTE,    /**< Number a >= b */
+        OP_STRING_LT,     /**< String a < b */
+        OP_STRING_LTE,    /**< String a <= b */
+        OP_STRING_EQ,     /**< String a == b */
+        OP_STRING_NEQ,    /**< String a != b */
+        OP_STRING_GT,     /**< String a > b */
+        OP_STRING_GTE,    /**< String a >= b */
+        OP_FIELD_NUMBER_LT,  /**< Field a as a number < constant b */
+        OP_FIELD_NUMBER_LTE, /**< Field a as a number <= constant b */
+        OP_FIELD_NUMBER_EQ,  /**< Field a as a number == constant b */
+        OP_FIELD_NUMBER_NEQ, /**< Field a as a number != constant b */
+        OP_FIELD_NUMBER_GT,  /**< Field a as a number > constant b */
+        OP_FIELD_NUMBER_GTE, /**< Field a as a number >= constant b */
+        OP_FIELD_STRING_LT,  /**< Field a as a string < constant b */
+        OP_FIELD_STRING_LTE, /**< Field a as a string <= constant b */
+        OP_FIELD_STRING_EQ,  /**< Field a as a string == constant b */
+        OP_FIELD_STRING_NEQ, /**< Field a as a string != constant b */
+        OP_FIELD_STRING_GT,  /**< Field a as a string > constant b */
+        OP_FIELD_STRING_GTE, /**< Field a as a string >= constant b */
+        OP_NUMBER_IN,     /**< Whether number a is in set b */
+        OP_STRING_IN,     /**< Whether string a is in set b */
+        OP_AND,           /**< Copy boolean a, and jump to target if it is
+                           *   false */
+        OP_OR,            /**< Copy boolean a, and jump to target if it is
+                           *   true */
+        OP_RIGHT_BOOLEAN, /**< Copy boolean a, the right hand side of a
+                           *   logical operator */
+        OP_JUMP,          /**< Jump to target */
+        OP_JUMP_UNLESS_NUMBERS /**< Jump to target unless the b fields listed
+                                *   from index a of the field list are all
+                                *   numbers */
+    } Opcode;
+
+    /**
+     * @brief How an operand of the wrong type is reported.
+     *
+     * This is normally the side of the instruction's operator that the operand
+     * is on, but a comparison that has been simplified (see
+     * ComparisonBinaryOperator::simplifyNode) reports its first operand as the
+     * operator it replaced would have done.
+     */
+    typedef enum {
+        OPERAND_LEFT,  /**< The left hand side of a binary operator */
+        OPERAND_RIGHT, /**< The right hand side of a binary operator */
+        OPERAND_UNARY  /**< The argument of a unary operator */
+    } Operand;
+
+    /**
+     * @brief The order to compile the terms of each chain of '&&' or '||'
+     *        in.
+     *
+     * Chains are identified by the position of their operator in the
+     * expression, and each order lists the original index of the term to
+     * compile in each place.
+     */
+    typedef std::map<int, std::vector<int> > TermOrders;
+
+    Program();
+
+    void setTermOrders(const TermOrders& orders);
+    int addRegister();
+    int addConstant(const Number& val);
+    int addConstant(const std::string& val);
+    int addSet(ValueSetRef set);
+    size_t emit(Opcode op, int dest, int a, int b, int pos);
+    void setLeftOperand(size_t instruction, Operand operand, int pos);
+    size_t emitJumpUnlessNumbers(const std::vector<int>& fields);
+    size_t emitJump();
+    void setTarget(size_t instruction);
+    size_t beginChain(int id, bool isAnd, const std::vector<bool>& canFail);
+    const std::vector<int>& termOrder(size_t chain) const;
+    void beginTerm(size_t chain);
+    void endChain(size_t chain);
+    void finish(int result);
+    bool isConstant(int reg, Variant::Type type) const;
+
+    bool run(const LineParser& line);
+    bool run(const LineBatch::Row& line);
+    size_t runBatch(const LineBatch& batch,
+                    size_t start,
+                    std::vector<unsigned char>& matches);
+    void setProfiling(bool profiling);
+    bool reorder(TermOrders& orders);
+    bool reordered() const;
+    Variant::Type resultType() const;
+    Number numberResult() const;
+    bool booleanResult() const;
+    const char* stringResult() const;
+    const std::string& errText() const;
+
+    size_t size() const;
+
+    static std::string operandError(Operand operand,
+                                    int pos,
+                                    Variant::Type expected,
+                                    Variant::Type actual);
+
+private:
+    Program(const Program& other);
+    Program& operator=(const Program& other);
+
+    /**
+     * @brief A single instruction.
+     */
+    typedef struct Instruction {
+        Opcode op;      ///< What to do
+        int dest;       ///< The register to write to
+        int a;          ///< The first operand
+        int b;          ///< The second operand
+        int pos;        ///< The position of the operator in the expression
+        Operand left;   ///< How a first operand of the wrong type is reported
+        size_t target;  ///< Where to jump to, for jumps
+    } Instruction;
+
+    /**
+     * @brief A register, holding the result of one node of the parse tree.
+     */
+    typedef struct Register {
+        Variant::Type type;  ///< The type of value in the register
+        Number number;       ///< The value, if it is a number (of either
+                             ///< kind, see Number)
+        bool boolean;        ///< The value, if it is a boolean
+        const char* string;  ///< The value, if it is a string
+    } Register;
+
+    /**
+     * @brief A chain of '&&' or '||', compiled as a list of terms.
+     */
+    typedef struct Chain {
+        int id;                    ///< The position of the operator
+        bool isAnd;                ///< Is it '&&', rather than '||'?
+        std::vector<bool> canFail; ///< Whether each term can fail, by its
+                                   ///< original index
+        std::vector<int> order;    ///< The original index of the term in
+                                   ///< each place
+        std::vector<size_t> starts; ///< The first instruction of the term in
+                                    ///< each place, followed by the end of
+                                    ///< the chain
+    } Chain;
+
+    template <typename Line>
+    bool step(const Line& line, Register* regs, size_t& ip);
+    template <typename Line>
+    bool runLine(const Line& line);
+    void joinWaiting(size_t ip, size_t failed);
+    void handOn(size_t ip, size_t failed);
+    void profile(size_t ip, std::chrono::steady_clock::time_point begin);
+    std::vector<int> bestOrder(const Chain& chain) const;
+    bool expect(const Register* regs,
+                const Instruction& in,
+                Variant::Type type);
+    template <typename Line, typename Compare>
+    bool fieldNumber(const Line& line,
+                     Register* regs,
+                     const Instruction& in,
+                     Compare compare);
+    template <typename Line, typename Compare>
+    bool fieldString(const Line& line,
+                     Register* regs,
+                     const Instruction& in,
+                     Compare compare);
+    template <typename Compare>
+    void batchFieldNumber(const LineBatch& batch,
+                          const Instruction& in,
+                          Compare compare,
+                          size_t& failed);
+    template <typename Compare>
+    void batchFieldString(const LineBatch& batch,
+                          const Instruction& in,
+                          Compare compare);
+    Register* batchRegisters(size_t row);
+    void setError(const Instruction& in,
+                  Operand operand,
+                  Variant::Type expected,
+                  Variant::Type actual);
+
+    std::vector<Instruction> code_;
+    std::vector<int> fieldLists_;
+    std::vector<Register> registers_;
+    std::vector<std::string> strings_;
+    std::vector<ValueSetRef> sets_;
+    int result_;
+    std::string error_;
+    TermOrders orders_;
+    std::vector<Chain> chains_;
+
+    // How many lines ran each instruction, how many of them left a true
+    // result (for the instructions that end the terms of a chain), and how
+    // long it took, while profiling
+    bool profiling_;
+    std::vector<uint64_t> runs_;
+    std::vector<uint64_t> trues_;
+    std::vector<std::chrono::steady_clock::duration> times_;
+
+    // Working space for Program::runBatch. Each line of the batch has its
+    // own copy of the registers, and the index of the next instruction it
+    // runs. The lines that run the current instruction are listed in
+    // active_, and the lines that have jumped ahead are listed by the
+    // instruction they jumped to.
+    std::vector<Register> batchRegisters_;
+    std::vector<size_t> next_;
+    std::vector<size_t> active_;
+    std::vector<std::vector<size_t> > waiting_;
+    std::vector<size_t> merged_;
+    std::vector<Number> numbers_;
+    std::vector<unsigned char> results_;
+};
+
+/**
+ * @brief Check the operands of an instruction.
+ *
+ * @param regs  The registers.
+ * @param in    The instruction.
+ * @param type  The type both operands should be.
+ *
+ * @return  true if they are that type, false otherwise (in which case error_
+ *          is set).
+ *
+ */
+inline bool Program::expect(const Register* regs,
+                            const Instruction& in,
+                            Variant::Type type) {
+    bool ok = true;
+    if (regs[in.a].type != type) {
+        setError(in, in.left, type, regs[in.a].type);
+        ok = false;
+    } else if (regs[in.b].type != type) {
+        setError(in, OPERAND_RIGHT, type, regs[in.b].type);
+        ok = false;
+    }
+    return ok;
+}
+
+/**
+ * @brief Compare a field with a constant number.
+ *
+ * This is instantiated once for each comparison, so the comparison itself is
+ * inlined.
+ *
+ * @param line     The current line, either a LineParser or a LineBatch::Row.
+ * @param regs     The registers.
+ * @param in       The instruction.
+ * @param compare  The comparison, e.g. std::less<double>.
+ *
+ * @return  true if the field is a number, false otherwise (in which case
+ *          error_ is set, as it would be by comparing registers).
+ *
+ */
+template <typename Line, typename Compare>
+inline bool Program::fieldNumber(const Line& line,
+                                 Register* regs,
+                                 const Instruction& in,
+                                 Compare compare) {
+    Number val;
+    bool ok = line.field(in.a).asNumber(val);
+    if (ok) {
+        regs[in.dest].type = Variant::BOOLEAN;
+        regs[in.dest].boolean = val.compare(regs[in.b].number, compare);
+    } else {
+        setError(in, in.left, Variant::NUMBER, Variant::STRING);
+    }
+    return ok;
+}
+
+/**
+ * @brief Compare a field with a constant string.
+ *
+ * @param line     The current line, either a LineParser or a LineBatch::Row.
+ * @param regs     The registers.
+ * @param in       The instruction.
+ * @param compare  How the result of strcmp is compared with 0, e.g.
+ *                 std::less<int>.
+ *
+ * @return  true, as any field can be a string.
+ *
+ */
+template <typename Line, typename Compare>
+inline bool Program::fieldString(const Line& line,
+                                 Register* regs,
+                                 const Instruction& in,
+                                 Compare compare) {
+    int cmp = strcmp(line.field(in.a).asString(), regs[in.b].string);
+    regs[in.dest].type = Variant::BOOLEAN;
+    regs[in.dest].boolean = compare(cmp, 0);
+    return true;
+}
+
+#endif // CSVFILTER_PROGRAM_H
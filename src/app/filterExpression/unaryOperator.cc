@@ -17,7 +17,10 @@
  * 
  */
 UnaryMinus::UnaryMinus(ConstLexTokenRef op, ParseTreeRef operand)
-    :op_(op), operand_(operand), result_(Variant::error("Uninitialised"))
+    :op_(op),
+     operand_(operand),
+     operandType_(NODE_TYPE_UNKNOWN),
+     result_(Variant::error("Uninitialised"))
 {
     assert(op->type() == LexToken::TYPE_MINUS);
 }
@@ -37,6 +40,7 @@ UnaryMinus::~UnaryMinus() {
  */
 UnaryMinus::NodeType UnaryMinus::validateTypes(ParseError& err) {
     NodeType result = operand_->validateTypes(err);
+    operandType_ = result;
     if (result != NODE_TYPE_ERROR) {
         if (result == NODE_TYPE_UNKNOWN) {
             if (!operand_->setType(NODE_TYPE_NUMBER, err)) {
@@ -74,14 +78,13 @@ VariantRef UnaryMinus::eval(const LineParser& line, NodeType typeHint) const {
     VariantRef ret = result_;
     if (val->type() == Variant::ERROR) {
         ret = val;
-    } else if (val->type() != Variant::NUMBER) {
-            std::stringstream msg;
-            msg << "The unary operator at " << op_->position().begin
-                << "expects arguments of type number (got "
-                << val->type() << ")";
-            ret = Variant::error(msg.str());
+    } else if (!val->isNumber()) {
+        ret = Variant::error(Program::operandError(Program::OPERAND_UNARY,
+                                                   op_->position().begin,
+                                                   Variant::NUMBER,
+                                                   val->type()));
     } else {
-        result_->resetToNumber(-val->numberVal());
+        result_->resetToNumber(val->asNumber().negate());
     }
     return ret;
 }
@@ -102,6 +105,82 @@ bool UnaryMinus::canBeNumber(const LineParser& line) const {
     return true;
 }
 
+/**
+ * @copydoc ParseTree::compile
+ */
+int UnaryMinus::compile(Program& program, NodeType typeHint) const {
+    int operand = operand_->compile(program, NODE_TYPE_NUMBER);
+    int ret = program.addRegister();
+    program.emit(Program::OP_NEGATE, ret, operand, -1, op_->position().begin);
+    return ret;
+}
+
+/**
+ * @copydoc ParseTree::numberFields
+ */
+bool UnaryMinus::numberFields(std::vector<int>& fields) const {
+    return true;
+}
+
 Range UnaryMinus::position() const {
     return Range(op_->position().begin, operand_->position().end);
 }
+
+/**
+ * @copydoc ParseTree::highestColumn
+ */
+int UnaryMinus::highestColumn() const {
+    return operand_->highestColumn();
+}
+
+/**
+ * @copydoc ParseTree::simplifyNode
+ *
+ * Constants are negated up front, and double negatives are removed when the
+ * inner operand is known to be a number (see UnaryMinus::negatedOperand).
+ */
+ParseTreeRef UnaryMinus::simplifyNode() {
+    operand_ = simplify(operand_);
+    ParseTreeRef ret = fold();
+    if (ret == nullptr) {
+        ret = operand_->negatedOperand();
+    }
+    return ret;
+}
+
+/**
+ * @copydoc ParseTree::negatedOperand
+ *
+ * An operand whose type was only known at run time, such as a field, is not
+ * returned, as this node is what checks that it is a number.
+ */
+ParseTreeRef UnaryMinus::negatedOperand() const {
+    ParseTreeRef ret;
+    if (operandType_ == NODE_TYPE_NUMBER) {
+        ret = operand_;
+    }
+    return ret;
+}
+
+/**
+ * @copydoc ParseTree::monotonicIn
+ */
+ParseTreeRef UnaryMinus::monotonicIn(int& direction) const {
+    direction = -1;
+    return operand_;
+}
+
+/**
+ * @copydoc ParseTree::apply
+ */
+Number UnaryMinus::apply(const Number& x) const {
+    return x.negate();
+}
+
+/**
+ * @copydoc ParseTree::monotonicOperand
+ */
+void UnaryMinus::monotonicOperand(Program::Operand& operand, int& pos) const {
+    operand = Program::OPERAND_UNARY;
+    pos = op_->position().begin;
+}
@@ -28,11 +28,20 @@ public:
     
     virtual void stream(std::ostream& out);
     virtual bool canBeNumber(const LineParser& line) const;
+    virtual int compile(Program& program, NodeType typeHint) const;
+    virtual bool numberFields(std::vector<int>& fields) const;
     virtual Range position() const;
+    virtual int highestColumn() const;
+    virtual ParseTreeRef simplifyNode();
+    virtual ParseTreeRef negatedOperand() const;
+    virtual ParseTreeRef monotonicIn(int& direction) const;
+    virtual Number apply(const Number& x) const;
+    virtual void monotonicOperand(Program::Operand& operand, int& pos) const;
 
 private:
     ConstLexTokenRef op_;
     ParseTreeRef operand_;
+    NodeType operandType_;
     VariantRef result_;
 };
 
@@ -0,0 +1,306 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#include "valueSet.h"
+#include "../numberParser.h"
+
+#include <fstream>
+#include <sstream>
+#include <math.h>
+#include <string.h>
+
+/**
+ * @brief The smallest hash table, in slots.
+ */
+static const size_t MIN_SLOTS = 16;
+
+/**
+ * @brief Constructor
+ *
+ * Create an empty set.
+ *
+ */
+ValueSet::ValueSet()
+    :numbers_(false),
+     position_(),
+     values_(),
+     keys_(),
+     slots_() {
+
+}
+
+/**
+ * @brief Add a string to the set.
+ *
+ * The set must be empty, or already hold strings.
+ *
+ * @param val  The string.
+ *
+ */
+void ValueSet::add(const std::string& val) {
+    if (!contains(val.c_str())) {
+        values_.push_back(val);
+        grow();
+        insert(hash(val.c_str()), values_.size() - 1);
+    }
+}
+
+/**
+ * @brief Add a number to the set.
+ *
+ * The set must be empty, or already hold numbers.
+ *
+ * @param val   The number.
+ * @param text  How the number was written, for ValueSet::text.
+ *
+ */
+void ValueSet::add(const Number& val, const std::string& text) {
+    numbers_ = true;
+    Key key;
+    // NaN is not equal to anything, so it is left out
+    if (makeKey(val, key) && !contains(val)) {
+        values_.push_back(text);
+        keys_.push_back(key);
+        grow();
+        insert(hash(key), values_.size() - 1);
+    }
+}
+
+/**
+ * @brief Add the values listed in a file.
+ *
+ * The file has one value on each line, and blank lines are ignored. If every
+ * value is a number (by the same rules as fields in the csv file, see
+ * NumberParser) then they are added as numbers, and otherwise they are added
+ * as strings. The set must be empty.
+ *
+ * @param path  The file.
+ * @param err   Set to a description of the problem, if the file could not be
+ *              read.
+ *
+ * @return  true if the values were added, false otherwise.
+ *
+ */
+bool ValueSet::readFile(const std::string& path, std::string& err) {
+    bool ok = true;
+    std::vector<std::string> lines;
+    std::ifstream in(path.c_str());
+    if (!in) {
+        ok = false;
+    } else {
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!line.empty() && line[line.size() - 1] == '\r') {
+                line.erase(line.size() - 1);
+            }
+            if (!line.empty()) {
+                lines.push_back(line);
+            }
+        }
+        ok = in.eof();
+    }
+
+    if (!ok) {
+        std::stringstream msg;
+        msg << "Could not read \"" << path << "\"";
+        err = msg.str();
+    } else if (lines.empty()) {
+        std::stringstream msg;
+        msg << "\"" << path << "\" does not contain any values";
+        err = msg.str();
+        ok = false;
+    } else {
+        std::vector<Number> numbers(lines.size());
+        bool allNumbers = true;
+        for (size_t i = 0; allNumbers && i < lines.size(); i++) {
+            allNumbers = NumberParser::toNumber(lines[i].c_str(),
+                                                lines[i].size(),
+                                                numbers[i]);
+        }
+        for (size_t i = 0; i < lines.size(); i++) {
+            if (allNumbers) {
+                add(numbers[i], lines[i]);
+            } else {
+                add(lines[i]);
+            }
+        }
+    }
+    return ok;
+}
+
+/**
+ * @brief Set where the set was written in the expression.
+ *
+ */
+void ValueSet::setPosition(Range position) {
+    position_ = position;
+}
+
+/**
+ * @brief Does the set hold numbers, rather than strings?
+ *
+ */
+bool ValueSet::numbers() const {
+    return numbers_;
+}
+
+/**
+ * @brief The number of different values in the set.
+ *
+ */
+size_t ValueSet::size() const {
+    return values_.size();
+}
+
+/**
+ * @brief One of the values, as it was written.
+ *
+ * @param i  The index of the value, in the order they were added (leaving out
+ *           repeats).
+ *
+ */
+const std::string& ValueSet::text(size_t i) const {
+    return values_[i];
+}
+
+/**
+ * @brief Where the set was written in the expression.
+ *
+ */
+Range ValueSet::position() const {
+    return position_;
+}
+
+/**
+ * @brief Is a string in the set?
+ *
+ * This can only be called on a set of strings.
+ *
+ */
+bool ValueSet::contains(const char* val) const {
+    bool ret = false;
+    if (!slots_.empty()) {
+        size_t mask = slots_.size() - 1;
+        for (size_t i = hash(val) & mask; !ret && slots_[i] != 0;
+             i = (i + 1) & mask) {
+            ret = (strcmp(values_[slots_[i] - 1].c_str(), val) == 0);
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Is a number in the set?
+ *
+ * This can only be called on a set of numbers.
+ *
+ */
+bool ValueSet::contains(const Number& val) const {
+    bool ret = false;
+    Key key;
+    if (!slots_.empty() && makeKey(val, key)) {
+        size_t mask = slots_.size() - 1;
+        for (size_t i = hash(key) & mask; !ret && slots_[i] != 0;
+             i = (i + 1) & mask) {
+            const Key& k = keys_[slots_[i] - 1];
+            ret = (k.integer == key.integer && k.bits == key.bits);
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Work out the key for a number.
+ *
+ * Doubles that are whole numbers in the range of an int64_t have the same key
+ * as that integer. Comparisons between an integer and a double are exact, so
+ * they can only be equal if the double is that whole number.
+ *
+ * @param val  The number.
+ * @param key  Set to the key.
+ *
+ * @return  false if the number is NaN, true otherwise.
+ *
+ */
+bool ValueSet::makeKey(const Number& val, Key& key) {
+    // 2^63
+    const double integerLimit = 9223372036854775808.0;
+
+    bool ret = true;
+    if (val.isInteger()) {
+        key.integer = true;
+        key.bits = static_cast<uint64_t>(val.integerVal());
+    } else {
+        double d = val.doubleVal();
+        if (d != d) {
+            ret = false;
+        } else if (d >= -integerLimit && d < integerLimit && floor(d) == d) {
+            // this includes -0.0, which is equal to 0
+            key.integer = true;
+            key.bits = static_cast<uint64_t>(static_cast<int64_t>(d));
+        } else {
+            key.integer = false;
+            memcpy(&key.bits, &d, sizeof(d));
+        }
+    }
+    return ret;
+}
+
+uint64_t ValueSet::hash(const Key& key) {
+    return mix(key.bits ^ key.integer);
+}
+
+uint64_t ValueSet::hash(const char* val) {
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for (const unsigned char* c = reinterpret_cast<const unsigned char*>(val);
+         *c != '\0'; c++) {
+        h = (h ^ *c) * 1099511628211ULL;
+    }
+    return mix(h);
+}
+
+/**
+ * @brief Spread the bits of a hash, so the low bits can be used as an index.
+ *
+ */
+uint64_t ValueSet::mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/**
+ * @brief Put a value into the hash table.
+ *
+ * @param h      The hash of the value.
+ * @param value  The index of the value.
+ *
+ */
+void ValueSet::insert(uint64_t h, size_t value) {
+    size_t mask = slots_.size() - 1;
+    size_t i = h & mask;
+    while (slots_[i] != 0) {
+        i = (i + 1) & mask;
+    }
+    slots_[i] = value + 1;
+}
+
+/**
+ * @brief Make room in the hash table for the last value.
+ *
+ * The table is kept at most half full, so that lookups only look at a few
+ * slots. When it grows the values that were already in it are put back.
+ *
+ */
+void ValueSet::grow() {
+    if (values_.size() * 2 > slots_.size()) {
+        size_t slots = slots_.empty() ? MIN_SLOTS : slots_.size() * 2;
+        slots_.assign(slots, 0);
+        for (size_t v = 0; v + 1 < values_.size(); v++) {
+            insert(numbers_ ? hash(keys_[v]) : hash(values_[v].c_str()), v);
+        }
+    }
+}
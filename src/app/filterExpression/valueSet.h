@@ -0,0 +1,82 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#ifndef CSVFILTER_VALUE_SET_H
+#define CSVFILTER_VALUE_SET_H
+
+#include "parseError.h"
+#include "../number.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+class ValueSet;
+
+/**
+ * @brief A reference to a set of values.
+ */
+typedef std::shared_ptr<const ValueSet> ValueSetRef;
+
+/**
+ * @brief The set of values on the right hand side of an 'in' operator.
+ *
+ * The values are either all strings or all numbers, depending on the first
+ * one that is added. They are kept in an open addressing hash table, so
+ * looking a value up takes the same time however many values there are.
+ *
+ * Numbers are looked up exactly as '==' compares them (see Number::compare),
+ * so the integer 3 and the double 3.0 are the same value, and NaN is not in
+ * any set.
+ *
+ */
+class ValueSet {
+public:
+    ValueSet();
+
+    void add(const std::string& val);
+    void add(const Number& val, const std::string& text);
+    bool readFile(const std::string& path, std::string& err);
+    void setPosition(Range position);
+
+    bool numbers() const;
+    size_t size() const;
+    const std::string& text(size_t i) const;
+    Range position() const;
+
+    bool contains(const char* val) const;
+    bool contains(const Number& val) const;
+
+private:
+    ValueSet(const ValueSet& other);
+    ValueSet& operator=(const ValueSet& other);
+
+    /**
+     * @brief A number, in a form where equal numbers have equal keys.
+     */
+    typedef struct Key {
+        bool integer;  ///< Is bits an int64_t, rather than a double?
+        uint64_t bits; ///< The value
+    } Key;
+
+    static bool makeKey(const Number& val, Key& key);
+    static uint64_t hash(const Key& key);
+    static uint64_t hash(const char* val);
+    static uint64_t mix(uint64_t h);
+    void insert(uint64_t h, size_t value);
+    void grow();
+
+    bool numbers_;
+    Range position_;
+    // the values as written, and (for numbers) their keys, in the order they
+    // were added
+    std::vector<std::string> values_;
+    std::vector<Key> keys_;
+    // the hash table, holding one more than the index of each value, or 0 for
+    // an empty slot
+    std::vector<uint32_t> slots_;
+};
+
+#endif // CSVFILTER_VALUE_SET_H
@@ -4,7 +4,6 @@
 
 #include "variant.h"
 
-#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
@@ -20,8 +19,9 @@
  *
  */
 Variant::Variant(Type t, const char* val)
-    :type_(t) {
-    val_.charVal_ = strdup(val);
+    :type_(t),
+     owned_() {
+    setOwned(val, strlen(val));
 }
 
 /**
@@ -32,7 +32,8 @@ Variant::Variant(Type t, const char* val)
  * @param val  The boolean value to store
  */
 Variant::Variant(bool val)
-    :type_(BOOLEAN) {
+    :type_(BOOLEAN),
+     owned_() {
     val_.boolVal_ = val;
 }
 
@@ -41,11 +42,12 @@ Variant::Variant(bool val)
  *
  * Constructor for number types
  *
- * @param val  The double value to store
+ * @param val  The number to store
  */
-Variant::Variant(double val)
-    :type_(NUMBER) {
-    val_.numberVal_ = val;
+Variant::Variant(const Number& val)
+    :type_(NUMBER),
+     owned_() {
+    resetToNumber(val);
 }
 
 /**
@@ -55,7 +57,7 @@ Variant::Variant(double val)
  *
  */
 Variant::~Variant() {
-    clear();
+
 }
 
 /**
@@ -68,11 +70,30 @@ Variant::~Variant() {
  *
  */
 void Variant::resetToNumber(double num) {
-    clear();
     type_ = NUMBER;
     val_.numberVal_ = num;
 }
 
+/**
+ * @brief Reset the variant to a number
+ *
+ * Change the value stored in this variant to a number, which will be an
+ * INTEGER if the number is an integer. This is a performance enhancement to
+ * avoid deleting and creating lots of variants.
+ *
+ * @param num  The new value
+ *
+ */
+void Variant::resetToNumber(const Number& num) {
+    if (num.isInteger()) {
+        type_ = INTEGER;
+        val_.integerVal_ = num.integerVal();
+    } else {
+        type_ = NUMBER;
+        val_.numberVal_ = num.doubleVal();
+    }
+}
+
 /**
  * @brief Reset the variant to a string
  *
@@ -83,9 +104,8 @@ void Variant::resetToNumber(double num) {
  *
  */
 void Variant::resetToString(const char* val) {
-    clear();
     type_ = STRING;
-    val_.charVal_ = strdup(val);
+    setOwned(val, strlen(val));
 }
 
 /**
@@ -98,9 +118,23 @@ void Variant::resetToString(const char* val) {
  *
  */
 void Variant::resetToString(const std::string& val) {
-    clear();
     type_ = STRING;
-    val_.charVal_ = strdup(val.c_str());
+    setOwned(val.c_str(), val.size());
+}
+
+/**
+ * @brief Reset the variant to a string owned by someone else
+ *
+ * Change the value stored in this variant to a string without copying it. The
+ * string must stay valid, and unchanged, for as long as the variant holds it.
+ * This is used to refer to fields of the current line.
+ *
+ * @param val  The new value
+ *
+ */
+void Variant::resetToStringView(const char* val) {
+    type_ = STRING;
+    val_.charVal_ = val;
 }
 
 /**
@@ -113,9 +147,8 @@ void Variant::resetToString(const std::string& val) {
  *
  */
 void Variant::resetToError(const std::string& err) {
-    clear();
     type_ = ERROR;
-    val_.charVal_ = strdup(err.c_str());
+    setOwned(err.c_str(), err.size());
 }
 
 /**
@@ -128,7 +161,6 @@ void Variant::resetToError(const std::string& err) {
  *
  */
 void Variant::resetToBoolean(bool b) {
-    clear();
     type_ = BOOLEAN;
     val_.boolVal_ = b;
 }
@@ -200,7 +232,21 @@ VariantRef Variant::error(const std::string& val) {
  *
  */ 
 VariantRef Variant::number(double val) {
-    return VariantRef(new Variant(val));
+    return VariantRef(new Variant(Number::real(val)));
+}
+
+/**
+ * @brief Create an integer
+ *
+ * Create a new variant containing an integer
+ *
+ * @param val  The integer to store.
+ *
+ * @return  A reference to the new variant
+ *
+ */ 
+VariantRef Variant::integer(int64_t val) {
+    return VariantRef(new Variant(Number::integer(val)));
 }
 
 /**
@@ -230,18 +276,59 @@ Variant::Type Variant::type() const {
 }
 
 
+/**
+ * @brief Is the variant a number?
+ *
+ * @return  true if the variant type is NUMBER or INTEGER
+ *
+ */
+bool Variant::isNumber() const {
+    return (type_ == NUMBER || type_ == INTEGER);
+}
+
 /**
  * @brief The number value
  *
- * The number value being stored by the variant. This can only be called if the
- * variant type is NUMBER
+ * The number value being stored by the variant, as a double. This can only be
+ * called if the variant type is NUMBER or INTEGER (in which case the integer
+ * is converted, so may be rounded).
  *
  * @return  The number being stored
  *
  */
 double Variant::numberVal() const {
-    assert(type_ == NUMBER);
-    return val_.numberVal_;
+    assert(isNumber());
+    return (type_ == INTEGER) ? static_cast<double>(val_.integerVal_)
+                              : val_.numberVal_;
+}
+
+/**
+ * @brief The integer value
+ *
+ * The integer value being stored by the variant. This can only be called if
+ * the variant type is INTEGER
+ *
+ * @return  The integer being stored
+ *
+ */
+int64_t Variant::integerVal() const {
+    assert(type_ == INTEGER);
+    return val_.integerVal_;
+}
+
+/**
+ * @brief The number value
+ *
+ * The number being stored by the variant, without rounding integers. This can
+ * only be called if the variant type is NUMBER or INTEGER.
+ *
+ * @return  The number being stored
+ *
+ */
+Number Variant::asNumber() const {
+    assert(isNumber());
+    return (type_ == INTEGER) ? Number::integer(val_.integerVal_)
+                              : Number::real(val_.numberVal_);
 }
 
 
@@ -274,10 +361,19 @@ const char* Variant::charVal() const {
     return val_.charVal_;
 }
 
-void Variant::clear() {
-    if (type_ == STRING || type_ == ERROR) {
-        free(val_.charVal_);
-    }
+/**
+ * @brief Copy a string into the variant's own buffer
+ *
+ * The buffer keeps its capacity between resets, so this only allocates when
+ * the variant is given a longer string than it has held before.
+ *
+ * @param val     The string to copy
+ * @param length  The length of val
+ *
+ */
+void Variant::setOwned(const char* val, size_t length) {
+    owned_.assign(val, length);
+    val_.charVal_ = owned_.c_str();
 }
 
 /**
@@ -299,6 +395,10 @@ std::ostream& operator<< (std::ostream &out, Variant::Type t)
     case Variant::NUMBER:
         label = "number";
         break;
+    case Variant::INTEGER:
+        // to users, integers are just numbers
+        label = "number";
+        break;
     case Variant::BOOLEAN:
         label = "boolean";
         break;
@@ -5,6 +5,8 @@
 #ifndef CSVFILTER_VARIANT_H
 #define CSVFILTER_VARIANT_H
 
+#include "../number.h"
+
 #include <string>
 #include <memory>
 
@@ -19,7 +21,15 @@ typedef std::shared_ptr<Variant> VariantRef;
  * supports an error type that is used when an expression cannot be evaluated.
  *
  * To create a Variant use the type-specific static methods Variant::string,
- * Variant::error, Variant::number and Variant::boolean.
+ * Variant::error, Variant::number, Variant::integer and Variant::boolean.
+ *
+ * Numbers are either doubles (NUMBER) or 64 bit integers (INTEGER), see
+ * Number. Both are numbers as far as the expression's types are concerned.
+ *
+ * Strings are either copied into a buffer owned by the variant, which is kept
+ * and reused when the variant is reset, or (with Variant::resetToStringView)
+ * point at storage owned by someone else, such as the current line. Resetting
+ * a variant therefore does not allocate once it has settled down.
  *
  */
 class Variant {
@@ -33,19 +43,25 @@ public:
      */
     typedef enum {
         NUMBER, /**< A number, which is stored as a double */
+        INTEGER, /**< A number, which is stored as a 64 bit integer */
         BOOLEAN, /**< A boolean */
         STRING, /**< A string */
         ERROR /**< An error message */
     } Type;
 
     Type type() const;
+    bool isNumber() const;
     double numberVal() const;
+    int64_t integerVal() const;
+    Number asNumber() const;
     bool booleanVal() const;
     const char* charVal() const;
 
     void resetToNumber(double num);
+    void resetToNumber(const Number& num);
     void resetToString(const char* val);
     void resetToString(const std::string& val);
+    void resetToStringView(const char* val);
     void resetToError(const std::string& err);
     void resetToBoolean(bool b);
     
@@ -54,20 +70,26 @@ public:
     static VariantRef error(const char* val);
     static VariantRef error(const std::string& val);
     static VariantRef number(double val);
+    static VariantRef integer(int64_t val);
     static VariantRef boolean(bool val);
     
 private:
     Variant(Type t, const char* val);
     Variant(bool val);
-    Variant(double val);
+    Variant(const Number& val);
+    Variant(const Variant& other);
+    Variant& operator=(const Variant& other);
+
+    void setOwned(const char* val, size_t length);
 
-    void clear();
     union {
         double numberVal_;
+        int64_t integerVal_;
         bool boolVal_;
-        char* charVal_; // strings cannot be used in unions
+        const char* charVal_; // either owned_ or someone else's storage
     } val_;
     Type type_;
+    std::string owned_;
 };
 
 std::ostream& operator<< (std::ostream &out, Variant::Type t);
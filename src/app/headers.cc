@@ -4,6 +4,7 @@
 
 #include "headers.h"
 
+#include <algorithm>
 #include <sstream>
 #include <iostream>
 #include <utility>
@@ -39,7 +40,7 @@ Headers::Headers(const LineParser& headerLine,
     std::list<std::pair<const std::string, int>> tokensToTransform;
 
     for (int i = 0; ok_ && i < headerLine.fieldCount(); i++) {
-        std::string h = headerLine.field(i)->asString();
+        std::string h = headerLine.field(i).asString();
         originalHeaders_.push_back(h);
         if (headerIndexes_.find(h) != headerIndexes_.end()) {
             tokensToTransform.push_back(std::make_pair(h, i));
@@ -166,6 +167,36 @@ int Headers::outColIdx(int inIdx) const {
     return ret;
 }
 
+/**
+ * @brief  The last input column used in the output
+ *
+ * @return  The highest index of an input column that is output, or -1 if there
+ *          are no output columns.
+ *
+ */
+int Headers::highestOutCol() const {
+    int ret = -1;
+    for (size_t i = 0; i < outCols_.size(); i++) {
+        ret = std::max(ret, outCols_[i]);
+    }
+    return ret;
+}
+
+/**
+ * @brief  Is every input column output, in its original order?
+ *
+ * @return  true if the output columns are the same as the input columns, in
+ *          which case lines can be output as they are.
+ *
+ */
+bool Headers::outputsAllCols() const {
+    bool ret = (outCols_.size() == originalHeaders_.size());
+    for (size_t i = 0; ret && i < outCols_.size(); i++) {
+        ret = (outCols_[i] == static_cast<int>(i));
+    }
+    return ret;
+}
+
 /**
  * @brief Make aliases for headers that are not valid in expressions
  * 
@@ -215,7 +246,7 @@ bool Headers::readOutputHeaders(
 
     bool valid = true;
     if (outputHeaders.size() == 0) {
-        for (int i = 0; i < headerIndexes_.size(); i++) {
+        for (int i = 0; i < originalHeaders_.size(); i++) {
             outCols_.push_back(i);
         }
     } else {
@@ -32,6 +32,8 @@ public:
 
     int outColCount() const;
     int outColIdx(int inIdx) const;
+    int highestOutCol() const;
+    bool outputsAllCols() const;
 private:
     Headers(const Headers& other);
     Headers& operator=(const Headers& other);
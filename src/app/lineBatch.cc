@@ -0,0 +1,208 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#include "lineBatch.h"
+
+#include <assert.h>
+#include <string.h>
+
+/**
+ * @brief The initial size of the arena, which is shared by all the lines in
+ *        the batch. It grows if it is not big enough.
+ */
+static const size_t ARENA_SIZE = 64 * 1024;
+
+/**
+ * @brief Constructor
+ *
+ * Create an empty batch, which keeps all the fields of each line. Call
+ * LineBatch::setFieldLimit to keep fewer.
+ *
+ */
+LineBatch::LineBatch()
+    :parser_(),
+     fieldLimit_(0),
+     size_(0),
+     lines_(CAPACITY),
+     lengths_(CAPACITY),
+     fieldCounts_(CAPACITY),
+     spans_(),
+     located_(CAPACITY),
+     nextField_(CAPACITY),
+     arena_(ARENA_SIZE) {
+
+}
+
+/**
+ * @brief Only keep the first few fields.
+ *
+ * Fields after the limit are still checked and counted, see
+ * LineParser::setFieldLimit. This must be set before any lines are added.
+ *
+ * @param limit  The number of fields that are needed.
+ *
+ */
+void LineBatch::setFieldLimit(int limit) {
+    fieldLimit_ = limit;
+    parser_.setFieldLimit(limit);
+    spans_.resize(limit * CAPACITY);
+}
+
+/**
+ * @brief Parse a line and add it to the batch.
+ *
+ * The batch must not be full.
+ *
+ * @param line    The line to add. This does not need to be terminated, and
+ *                must stay valid until the batch is cleared.
+ * @param length  The length of the line.
+ *
+ * @return  true if the line was added, false if it is not a valid line of
+ *          csv (in which case see LineBatch::errText).
+ *
+ */
+bool LineBatch::add(const char* line, size_t length) {
+    bool ok = true;
+    if (parser_.countFields(line, length)) {
+        // the fields are found when they are needed
+        located_[size_] = 0;
+        nextField_[size_] = 0;
+    } else {
+        // with no fields to keep there are no spans to put them in
+        FieldSpan* spans = (fieldLimit_ > 0) ? &spans_[size_] : nullptr;
+        ok = parser_.split(spans, CAPACITY);
+        located_[size_] = fieldLimit_;
+    }
+    if (ok) {
+        lines_[size_] = line;
+        lengths_[size_] = length;
+        fieldCounts_[size_] = parser_.fieldCount();
+        size_++;
+    }
+    return ok;
+}
+
+/**
+ * @brief Find a field in a line without quotes.
+ *
+ * The spans are filled in for the fields up to and including this one.
+ *
+ * @param idx  The field. This must be less than the number of fields in the
+ *             line, and than the limit set by LineBatch::setFieldLimit.
+ * @param row  The line.
+ *
+ */
+void LineBatch::locate(int idx, size_t row) const {
+    assert(idx < fieldLimit_ && static_cast<size_t>(idx) < fieldCounts_[row]);
+    const char* line = lines_[row];
+    size_t length = lengths_[row];
+    size_t start = nextField_[row];
+    for (int i = located_[row]; i <= idx; i++) {
+        const char* comma = static_cast<const char*>(
+            memchr(line + start, ',', length - start));
+        size_t end = (comma != nullptr) ? comma - line : length;
+        FieldSpan& span = spans_[i * CAPACITY + row];
+        span.offset = start;
+        span.length = end - start;
+        span.flags = 0;
+        span.number = Number();
+        span.value = nullptr;
+        start = end + 1;
+    }
+    located_[row] = idx + 1;
+    nextField_[row] = start;
+}
+
+/**
+ * @brief Remove the last line that was added.
+ *
+ */
+void LineBatch::removeLast() {
+    size_--;
+}
+
+/**
+ * @brief Remove all the lines.
+ *
+ * The fields of the lines, and any strings worked out from them, are no
+ * longer valid.
+ *
+ */
+void LineBatch::clear() {
+    size_ = 0;
+    arena_.reset();
+}
+
+/**
+ * @brief The number of lines in the batch.
+ *
+ */
+size_t LineBatch::size() const {
+    return size_;
+}
+
+/**
+ * @brief Is the batch full?
+ *
+ */
+bool LineBatch::full() const {
+    return (size_ == CAPACITY);
+}
+
+/**
+ * @brief A line in the batch, as it was added.
+ *
+ */
+const char* LineBatch::line(size_t row) const {
+    return lines_[row];
+}
+
+/**
+ * @brief The length of a line in the batch.
+ *
+ */
+size_t LineBatch::length(size_t row) const {
+    return lengths_[row];
+}
+
+/**
+ * @brief The number of fields in a line, including any after the limit.
+ *
+ */
+size_t LineBatch::fieldCount(size_t row) const {
+    return fieldCounts_[row];
+}
+
+/**
+ * @brief One of the lines in the batch.
+ *
+ * @param row  The index of the line.
+ *
+ * @return  A view of the line, which is valid until the batch is cleared.
+ *
+ */
+LineBatch::Row LineBatch::row(size_t row) const {
+    return Row(*this, row);
+}
+
+/**
+ * @brief  Scratch memory for the lines in the batch.
+ *
+ * Strings worked out while filtering the batch can be allocated from this.
+ * They are freed when the batch is cleared.
+ *
+ */
+Arena& LineBatch::arena() const {
+    return arena_;
+}
+
+/**
+ * @brief  Error description
+ *
+ * @return  Why the last line passed to LineBatch::add could not be parsed.
+ *
+ */
+const std::string& LineBatch::errText() const {
+    return parser_.errText();
+}
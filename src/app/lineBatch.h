@@ -0,0 +1,149 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#ifndef CSVFILTER_LINE_BATCH_H
+#define CSVFILTER_LINE_BATCH_H
+
+#include "lineParser.h"
+#include "field.h"
+#include "arena.h"
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+
+/**
+ * @brief A batch of parsed lines, stored by column.
+ *
+ * Filter expressions are evaluated a batch of lines at a time (see
+ * Program::runBatch), one instruction for every line before moving on to the
+ * next. To keep that working on neighbouring memory, the fields of the lines
+ * are stored column by column: all the spans for the first field, then all
+ * the spans for the second, and so on. As with LineParser, numbers and
+ * unescaped strings are only worked out from a field when they are first
+ * needed, and are then cached in its span.
+ *
+ * Lines without quotes are only checked and counted when they are added (see
+ * LineParser::countFields). Their fields are found when they are first used,
+ * so a field that the filter only looks at for a few of the lines is not
+ * split out of the others.
+ *
+ * The lines are not copied, so they must stay valid until the batch is
+ * cleared. Only the fields below the limit set by LineBatch::setFieldLimit
+ * are kept.
+ *
+ */
+class LineBatch {
+public:
+    /**
+     * @brief The most lines a batch holds.
+     */
+    static const size_t CAPACITY = 1024;
+
+    /**
+     * @brief One line from a batch.
+     *
+     * This gives access to the fields of a line in the same way as
+     * LineParser, so that code that works on one line can work on a line
+     * from a batch.
+     */
+    class Row {
+    public:
+        Row(const LineBatch& batch, size_t row);
+
+        Field field(int idx) const;
+        Arena& arena() const;
+    private:
+        const LineBatch* batch_;
+        size_t row_;
+    };
+
+    LineBatch();
+
+    void setFieldLimit(int limit);
+    bool add(const char* line, size_t length);
+    void removeLast();
+    void clear();
+
+    size_t size() const;
+    bool full() const;
+    const char* line(size_t row) const;
+    size_t length(size_t row) const;
+    size_t fieldCount(size_t row) const;
+    Field field(int idx, size_t row) const;
+    Row row(size_t row) const;
+    Arena& arena() const;
+
+    const std::string& errText() const;
+private:
+    LineBatch(const LineBatch& other);
+    LineBatch& operator=(const LineBatch& other);
+
+    void locate(int idx, size_t row) const;
+
+    LineParser parser_;
+    int fieldLimit_;
+    size_t size_;
+    std::vector<const char*> lines_;
+    std::vector<size_t> lengths_;
+    std::vector<size_t> fieldCounts_;
+    // Fields are found, and cache the values worked out from them, even when
+    // accessed through a const batch. For each line, the fields before
+    // located_ have spans, and the next one starts at nextField_.
+    mutable std::vector<FieldSpan> spans_;
+    mutable std::vector<int> located_;
+    mutable std::vector<size_t> nextField_;
+    mutable Arena arena_;
+};
+
+/**
+ * @brief  Access to fields from the batch
+ *
+ * @param idx  The index of the field. This must be less than the limit set by
+ *             LineBatch::setFieldLimit.
+ * @param row  The line the field is in.
+ *
+ * @return  The field
+ *
+ */
+inline Field LineBatch::field(int idx, size_t row) const {
+    if (idx >= located_[row]) {
+        locate(idx, row);
+    }
+    return Field(lines_[row], spans_[idx * CAPACITY + row], arena_);
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param batch  The batch the line is in.
+ * @param row    Which line of the batch it is.
+ *
+ */
+inline LineBatch::Row::Row(const LineBatch& batch, size_t row)
+    :batch_(&batch), row_(row) {
+
+}
+
+/**
+ * @brief  Access to fields from the line
+ *
+ * @see LineBatch::field
+ *
+ */
+inline Field LineBatch::Row::field(int idx) const {
+    return batch_->field(idx, row_);
+}
+
+/**
+ * @brief  Scratch memory for the line
+ *
+ * @see LineBatch::arena
+ *
+ */
+inline Arena& LineBatch::Row::arena() const {
+    return batch_->arena();
+}
+
+#endif // CSVFILTER_LINE_BATCH_H
@@ -0,0 +1,224 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#include "lineFilter.h"
+#include "filterExpression/variant.h"
+
+#include <algorithm>
+#include <sstream>
+#include <assert.h>
+#include <string.h>
+
+/**
+ * @brief Constructor
+ *
+ * @param headers             The headers from the input file. These must
+ *                            outlive this object.
+ * @param filter              The filter expression, or nullptr if every line
+ *                            should be output. A copy of this is taken, see
+ *                            Expression::clone.
+ * @param expectedFieldCount  The number of fields every line must have.
+ *
+ * Only the fields that are output or used by the filter are split out of
+ * each line.
+ *
+ */
+LineFilter::LineFilter(const Headers& headers,
+                       const Expression* filter,
+                       int expectedFieldCount)
+    :headers_(headers),
+     filter_(filter != nullptr ? filter->clone() : nullptr),
+     batch_(),
+     expectedFieldCount_(expectedFieldCount),
+     passThrough_(headers.outputsAllCols()),
+     lines_(),
+     added_(0),
+     failed_(false),
+     matches_(),
+     error_() {
+
+    // the parser can stop splitting fields after the last one we use. If the
+    // line is output as it is then none of them are needed for the output.
+    int highest = passThrough_ ? -1 : headers_.highestOutCol();
+    if (filter_) {
+        highest = std::max(highest, filter_->highestColumn());
+    }
+    batch_.setFieldLimit(highest + 1);
+}
+
+/**
+ * @brief Add a line to be filtered.
+ *
+ * The line is parsed and checked straight away, unless it cannot match (see
+ * LineFilter::cannotMatch), and is filtered by the next call to
+ * LineFilter::flush.
+ *
+ * @param line    The line to filter. This does not need to be terminated, and
+ *                must stay valid until the next call to LineFilter::flush.
+ * @param length  The length of the line.
+ *
+ * @return  true if more lines can be added, or false if LineFilter::flush must
+ *          be called first, either because the batch is full or because the
+ *          line could not be filtered.
+ *
+ */
+bool LineFilter::add(const char* line, size_t length) {
+    assert(!failed_ && !batch_.full());
+    if (cannotMatch(line, length)) {
+        // nothing to do
+    } else if (!batch_.add(line, length)) {
+        setError(false, batch_.errText());
+    } else if (batch_.fieldCount(batch_.size() - 1) != expectedFieldCount_) {
+        std::stringstream err;
+        err << "Incorrect number of entries. Expected "
+            << expectedFieldCount_ << ", got "
+            << batch_.fieldCount(batch_.size() - 1) << std::endl;
+        batch_.removeLast();
+        setError(true, err.str());
+    } else {
+        lines_.push_back(added_);
+    }
+    added_++;
+    return (!failed_ && !batch_.full());
+}
+
+/**
+ * @brief Filter the lines that have been added.
+ *
+ * The filter expression is evaluated for the lines added since the last
+ * flush, and the output columns of the ones that match are appended to out,
+ * each followed by a newline. If one of the lines could not be filtered then
+ * the output stops just before it.
+ *
+ * @param out  The output for the lines is appended to this.
+ *
+ * @return  true if the lines were all filtered, false if one could not be (in
+ *          which case see LineFilter::error).
+ *
+ */
+bool LineFilter::flush(std::string& out) {
+    size_t filtered = batch_.size();
+    if (filter_) {
+        filtered = filter_->evalBatch(batch_, matches_);
+        if (filtered < batch_.size()) {
+            std::stringstream err;
+            err << " Failed to evaluate filter expression ("
+                << filter_->evalErrText() << ")"
+                << std::endl;
+            setError(true, err.str());
+            error_.line = lines_[filtered];
+        }
+    }
+
+    for (size_t row = 0; row < filtered; row++) {
+        if (!filter_ || matches_[row]) {
+            writeLine(row, out);
+        }
+    }
+
+    bool ok = !failed_;
+    batch_.clear();
+    lines_.clear();
+    added_ = 0;
+    failed_ = false;
+    return ok;
+}
+
+/**
+ * @brief The reason the last line could not be filtered.
+ *
+ * @return  The error from the last call to LineFilter::flush that returned
+ *          false.
+ *
+ */
+const LineFilter::LineError& LineFilter::error() const {
+    return error_;
+}
+
+/**
+ * @brief Describe an error.
+ *
+ * @param err         The error, as returned by LineFilter::error.
+ * @param lineNumber  The line the error occurred on, counting from the first
+ *                    line after the headers.
+ *
+ * @return  A message describing the error.
+ *
+ */
+std::string LineFilter::errText(const LineError& err, int lineNumber) {
+    std::stringstream msg;
+    if (err.numbered) {
+        msg << "Line " << lineNumber << ": ";
+    }
+    msg << err.text;
+    return msg.str();
+}
+
+/**
+ * @brief Can a line be skipped without parsing it?
+ *
+ * A line without quotes cannot fail to parse, and the value of each field is
+ * exactly the text in the line. If it has the right number of fields but
+ * does not contain any of the text the filter expression needs, then it
+ * cannot match, and evaluating the expression for it cannot fail.
+ *
+ * @return  true if the line certainly does not match, false if it needs to be
+ *          parsed to find out.
+ *
+ */
+bool LineFilter::cannotMatch(const char* line, size_t length) const {
+    bool ret = (filter_ && !filter_->requiredText().empty() && length > 0);
+    if (ret) {
+        const std::vector<std::string>& needles = filter_->requiredText();
+        for (size_t i = 0; ret && i < needles.size(); i++) {
+            ret = (memmem(line, length,
+                          needles[i].data(), needles[i].size()) == nullptr);
+        }
+    }
+    if (ret) {
+        // a single pass with no early exit, so that it can be vectorised
+        size_t commas = 0;
+        size_t quotes = 0;
+        for (size_t i = 0; i < length; i++) {
+            commas += (line[i] == ',');
+            quotes += (line[i] == '"');
+        }
+        ret = (quotes == 0 && commas + 1 == expectedFieldCount_);
+    }
+    return ret;
+}
+
+/**
+ * @brief Output a line that matched.
+ *
+ * The line is copied as it is if every column is output, otherwise the output
+ * columns are formatted from the parsed fields.
+ *
+ * @param row  The line's row in the batch.
+ *
+ */
+void LineFilter::writeLine(size_t row, std::string& out) {
+    if (passThrough_) {
+        out.append(batch_.line(row), batch_.length(row));
+        out += '\n';
+    } else {
+        formatLine(batch_.row(row), headers_, out);
+    }
+}
+
+/**
+ * @brief Record why the line being added could not be filtered.
+ *
+ */
+void LineFilter::setError(bool numbered, const std::string& text) {
+    failed_ = true;
+    error_.numbered = numbered;
+    error_.text = text;
+    error_.line = added_;
+}
+
+LineFilter::LineError::LineError()
+    :numbered(false), text(""), line(0) {
+
+}
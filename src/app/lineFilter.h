@@ -0,0 +1,108 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#ifndef CSVFILTER_LINE_FILTER_H
+#define CSVFILTER_LINE_FILTER_H
+
+#include "lineParser.h"
+#include "lineBatch.h"
+#include "headers.h"
+#include "filterExpression/expression.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Filter the lines of a csv file.
+ *
+ * This class does the work for each line of the input file: it parses the
+ * line, checks that it has the right number of fields, evaluates the filter
+ * expression and, if the line matches, formats the output columns. When every
+ * column is output in its original order, the original line is output as it
+ * is rather than being put back together from its fields.
+ *
+ * Lines are filtered in batches. They are parsed as they are added (see
+ * LineFilter::add) into a LineBatch, and the filter expression is evaluated
+ * for the whole batch when it is flushed (see LineFilter::flush).
+ *
+ * If the filter expression can only match lines that contain certain text
+ * (see Expression::requiredText), lines without it are skipped before they
+ * are parsed, as long as they are simple enough to check cheaply.
+ *
+ * Each LineFilter has its own LineParser and its own copy of the filter
+ * expression, so separate LineFilters can be used on separate threads.
+ *
+ */
+class LineFilter {
+public:
+    /**
+     * @brief  Why a line could not be filtered.
+     */
+    typedef struct LineError {
+        LineError();
+
+        bool numbered;    ///< Should the message be prefixed by the line number
+        std::string text; ///< The error message
+        size_t line;      ///< Which of the lines added since the last flush
+                          ///< it was, counting from 0
+    } LineError;
+
+    LineFilter(const Headers& headers,
+               const Expression* filter,
+               int expectedFieldCount);
+
+    bool add(const char* line, size_t length);
+    bool flush(std::string& out);
+    const LineError& error() const;
+
+    static std::string errText(const LineError& err, int lineNumber);
+    template <typename Line>
+    static void formatLine(const Line& line,
+                           const Headers& headers,
+                           std::string& out);
+private:
+    LineFilter(const LineFilter& other);
+    LineFilter& operator=(const LineFilter& other);
+
+    bool cannotMatch(const char* line, size_t length) const;
+    void writeLine(size_t row, std::string& out);
+    void setError(bool numbered, const std::string& text);
+
+    const Headers& headers_;
+    std::unique_ptr<Expression> filter_;
+    LineBatch batch_;
+    size_t expectedFieldCount_;
+    bool passThrough_;
+    std::vector<size_t> lines_;
+    size_t added_;
+    bool failed_;
+    std::vector<unsigned char> matches_;
+    LineError error_;
+};
+
+/**
+ * @brief Format the output columns of a line.
+ *
+ * @param line     The parsed line, either a LineParser or a LineBatch::Row.
+ * @param headers  The headers, which give the columns to output.
+ * @param out      The columns are appended to this, followed by a newline.
+ *
+ */
+template <typename Line>
+void LineFilter::formatLine(const Line& line,
+                            const Headers& headers,
+                            std::string& out) {
+    for (int i = 0; i < headers.outColCount(); i++) {
+        int colIdx = headers.outColIdx(i);
+        if (i != 0) {
+            out += ',';
+        }
+        Field field = line.field(colIdx);
+        out.append(field.raw(), field.length());
+    }
+    out += '\n';
+}
+
+#endif // CSVFILTER_LINE_FILTER_H
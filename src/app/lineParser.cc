@@ -4,6 +4,14 @@
 
 #include "lineParser.h"
 
+#include <string.h>
+
+/**
+ * @brief The initial size of the arena. This is plenty for most lines, and
+ *        the arena grows if it is not.
+ */
+static const size_t ARENA_SIZE = 4096;
+
 /**
  * @brief Constructor
  *
@@ -12,65 +20,190 @@
  *
  */
 LineParser::LineParser()
-    :error_(""), fields_(), usedFields_(0) {
+    :index_(),
+     error_(""),
+     line_(nullptr),
+     length_(0),
+     fields_(),
+     arena_(ARENA_SIZE),
+     usedFields_(0),
+     fieldLimit_(-1) {
 
 }
 
 /**
  * @brief Parse a line into separate fields.
  *
- * Parse a line of csv. The buffer containing the line is modified in-place to
- * save copies, and the Field classes will refer directly to the buffer until
- * the next call to parse. However ownership is not retained - the calling code
- * (usually a FileReader) must delete (or reuse) the memory. The fields should
- * not be accessed after that happens.
+ * Parse a terminated line of csv.
+ *
+ * @see LineParser::parse(const char*, size_t)
  *
- * @param line  The line to parse. This line will be edited in-place.
+ * @param line  The line to parse.
  *
  * @return  true if the line is a valid line of csv, false otherwise (in which
  *          case see LineParser::errText)
  */
-bool LineParser::parse(char* line) {
-    bool ok = true;
-    error_ = "";
+bool LineParser::parse(const char* line) {
+    return parse(line, strlen(line));
+}
 
-    // Note that we manually keep track of how many fields we've parsed out of
-    // the line and reuse the field entries in fields_. This is purely a
-    // performance optimisation - clearing the array and deleting all the field
-    // objects is actually quite expensive.
+/**
+ * @brief Parse a line into separate fields.
+ *
+ * Parse a line of csv. The line is not modified or copied, and the Fields will
+ * refer directly to it until the next call to parse, so the original record
+ * is still intact once it has been parsed. However ownership is not retained
+ * - the calling code (usually a FileReader) must delete (or reuse) the memory.
+ * The fields should not be accessed after that happens.
+ *
+ * @param line    The line to parse. This does not need to be terminated.
+ * @param length  The length of the line.
+ *
+ * @return  true if the line is a valid line of csv, false otherwise (in which
+ *          case see LineParser::errText)
+ */
+bool LineParser::parse(const char* line, size_t length) {
+    return parse(line, length, nullptr, 0);
+}
+
+/**
+ * @brief Parse a line into an array of spans.
+ *
+ * Parse a line of csv as LineParser::parse(const char*, size_t) does, but put
+ * the spans for the fields into an array owned by the caller rather than
+ * keeping them in the parser, so LineParser::field cannot be used afterwards.
+ * This lets a LineBatch parse lines straight into its columns.
+ *
+ * @param line    The line to parse. This does not need to be terminated.
+ * @param length  The length of the line.
+ * @param spans   Where to put the span for the first field, or nullptr to
+ *                keep the spans in the parser. There must be room for as many
+ *                fields as the limit set by LineParser::setFieldLimit.
+ * @param stride  The distance between the spans for consecutive fields.
+ *
+ * @return  true if the line is a valid line of csv, false otherwise (in which
+ *          case see LineParser::errText)
+ */
+bool LineParser::parse(const char* line,
+                       size_t length,
+                       FieldSpan* spans,
+                       size_t stride) {
+    start(line, length);
+    return split(spans, stride);
+}
+
+/**
+ * @brief Count the fields in a line, without splitting them out.
+ *
+ * A line without any quotes is always valid, and its fields are exactly the
+ * text between the commas, so they can be found later by whoever needs them.
+ * This counts the fields of such a line (see LineParser::fieldCount), which
+ * only needs the structural index. A line that has quotes must be split
+ * with LineParser::split to check it.
+ *
+ * @param line    The line. This does not need to be terminated.
+ * @param length  The length of the line.
+ *
+ * @return  true if the line has no quotes and its fields were counted, false
+ *          if it needs to be split.
+ *
+ */
+bool LineParser::countFields(const char* line, size_t length) {
+    start(line, length);
+    bool ret = (length == 0 || index_.nextQuote(0) == length);
+    if (ret && length > 0) {
+        usedFields_ = 1 + index_.countCommas(0);
+    }
+    return ret;
+}
+
+/**
+ * @brief Split the line passed to LineParser::countFields into fields.
+ *
+ * @param spans   As for LineParser::parse(const char*, size_t, FieldSpan*,
+ *                size_t).
+ * @param stride  The distance between the spans for consecutive fields.
+ *
+ * @return  true if the line is a valid line of csv, false otherwise (in which
+ *          case see LineParser::errText)
+ *
+ */
+bool LineParser::split(FieldSpan* spans, size_t stride) {
+    bool ok = true;
+    const char* line = line_;
+    size_t length = length_;
     usedFields_ = 0;
 
-    char* pos = line;
-    char* startOfField = pos;
+    size_t startOfField = 0;
 
-    if (*line) {
+    if (length > 0) {
         bool more = true;
+        if (fieldLimit_ == 0 && index_.nextQuote(0) == length) {
+            // none of the fields are needed, and they cannot be quoted
+            usedFields_ = 1 + index_.countCommas(0);
+            more = false;
+        }
         while (ok && more) {
+            size_t end = length;
 
-            pos = endOfField(pos);
-
-            if (pos == nullptr) {
+            if (!endOfField(line, startOfField, length, end)) {
                 ok = false;
-            } else if (*pos) {
-                *pos = '\0';
-                pos++;
-            } else {
+            } else if (end >= length) {
                 more = false;
             }
-        
-            if (usedFields_ < fields_.size()) {
-                fields_[usedFields_]->reset(startOfField);
+
+
+            if (fieldLimit_ >= 0 && usedFields_ >= fieldLimit_) {
+                // past the fields we need, so just count it
             } else {
-                fields_.push_back(FieldRef(new Field(startOfField)));
+                FieldSpan* target = nullptr;
+                if (spans != nullptr) {
+                    target = &spans[usedFields_ * stride];
+                } else {
+                    if (usedFields_ == fields_.size()) {
+                        fields_.push_back(FieldSpan());
+                    }
+                    target = &fields_[usedFields_];
+                }
+                FieldSpan& span = *target;
+                span.offset = startOfField;
+                span.length = end - startOfField;
+                span.flags = (startOfField < length &&
+                              line[startOfField] == '"') ? FieldSpan::QUOTED
+                                                         : 0;
+                span.number = Number();
+                span.value = nullptr;
             }
             usedFields_++;
-            startOfField = pos;
+            startOfField = end + 1;
+
+            if (ok && more && usedFields_ == fieldLimit_ &&
+                index_.nextQuote(startOfField) == length) {
+                // there are no quoted fields left, so every remaining comma
+                // starts another field
+                usedFields_ += 1 + index_.countCommas(startOfField);
+                more = false;
+            }
         }
     }
 
     return ok;
 }
 
+/**
+ * @brief Only split out the first few fields.
+ *
+ * Fields after the limit are checked and included in LineParser::fieldCount,
+ * but cannot be accessed with LineParser::field. When none of them are quoted
+ * they are counted straight from the structural index.
+ *
+ * @param limit  The number of fields that are needed, or -1 for all of them.
+ *
+ */
+void LineParser::setFieldLimit(int limit) {
+    fieldLimit_ = limit;
+}
+
 /**
  * @brief  Error description
  *
@@ -98,52 +231,93 @@ size_t LineParser::fieldCount() const {
  *
  * Gets a field from the last line that was parsed.
  *
- * @param idx  The index of the field you want
+ * @param idx  The index of the field you want. This must be less than the
+ *             limit set by LineParser::setFieldLimit, if there is one.
  *
  * @return  The field at that index
  *
  */
-FieldRef LineParser::field(int idx) const {
-    return fields_[idx];
+Field LineParser::field(int idx) const {
+    return Field(line_, fields_[idx], arena_);
 }
 
+/**
+ * @brief  Scratch memory for the current line.
+ *
+ * Strings worked out while filtering the line can be allocated from this. They
+ * are freed when the next line is parsed.
+ *
+ * @return  The arena for the current line.
+ *
+ */
+Arena& LineParser::arena() const {
+    return arena_;
+}
 
 
-char* LineParser::endOfField(char* pos) {
-    char* ret = pos;
+/**
+ * @brief  Start on a new line.
+ *
+ * Forget the last line, and build the structural index for this one.
+ *
+ */
+void LineParser::start(const char* line, size_t length) {
+    error_ = "";
+
+    // Note that we manually keep track of how many fields we've parsed out of
+    // the line and reuse the entries in fields_, so that the memory they use
+    // is kept from line to line. Everything in the arena was for the last line.
+    usedFields_ = 0;
+    line_ = line;
+    length_ = length;
+    arena_.reset();
 
-    if (*ret == '"') {
+    if (length > 0) {
+        index_.build(line, length);
+    }
+}
+
+/**
+ * @brief  Find the end of a field
+ *
+ * @param line    The line being parsed.
+ * @param pos     The start of the field.
+ * @param length  The length of the line.
+ * @param end     Set to the position of the comma after the field, or the
+ *                length of the line if it is the last field.
+ *
+ * @return  false if the field is not valid (in which case error_ is set), true
+ *          otherwise.
+ *
+ */
+bool LineParser::endOfField(const char* line,
+                            size_t pos,
+                            size_t length,
+                            size_t& end) {
+    bool ok = true;
+
+    if (pos < length && line[pos] == '"') {
         // quoted field
-        bool keepGoing = true;
-
-        while (*ret && keepGoing) {
-            ret++;
-            if (*ret == '"') {
-                if (*(ret + 1) == '"') {
-                    // double quote is a escaped quote
-                    ret++;
-                } else {
-                    keepGoing = false;
-                }
-            }
+        size_t quote = index_.nextQuote(pos + 1);
+        while (quote + 1 < length && line[quote + 1] == '"') {
+            // double quote is a escaped quote
+            quote = index_.nextQuote(quote + 2);
         }
 
-        if (*ret == '\0') {
+        if (quote >= length) {
             error_ = "Unterminated string field";
-            ret = nullptr;
+            ok = false;
         } else {
-            // we're pointing to the closing quote
-            ret++;
-            if (*ret != ',' && *ret != '\0') {
-                ret = nullptr;
+            // the closing quote must be the end of the field
+            end = quote + 1;
+            if (end < length && line[end] != ',') {
                 error_ = "Unexpected characters after string field";
+                ok = false;
             }
         }
     } else {
         // unquoted field
-        while (*ret && *ret != ',') {
-            ret++;
-        }
+        end = index_.nextComma(pos);
     }
-    return ret;
+    return ok;
 }
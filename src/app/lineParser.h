@@ -6,6 +6,7 @@
 #define CSVFILTER_LINEPARSER_H
 
 #include "field.h"
+#include "structuralIndex.h"
 
 #include <vector>
 #include <string>
@@ -16,28 +17,58 @@
  * This class provides methods to parse a line of csv into individual fields,
  * and has full support for quoted fields.
  *
+ * The commas and quotes in the line are found up front with a StructuralIndex,
+ * so the fields are split out without looking at every character.
+ *
  * Once the line is parsed (using LineParser::parse) you can access the
- * individual fields by using LineParser::fieldCount and LineParser::field.
+ * individual fields by using LineParser::fieldCount and LineParser::field. The
+ * parsed line is held as a flat array of FieldSpans, and LineParser::field
+ * returns a view of one of them.
+ *
+ * Strings worked out from the line, such as unescaped fields, are stored in an
+ * Arena that is reset when the next line is parsed (see LineParser::arena).
+ *
+ * If only the first few fields are needed, LineParser::setFieldLimit stops the
+ * parser from splitting out the rest. They are still checked and counted.
+ * Lines without quotes can be counted without splitting out any fields at
+ * all (see LineParser::countFields).
  *
  */
 class LineParser {
 public:
     LineParser();
-    bool parse(char*);
+    bool parse(const char* line);
+    bool parse(const char* line, size_t length);
+    bool parse(const char* line,
+               size_t length,
+               FieldSpan* spans,
+               size_t stride);
+    bool countFields(const char* line, size_t length);
+    bool split(FieldSpan* spans, size_t stride);
+    void setFieldLimit(int limit);
 
     size_t fieldCount() const;
-    FieldRef field(int idx) const;
+    Field field(int idx) const;
+    Arena& arena() const;
 
     const std::string& errText() const;
 private:
     LineParser(const LineParser& other);
     LineParser& operator=(const LineParser& other);
 
-    char* endOfField(char* pos);
+    void start(const char* line, size_t length);
+    bool endOfField(const char* line, size_t pos, size_t length, size_t& end);
 
+    StructuralIndex index_;
     std::string error_;
-    std::vector<FieldRef> fields_;
+    const char* line_;
+    size_t length_;
+    // Fields cache the values worked out from them, even when accessed
+    // through a const parser
+    mutable std::vector<FieldSpan> fields_;
+    mutable Arena arena_;
     int usedFields_;
+    int fieldLimit_;
 };
 
 
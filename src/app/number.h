@@ -0,0 +1,266 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#ifndef CSVFILTER_NUMBER_H
+#define CSVFILTER_NUMBER_H
+
+#include <stdint.h>
+
+/**
+ * @brief A number, which is either a 64 bit integer or a double.
+ *
+ * Numbers written without a decimal point or an exponent are kept as
+ * integers, so that values above 2^53 (such as ids and timestamps in
+ * nanoseconds) are not rounded, and comparing them does not need any floating
+ * point.
+ *
+ * Integers stay integers when they are negated, added, subtracted or
+ * multiplied, unless the result overflows or is negative zero (which only a
+ * double can hold, and which matters when it is divided by). Division, and any
+ * arithmetic involving a double, is done with doubles. Comparisons are always exact,
+ * even between an integer and a double.
+ *
+ */
+class Number {
+public:
+    Number();
+
+    static Number integer(int64_t val);
+    static Number real(double val);
+
+    bool isInteger() const;
+    int64_t integerVal() const;
+    double doubleVal() const;
+
+    Number negate() const;
+    Number add(const Number& other) const;
+    Number subtract(const Number& other) const;
+    Number multiply(const Number& other) const;
+    Number divide(const Number& other) const;
+
+    template <typename Compare>
+    bool compare(const Number& other, Compare compare) const;
+
+private:
+    double order(const Number& other) const;
+    static double order(int64_t i, double d);
+
+    bool isInteger_;
+    union {
+        int64_t integer_;
+        double real_;
+    } val_;
+};
+
+/**
+ * @brief Constructor
+ *
+ * The integer zero.
+ *
+ */
+inline Number::Number()
+    :isInteger_(true) {
+    val_.integer_ = 0;
+}
+
+/**
+ * @brief Create an integer
+ *
+ */
+inline Number Number::integer(int64_t val) {
+    Number ret;
+    ret.val_.integer_ = val;
+    return ret;
+}
+
+/**
+ * @brief Create a double
+ *
+ */
+inline Number Number::real(double val) {
+    Number ret;
+    ret.isInteger_ = false;
+    ret.val_.real_ = val;
+    return ret;
+}
+
+/**
+ * @brief Is the number an integer?
+ *
+ */
+inline bool Number::isInteger() const {
+    return isInteger_;
+}
+
+/**
+ * @brief The integer value
+ *
+ * This can only be called if Number::isInteger is true.
+ *
+ */
+inline int64_t Number::integerVal() const {
+    return val_.integer_;
+}
+
+/**
+ * @brief The value as a double
+ *
+ * Integers are converted, so may be rounded.
+ *
+ */
+inline double Number::doubleVal() const {
+    return isInteger_ ? static_cast<double>(val_.integer_) : val_.real_;
+}
+
+/**
+ * @brief Minus this number
+ *
+ */
+inline Number Number::negate() const {
+    Number ret;
+    if (!isInteger_ || val_.integer_ == INT64_MIN || val_.integer_ == 0) {
+        ret = real(-doubleVal());
+    } else {
+        ret = integer(-val_.integer_);
+    }
+    return ret;
+}
+
+/**
+ * @brief This number plus another
+ *
+ */
+inline Number Number::add(const Number& other) const {
+    int64_t sum = 0;
+    Number ret;
+    if (isInteger_ && other.isInteger_ &&
+        !__builtin_add_overflow(val_.integer_, other.val_.integer_, &sum)) {
+        ret = integer(sum);
+    } else {
+        ret = real(doubleVal() + other.doubleVal());
+    }
+    return ret;
+}
+
+/**
+ * @brief This number minus another
+ *
+ */
+inline Number Number::subtract(const Number& other) const {
+    int64_t difference = 0;
+    Number ret;
+    if (isInteger_ && other.isInteger_ &&
+        !__builtin_sub_overflow(val_.integer_, other.val_.integer_,
+                                &difference)) {
+        ret = integer(difference);
+    } else {
+        ret = real(doubleVal() - other.doubleVal());
+    }
+    return ret;
+}
+
+/**
+ * @brief This number times another
+ *
+ */
+inline Number Number::multiply(const Number& other) const {
+    int64_t product = 0;
+    Number ret;
+    if (isInteger_ && other.isInteger_ &&
+        !__builtin_mul_overflow(val_.integer_, other.val_.integer_,
+                                &product) &&
+        (product != 0 || (val_.integer_ < 0) == (other.val_.integer_ < 0))) {
+        ret = integer(product);
+    } else {
+        ret = real(doubleVal() * other.doubleVal());
+    }
+    return ret;
+}
+
+/**
+ * @brief This number divided by another
+ *
+ * The result is always a double, even if the integers divide exactly.
+ *
+ */
+inline Number Number::divide(const Number& other) const {
+    return real(doubleVal() / other.doubleVal());
+}
+
+/**
+ * @brief Compare this number with another
+ *
+ * This is instantiated once for each comparison, so the comparison itself is
+ * inlined.
+ *
+ * @param other    The number to compare with.
+ * @param compare  The comparison, e.g. std::less<double>.
+ *
+ * @return  The result of the comparison, which is exact even if the numbers
+ *          cannot be represented as doubles.
+ *
+ */
+template <typename Compare>
+inline bool Number::compare(const Number& other, Compare compare) const {
+    bool ret = false;
+    if (!isInteger_ && !other.isInteger_) {
+        ret = compare(val_.real_, other.val_.real_);
+    } else {
+        ret = compare(order(other), 0.0);
+    }
+    return ret;
+}
+
+/**
+ * @brief Compare this number with another, when at least one is an integer.
+ *
+ * @return  -1, 0 or 1 if this number is less than, equal to or greater than
+ *          the other, or NaN if the other is NaN (so comparing the result
+ *          with 0 behaves like comparing with NaN).
+ *
+ */
+inline double Number::order(const Number& other) const {
+    double ret = 0.0;
+    if (!isInteger_) {
+        ret = -order(other.val_.integer_, val_.real_);
+    } else if (!other.isInteger_) {
+        ret = order(val_.integer_, other.val_.real_);
+    } else {
+        ret = (val_.integer_ > other.val_.integer_) -
+              (val_.integer_ < other.val_.integer_);
+    }
+    return ret;
+}
+
+/**
+ * @brief Compare an integer with a double.
+ *
+ * @copydetails Number::order(const Number&) const
+ *
+ */
+inline double Number::order(int64_t i, double d) {
+    // 2^53, above which every double is an integer, and 2^63
+    const double exactLimit = 9007199254740992.0;
+    const double integerLimit = 9223372036854775808.0;
+
+    double ret = 0.0;
+    if (d != d) {
+        ret = d;
+    } else if (d >= integerLimit) {
+        ret = -1.0;
+    } else if (d < -integerLimit) {
+        ret = 1.0;
+    } else if (d >= exactLimit || d <= -exactLimit) {
+        // d is a whole number that fits in an int64_t
+        int64_t e = static_cast<int64_t>(d);
+        ret = (i > e) - (i < e);
+    } else {
+        // either i converts exactly, or it is further from zero than d is
+        double di = static_cast<double>(i);
+        ret = (di > d) - (di < d);
+    }
+    return ret;
+}
+
+#endif // CSVFILTER_NUMBER_H
@@ -0,0 +1,225 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#include "numberParser.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * @brief The powers of ten that are exactly representable as doubles.
+ */
+static const double POWERS_OF_TEN[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ * @brief The highest power of ten in POWERS_OF_TEN.
+ */
+static const int MAX_EXACT_POWER = 22;
+
+/**
+ * @brief Integers up to this are exactly representable as doubles.
+ */
+static const uint64_t MAX_EXACT_INTEGER = 1ULL << 53;
+
+/**
+ * @brief The most significant digits that always fit in a uint64_t.
+ */
+static const int MAX_DIGITS = 19;
+
+/**
+ * @brief Exponents past this are left to strtod, and cannot overflow an int.
+ */
+static const int MAX_EXPONENT = 100000;
+
+static bool isDigit(char c) {
+    return (c >= '0' && c <= '9');
+}
+
+/**
+ * @brief Try to convert a string to a number.
+ *
+ * @param str     The string. This does not need to be terminated.
+ * @param length  The length of the string.
+ * @param val     Set to the number, if the string is one. This is an
+ *                integer if the string is one that fits in an int64_t.
+ *
+ * @return  NUMBER if the string was converted, NOT_NUMBER if strtod would not
+ *          convert all of it, or USE_STRTOD if it could not be worked out
+ *          here.
+ *
+ */
+NumberParser::Result NumberParser::parse(const char* str,
+                                         size_t length,
+                                         Number& val) {
+    if (length == 0) {
+        // strtod converts nothing, which is all of an empty string
+        val = Number();
+        return NUMBER;
+    }
+
+    // anything strtod could convert starts with one of these
+    char first = str[0];
+    if (!isDigit(first) && first != '-' && first != '+' && first != '.') {
+        bool maybe = (first == 'i' || first == 'I' ||
+                      first == 'n' || first == 'N' ||
+                      first == ' ' || (first >= '\t' && first <= '\r'));
+        return maybe ? USE_STRTOD : NOT_NUMBER;
+    }
+
+    size_t pos = 0;
+    bool negative = false;
+    if (first == '-' || first == '+') {
+        negative = (first == '-');
+        pos++;
+    }
+
+    // the significant digits, ignoring the decimal point
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool anyDigits = false;
+    bool isInteger = true;
+
+    while (pos < length && isDigit(str[pos])) {
+        anyDigits = true;
+        if (digits > 0 || str[pos] != '0') {
+            if (digits == MAX_DIGITS) {
+                return USE_STRTOD;
+            }
+            mantissa = mantissa * 10 + (str[pos] - '0');
+            digits++;
+        }
+        pos++;
+    }
+    if (pos < length && str[pos] == '.') {
+        isInteger = false;
+        pos++;
+        while (pos < length && isDigit(str[pos])) {
+            anyDigits = true;
+            if (digits > 0 || str[pos] != '0') {
+                if (digits == MAX_DIGITS) {
+                    return USE_STRTOD;
+                }
+                mantissa = mantissa * 10 + (str[pos] - '0');
+                digits++;
+            }
+            exponent--;
+            pos++;
+        }
+    }
+    if (!anyDigits) {
+        // a lone sign or point, or infinity or NaN
+        return USE_STRTOD;
+    }
+
+    if (pos < length && (str[pos] == 'e' || str[pos] == 'E')) {
+        isInteger = false;
+        pos++;
+        bool negativeExponent = false;
+        if (pos < length && (str[pos] == '-' || str[pos] == '+')) {
+            negativeExponent = (str[pos] == '-');
+            pos++;
+        }
+        if (pos == length || !isDigit(str[pos])) {
+            return USE_STRTOD;
+        }
+        int written = 0;
+        while (pos < length && isDigit(str[pos])) {
+            written = written * 10 + (str[pos] - '0');
+            if (written > MAX_EXPONENT) {
+                return USE_STRTOD;
+            }
+            pos++;
+        }
+        exponent += negativeExponent ? -written : written;
+    }
+
+    if (pos != length) {
+        // strtod would stop here too, unless this is a hex number
+        return (str[pos] == 'x' || str[pos] == 'X') ? USE_STRTOD : NOT_NUMBER;
+    }
+
+    if (isInteger && mantissa <= static_cast<uint64_t>(INT64_MAX) &&
+        !(negative && mantissa == 0)) {
+        int64_t integer = static_cast<int64_t>(mantissa);
+        val = Number::integer(negative ? -integer : integer);
+        return NUMBER;
+    }
+
+    double ret = 0.0;
+    if (mantissa == 0) {
+        ret = 0.0;
+    } else if (exponent == 0) {
+        // a single correctly rounded conversion
+        ret = static_cast<double>(mantissa);
+    } else if (mantissa > MAX_EXACT_INTEGER) {
+        return USE_STRTOD;
+    } else if (exponent > 0 && exponent <= MAX_EXACT_POWER) {
+        ret = static_cast<double>(mantissa) * POWERS_OF_TEN[exponent];
+    } else if (exponent < 0 && exponent >= -MAX_EXACT_POWER) {
+        ret = static_cast<double>(mantissa) / POWERS_OF_TEN[-exponent];
+    } else if (exponent > MAX_EXACT_POWER &&
+               exponent <= MAX_EXACT_POWER + 15 &&
+               mantissa <= MAX_EXACT_INTEGER /
+                   static_cast<uint64_t>(
+                       POWERS_OF_TEN[exponent - MAX_EXACT_POWER])) {
+        // move some of the exponent into the mantissa, which stays exact
+        mantissa *= static_cast<uint64_t>(
+            POWERS_OF_TEN[exponent - MAX_EXACT_POWER]);
+        ret = static_cast<double>(mantissa) * POWERS_OF_TEN[MAX_EXACT_POWER];
+    } else {
+        return USE_STRTOD;
+    }
+
+    val = Number::real(negative ? -ret : ret);
+    return NUMBER;
+}
+
+/**
+ * @brief Convert a string to a number.
+ *
+ * This gives the same result as checking that strtod converts the whole
+ * string, except that integers are not rounded.
+ *
+ * @param str     The string. This must be terminated at str[length], in case
+ *                strtod is needed.
+ * @param length  The length of the string.
+ * @param val     Set to the number, if the string is one.
+ *
+ * @return  true if the string is a number, false otherwise.
+ *
+ */
+bool NumberParser::toNumber(const char* str, size_t length, Number& val) {
+    Result result = parse(str, length, val);
+    if (result == USE_STRTOD) {
+        char* end = nullptr;
+        double converted = strtod(str, &end);
+        result = (end == str + length) ? NUMBER : NOT_NUMBER;
+        if (result == NUMBER) {
+            val = Number::real(converted);
+        }
+    }
+    return (result == NUMBER);
+}
+
+/**
+ * @brief Convert a string to a double.
+ *
+ * This gives exactly the same result as checking that strtod converts the
+ * whole string.
+ *
+ * @copydetails NumberParser::toNumber
+ *
+ */
+bool NumberParser::toDouble(const char* str, size_t length, double& val) {
+    Number number;
+    bool ret = toNumber(str, length, number);
+    if (ret) {
+        val = number.doubleVal();
+    }
+    return ret;
+}
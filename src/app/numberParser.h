@@ -0,0 +1,48 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#ifndef CSVFILTER_NUMBER_PARSER_H
+#define CSVFILTER_NUMBER_PARSER_H
+
+#include "number.h"
+
+#include <stddef.h>
+
+/**
+ * @brief Convert fields to numbers.
+ *
+ * A field is a number if strtod (in the C locale) converts the whole of it.
+ * That is slow, so plain decimal numbers with up to 19 significant digits,
+ * which is nearly all of the numbers in a typical csv file, are converted
+ * here instead, and give exactly the same double as strtod would.
+ *
+ * Integers that fit in an int64_t are converted to integer Numbers, without any
+ * floating point arithmetic. Other numbers use Clinger's fast path: when
+ * the digits and the power of ten are both exactly representable as doubles,
+ * a single multiplication or division gives the correctly rounded result.
+ *
+ * Anything else (long mantissas, large exponents, hex, infinity, NaN and
+ * leading whitespace) is left to strtod.
+ *
+ */
+class NumberParser {
+public:
+    /**
+     * @brief The result of NumberParser::parse.
+     */
+    typedef enum {
+        NUMBER,     /**< The string is a number, and has been converted */
+        NOT_NUMBER, /**< The string is definitely not a number */
+        USE_STRTOD  /**< The string must be checked with strtod */
+    } Result;
+
+    static Result parse(const char* str, size_t length, Number& val);
+    static bool toNumber(const char* str, size_t length, Number& val);
+    static bool toDouble(const char* str, size_t length, double& val);
+
+private:
+    NumberParser();
+};
+
+#endif // CSVFILTER_NUMBER_PARSER_H
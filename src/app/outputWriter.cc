@@ -0,0 +1,129 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#include "outputWriter.h"
+
+#include <sstream>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+/**
+ * @brief Constructor
+ *
+ * @param fd            The file descriptor to write to. This is not closed by
+ *                      this class.
+ * @param bufferSize    The size of the output buffer.
+ * @param lineBuffered  Should the output be written at the end of every call
+ *                      to OutputWriter::write?
+ *
+ */
+OutputWriter::OutputWriter(int fd, size_t bufferSize, bool lineBuffered)
+    :fd_(fd),
+     buffer_(bufferSize),
+     used_(0),
+     lineBuffered_(lineBuffered),
+     ok_(true),
+     errText_("") {
+
+}
+
+/**
+ * @brief Destructor
+ *
+ * Write out anything left in the buffer. Any error is lost at this point, so
+ * call OutputWriter::flush first if it matters.
+ *
+ */
+OutputWriter::~OutputWriter() {
+    flush();
+}
+
+/**
+ * @brief Write some output.
+ *
+ * @param data    The output to write.
+ * @param length  The number of bytes of output.
+ *
+ */
+void OutputWriter::write(const char* data, size_t length) {
+    if (used_ + length > buffer_.size()) {
+        flush();
+    }
+
+    if (length >= buffer_.size()) {
+        if (ok_) {
+            ok_ = writeAll(data, length);
+        }
+    } else {
+        memcpy(&buffer_[used_], data, length);
+        used_ += length;
+        if (lineBuffered_) {
+            flush();
+        }
+    }
+}
+
+/**
+ * @brief Write some output.
+ *
+ * @param data  The output to write.
+ *
+ */
+void OutputWriter::write(const std::string& data) {
+    write(data.data(), data.size());
+}
+
+/**
+ * @brief Write out everything in the buffer.
+ *
+ * @return  true if all the output so far has been written, false otherwise (in
+ *          which case see OutputWriter::errText).
+ *
+ */
+bool OutputWriter::flush() {
+    if (ok_ && used_ > 0) {
+        ok_ = writeAll(&buffer_[0], used_);
+    }
+    used_ = 0;
+    return ok_;
+}
+
+/**
+ * @brief Has all the output been written?
+ *
+ * @return  false if a write has failed, true otherwise.
+ *
+ */
+bool OutputWriter::ok() const {
+    return ok_;
+}
+
+/**
+ * @brief Error description
+ *
+ * @return  A description of the write that failed, if OutputWriter::ok
+ *          returns false, or a blank string otherwise.
+ *
+ */
+const std::string& OutputWriter::errText() const {
+    return errText_;
+}
+
+bool OutputWriter::writeAll(const char* data, size_t length) {
+    bool ok = true;
+    while (ok && length > 0) {
+        ssize_t count = ::write(fd_, data, length);
+        if (count >= 0) {
+            data += count;
+            length -= count;
+        } else if (errno != EINTR) {
+            std::stringstream msg;
+            msg << "Error writing output: " << strerror(errno);
+            errText_ = msg.str();
+            ok = false;
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,52 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#ifndef CSVFILTER_OUTPUT_WRITER_H
+#define CSVFILTER_OUTPUT_WRITER_H
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+
+/**
+ * @brief Buffered writer for the output.
+ *
+ * Output is copied into a large buffer, which is written to the file
+ * descriptor in one go when it fills up, rather than making a write call for
+ * every line. Writes larger than the buffer skip it and are written directly.
+ *
+ * When the output is line buffered the buffer is written out at the end of
+ * every call to OutputWriter::write, so that each line is seen as soon as it
+ * has been filtered. This is useful when the output is being watched.
+ *
+ * Once a write fails, further output is discarded. Check OutputWriter::ok
+ * after the last call to OutputWriter::flush.
+ *
+ */
+class OutputWriter {
+public:
+    OutputWriter(int fd, size_t bufferSize, bool lineBuffered);
+    ~OutputWriter();
+
+    void write(const char* data, size_t length);
+    void write(const std::string& data);
+    bool flush();
+
+    bool ok() const;
+    const std::string& errText() const;
+private:
+    OutputWriter(const OutputWriter& other);
+    OutputWriter& operator=(const OutputWriter& other);
+
+    bool writeAll(const char* data, size_t length);
+
+    int fd_;
+    std::vector<char> buffer_;
+    size_t used_;
+    bool lineBuffered_;
+    bool ok_;
+    std::string errText_;
+};
+
+#endif // CSVFILTER_OUTPUT_WRITER_H
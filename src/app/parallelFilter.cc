@@ -0,0 +1,494 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#include "parallelFilter.h"
+
+#include <algorithm>
+#include <string.h>
+
+/**
+ * @brief Constructor
+ *
+ * @param reader              The file to read. Any lines already read from it
+ *                            with FileReader::getLine are skipped.
+ * @param headers             The headers from the input file.
+ * @param filter              The filter expression, or nullptr if every line
+ *                            should be output.
+ * @param expectedFieldCount  The number of fields every line must have.
+ * @param workers             The number of worker threads.
+ * @param chunkSize           The amount of the file to give to a worker at a
+ *                            time.
+ * @param unordered           true to write the output for each chunk as soon
+ *                            as it is finished, rather than in input order.
+ *
+ */
+ParallelFilter::ParallelFilter(FileReader& reader,
+                               const Headers& headers,
+                               const Expression* filter,
+                               int expectedFieldCount,
+                               int workers,
+                               size_t chunkSize,
+                               bool unordered)
+    :reader_(reader),
+     chunkSize_(chunkSize),
+     maxChunks_(workers * 2),
+     unordered_(unordered),
+     out_(nullptr),
+     lineFilters_(),
+     workers_(),
+     chunks_(),
+     freeChunks_(),
+     inFlight_(),
+     queue_(),
+     lastResolved_(nullptr),
+     nextState_(RecordScanner::OUTSIDE_QUOTES),
+     stop_(false),
+     mutex_(),
+     queued_(),
+     finished_(),
+     outMutex_(),
+     chunkLines_(),
+     errText_("") {
+
+    for (int i = 0; i < workers; i++) {
+        lineFilters_.push_back(std::unique_ptr<LineFilter>(
+            new LineFilter(headers, filter, expectedFieldCount)));
+    }
+}
+
+/**
+ * @brief Destructor
+ *
+ */
+ParallelFilter::~ParallelFilter() {
+    stopWorkers();
+}
+
+/**
+ * @brief Filter the file.
+ *
+ * Filter the rest of the file, writing the output to out. This stops at the
+ * first line that cannot be filtered, having written the output for all the
+ * lines before it. If the output is unordered, output for lines after it may
+ * also have been written.
+ *
+ * Errors reading the file are not reported here - check FileReader::ok once
+ * this returns.
+ *
+ * @param out  The writer to write the output to.
+ *
+ * @return  true if all the lines were filtered, false otherwise (in which case
+ *          see ParallelFilter::errText).
+ *
+ */
+bool ParallelFilter::run(OutputWriter& out) {
+    out_ = &out;
+    for (size_t i = 0; i < lineFilters_.size(); i++) {
+        workers_.push_back(std::thread(&ParallelFilter::work, this,
+                                       lineFilters_[i].get()));
+    }
+
+    bool ok = true;
+    bool more = true;
+    while (ok && (more || !inFlight_.empty())) {
+        while (more && inFlight_.size() < maxChunks_) {
+            Chunk* chunk = readChunk();
+            if (chunk == nullptr) {
+                more = false;
+            } else {
+                std::lock_guard<std::mutex> lock(mutex_);
+                chunk->seq = chunkLines_.size();
+                chunkLines_.push_back(0);
+                inFlight_.push_back(chunk);
+                queueChunk(chunk);
+            }
+        }
+
+        Chunk* chunk = finishedChunk(more);
+        if (chunk != nullptr) {
+            if (!unordered_) {
+                writeChunk(chunk);
+            }
+            if (chunk->failed) {
+                ok = false;
+                stopWorkers();
+                setError(chunk);
+            }
+            freeChunks_.push_back(chunk);
+        }
+    }
+
+    stopWorkers();
+    return ok;
+}
+
+/**
+ * @brief Error description
+ *
+ * @return  A description of the line that could not be filtered, if
+ *          ParallelFilter::run returned false.
+ *
+ */
+const std::string& ParallelFilter::errText() const {
+    return errText_;
+}
+
+/**
+ * @brief Read the next chunk of the file.
+ *
+ * @return  The chunk, or nullptr at the end of the file.
+ *
+ */
+ParallelFilter::Chunk* ParallelFilter::readChunk() {
+    Chunk* chunk = nullptr;
+    if (!freeChunks_.empty()) {
+        chunk = freeChunks_.back();
+        freeChunks_.pop_back();
+    } else {
+        chunks_.push_back(std::unique_ptr<Chunk>(new Chunk()));
+        chunk = chunks_.back().get();
+    }
+
+    chunk->length = reader_.readChunk(chunk->data, chunkSize_);
+    if (chunk->length == 0) {
+        freeChunks_.push_back(chunk);
+        chunk = nullptr;
+    } else {
+        chunk->offset = 0;
+        chunk->scanned = false;
+        chunk->recordEnd = chunk->length;
+        chunk->resolved = false;
+        chunk->output.clear();
+        chunk->lines = 0;
+        chunk->failed = false;
+        chunk->done = false;
+    }
+    return chunk;
+}
+
+/**
+ * @brief Wait for the next chunk to be finished.
+ *
+ * If the output is ordered this is the oldest chunk, otherwise it is whichever
+ * chunk a worker finishes first. The chunk is removed from those in flight.
+ *
+ * While waiting, chunks that have been scanned are resolved and queued to be
+ * filtered. If this frees up room for more chunks to be read, we return
+ * without waiting any longer.
+ *
+ * @param more  false once the end of the file has been reached.
+ *
+ * @return  The finished chunk, or nullptr if there is room to read another.
+ *
+ */
+ParallelFilter::Chunk* ParallelFilter::finishedChunk(bool more) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    Chunk* chunk = nullptr;
+    bool removed = false;
+    while (chunk == nullptr && !removed && !inFlight_.empty()) {
+        removed = resolveChunks();
+        if (!more && lastResolved_ != nullptr && inFlight_.back()->resolved) {
+            // nothing follows the last chunk, so its last record is complete
+            queueChunk(lastResolved_);
+            lastResolved_ = nullptr;
+        }
+
+        size_t count = unordered_ ? inFlight_.size() : 1;
+        for (size_t i = 0; chunk == nullptr && i < count; i++) {
+            if (inFlight_[i]->done) {
+                chunk = inFlight_[i];
+                inFlight_.erase(inFlight_.begin() + i);
+            }
+        }
+        if (chunk == nullptr && !removed) {
+            finished_.wait(lock);
+        }
+    }
+    return chunk;
+}
+
+/**
+ * @brief Find the start state of the scanned chunks.
+ *
+ * Chunks are resolved in order, each starting in the state the previous one
+ * ended in. If a chunk starts inside a quoted field, the rest of that record
+ * is moved onto the end of the previous chunk. A chunk is only queued to be
+ * filtered once the chunk after it has been resolved, as until then we don't
+ * know whether its last record is complete.
+ *
+ * This must be called with mutex_ locked.
+ *
+ * @return  true if any chunks were entirely moved into the previous one, and
+ *          so are no longer in flight.
+ *
+ */
+bool ParallelFilter::resolveChunks() {
+    bool removed = false;
+    size_t i = 0;
+    while (i < inFlight_.size() && inFlight_[i]->resolved) {
+        i++;
+    }
+
+    while (i < inFlight_.size() && inFlight_[i]->scanned) {
+        Chunk* chunk = inFlight_[i];
+        RecordScanner::State start = nextState_;
+        nextState_ = chunk->endState[start];
+        chunk->resolved = true;
+
+        if (start == RecordScanner::INSIDE_QUOTES) {
+            appendToChunk(*lastResolved_, &chunk->data[0], chunk->recordEnd);
+            chunk->offset = chunk->recordEnd;
+        }
+
+        if (chunk->offset == chunk->length) {
+            inFlight_.erase(inFlight_.begin() + i);
+            freeChunks_.push_back(chunk);
+            removed = true;
+        } else {
+            if (lastResolved_ != nullptr) {
+                queueChunk(lastResolved_);
+            }
+            lastResolved_ = chunk;
+            i++;
+        }
+    }
+    return removed;
+}
+
+/**
+ * @brief Hand a chunk to the workers.
+ *
+ * The chunk is scanned if it hasn't been, otherwise it is filtered. This must
+ * be called with mutex_ locked.
+ *
+ */
+void ParallelFilter::queueChunk(Chunk* chunk) {
+    queue_.push_back(chunk);
+    queued_.notify_one();
+}
+
+/**
+ * @brief Write the output from a chunk.
+ *
+ * When the output is ordered this is called for each chunk in the order they
+ * were read, otherwise workers call it as they finish each chunk.
+ *
+ */
+void ParallelFilter::writeChunk(Chunk* chunk) {
+    std::lock_guard<std::mutex> lock(outMutex_);
+    out_->write(chunk->output);
+}
+
+/**
+ * @brief Describe the first line that could not be filtered.
+ *
+ * This must be called once the workers have stopped. The chunks that were
+ * read before the failed one have all been finished by then, but when the
+ * output is unordered one of them may also have failed, in which case that is
+ * the error we report.
+ *
+ * @param chunk  A chunk that failed.
+ *
+ */
+void ParallelFilter::setError(Chunk* chunk) {
+    for (size_t i = 0; i < inFlight_.size(); i++) {
+        Chunk* other = inFlight_[i];
+        if (other->done && other->failed && other->seq < chunk->seq) {
+            chunk = other;
+        }
+    }
+
+    int lineNumber = chunk->lines;
+    for (size_t i = 0; i < chunk->seq; i++) {
+        lineNumber += chunkLines_[i];
+    }
+    errText_ = LineFilter::errText(chunk->error, lineNumber);
+}
+
+/**
+ * @brief A worker thread.
+ *
+ * Scan or filter chunks from the queue until asked to stop.
+ *
+ * @param lineFilter  The LineFilter for this thread to use.
+ *
+ */
+void ParallelFilter::work(LineFilter* lineFilter) {
+    while (true) {
+        Chunk* chunk = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!stop_ && queue_.empty()) {
+                queued_.wait(lock);
+            }
+            if (stop_) {
+                break;
+            }
+            chunk = queue_.front();
+            queue_.pop_front();
+        }
+
+        if (!chunk->scanned) {
+            scanChunk(*chunk);
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            chunk->scanned = true;
+            finished_.notify_all();
+        } else {
+            filterChunk(*lineFilter, *chunk);
+            if (unordered_) {
+                writeChunk(chunk);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            chunkLines_[chunk->seq] = chunk->lines;
+            chunk->done = true;
+            finished_.notify_all();
+        }
+    }
+}
+
+/**
+ * @brief The first pass over a chunk.
+ *
+ * Work out the state at the end of the chunk for both of the states it could
+ * start in, and where the first record ends if it starts inside quotes. The
+ * two scans usually agree after a line or two, after which only one of them
+ * is carried on. Chunks without any quotes are skipped over entirely.
+ *
+ */
+void ParallelFilter::scanChunk(Chunk& chunk) {
+    const char* data = &chunk.data[0];
+    const char* pos = data;
+    const char* end = data + chunk.length;
+    RecordScanner::State outside = RecordScanner::OUTSIDE_QUOTES;
+    RecordScanner::State inside = RecordScanner::INSIDE_QUOTES;
+
+    if (memchr(pos, '"', end - pos) != nullptr) {
+        bool same = false;
+        while (pos < end) {
+            const char* newline =
+                static_cast<const char*>(memchr(pos, '\n', end - pos));
+            const char* lineEnd = (newline != nullptr) ? newline : end;
+            outside = RecordScanner::scanLine(pos, lineEnd, outside);
+            inside = same ? outside
+                          : RecordScanner::scanLine(pos, lineEnd, inside);
+            same = (outside == inside);
+
+            if (newline != nullptr && chunk.recordEnd == chunk.length &&
+                inside == RecordScanner::OUTSIDE_QUOTES) {
+                chunk.recordEnd = newline + 1 - data;
+            }
+            pos = lineEnd + 1;
+        }
+    }
+
+    chunk.endState[RecordScanner::OUTSIDE_QUOTES] = outside;
+    chunk.endState[RecordScanner::INSIDE_QUOTES] = inside;
+}
+
+/**
+ * @brief Filter the records in a chunk.
+ *
+ * The chunk starts with a whole record. This stops at the first record that
+ * cannot be filtered.
+ *
+ */
+void ParallelFilter::filterChunk(LineFilter& lineFilter, Chunk& chunk) {
+    const char* record = &chunk.data[chunk.offset];
+    const char* pos = record;
+    const char* end = &chunk.data[0] + chunk.length;
+
+    int batchStart = 0;
+
+    RecordScanner::State state = RecordScanner::OUTSIDE_QUOTES;
+    while (pos < end && !chunk.failed) {
+        const char* newline =
+            static_cast<const char*>(memchr(pos, '\n', end - pos));
+        const char* lineEnd = (newline != nullptr) ? newline : end;
+        state = RecordScanner::scanLine(pos, lineEnd, state);
+        pos = lineEnd + 1;
+
+        // a record that is still in quotes at the end of the file is passed
+        // on as it is, and rejected by the parser
+        if (state == RecordScanner::OUTSIDE_QUOTES || pos >= end) {
+            chunk.lines++;
+            if (!lineFilter.add(record, lineEnd - record)) {
+                flushBatch(lineFilter, chunk, batchStart);
+            }
+            record = pos;
+        }
+    }
+    if (!chunk.failed) {
+        flushBatch(lineFilter, chunk, batchStart);
+    }
+}
+
+/**
+ * @brief Filter the records added to a LineFilter for a chunk.
+ *
+ * @param lineFilter  The LineFilter.
+ * @param chunk       The chunk the records are from.
+ * @param batchStart  The number of records in the chunk before the ones that
+ *                    were added. This is moved on past them.
+ *
+ */
+void ParallelFilter::flushBatch(LineFilter& lineFilter,
+                                Chunk& chunk,
+                                int& batchStart) {
+    if (!lineFilter.flush(chunk.output)) {
+        chunk.failed = true;
+        chunk.error = lineFilter.error();
+        chunk.lines = batchStart + chunk.error.line + 1;
+    }
+    batchStart = chunk.lines;
+}
+
+/**
+ * @brief Add data to the end of a chunk.
+ *
+ * The chunk is grown as necessary, always leaving room for a terminator.
+ *
+ */
+void ParallelFilter::appendToChunk(Chunk& chunk,
+                                   const char* data,
+                                   size_t count) {
+    if (chunk.length + count + 1 > chunk.data.size()) {
+        chunk.data.resize(std::max(chunk.data.size() * 2,
+                                   chunk.length + count + 1));
+    }
+    if (count > 0) {
+        memcpy(&chunk.data[chunk.length], data, count);
+        chunk.length += count;
+    }
+}
+
+void ParallelFilter::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        queued_.notify_all();
+    }
+    for (size_t i = 0; i < workers_.size(); i++) {
+        workers_[i].join();
+    }
+    workers_.clear();
+}
+
+ParallelFilter::Chunk::Chunk()
+    :data(),
+     length(0),
+     offset(0),
+     seq(0),
+     scanned(false),
+     endState(),
+     recordEnd(0),
+     resolved(false),
+     output(),
+     lines(0),
+     failed(false),
+     error(),
+     done(false) {
+
+}
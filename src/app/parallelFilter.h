@@ -0,0 +1,127 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#ifndef CSVFILTER_PARALLEL_FILTER_H
+#define CSVFILTER_PARALLEL_FILTER_H
+
+#include "fileReader.h"
+#include "lineFilter.h"
+#include "outputWriter.h"
+#include "recordScanner.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Filter a file on several threads.
+ *
+ * The file is read in large chunks of whole lines (see FileReader::readChunk),
+ * which are handed out to a pool of worker threads. Each worker has its own
+ * LineFilter, and collects the output for a chunk in a buffer. The output is
+ * then written in the order the chunks were read, so it is identical to
+ * filtering the file a record at a time.
+ *
+ * A chunk may start part way through a record, as quoted fields can contain
+ * newlines. Each chunk is therefore processed in two passes. The first pass
+ * scans the quotes in the chunk to work out whether it would end inside a
+ * quoted field, both if it started outside one and if it started inside one
+ * (see RecordScanner). These scans run in parallel, and are then chained
+ * together in order to find the real state at the start of every chunk. A
+ * record that straddles two chunks is moved into the first of them, so that
+ * each chunk starts with a whole record. The second pass then filters the
+ * records in the chunk.
+ *
+ * Alternatively the output can be unordered, in which case each worker writes
+ * the output for a chunk as soon as it has finished it. This avoids holding
+ * output back behind a slow chunk, but the lines are no longer in the same
+ * order as the input.
+ *
+ * The number of chunks in flight is bounded, so the memory used depends on the
+ * number of workers and the chunk size rather than the size of the file.
+ *
+ */
+class ParallelFilter {
+public:
+    ParallelFilter(FileReader& reader,
+                   const Headers& headers,
+                   const Expression* filter,
+                   int expectedFieldCount,
+                   int workers,
+                   size_t chunkSize,
+                   bool unordered);
+    ~ParallelFilter();
+
+    bool run(OutputWriter& out);
+    const std::string& errText() const;
+
+private:
+    ParallelFilter(const ParallelFilter& other);
+    ParallelFilter& operator=(const ParallelFilter& other);
+
+    /**
+     * @brief A chunk of the input, and the result of filtering it.
+     */
+    typedef struct Chunk {
+        Chunk();
+
+        std::vector<char> data;        ///< The lines in the chunk
+        size_t length;                 ///< The length of the data
+        size_t offset;                 ///< Where the first whole record starts
+        size_t seq;                    ///< The position in the file
+        bool scanned;                  ///< Has the first pass finished?
+        RecordScanner::State endState[2]; ///< The state at the end of the
+                                          ///< chunk, for each start state
+        size_t recordEnd;              ///< The end of the first record, if the
+                                       ///< chunk starts inside quotes
+        bool resolved;                 ///< Is the start state known?
+        std::string output;            ///< The output for the matching lines
+        int lines;                     ///< The number of records filtered
+        bool failed;                   ///< Did a record fail to filter?
+        LineFilter::LineError error;   ///< Why, if it did
+        bool done;                     ///< Has a worker finished with it?
+    } Chunk;
+
+    Chunk* readChunk();
+    Chunk* finishedChunk(bool more);
+    bool resolveChunks();
+    void queueChunk(Chunk* chunk);
+    void writeChunk(Chunk* chunk);
+    void setError(Chunk* chunk);
+    void work(LineFilter* lineFilter);
+    static void scanChunk(Chunk& chunk);
+    static void appendToChunk(Chunk& chunk, const char* data, size_t count);
+    static void filterChunk(LineFilter& lineFilter, Chunk& chunk);
+    static void flushBatch(LineFilter& lineFilter,
+                           Chunk& chunk,
+                           int& batchStart);
+    void stopWorkers();
+
+    FileReader& reader_;
+    size_t chunkSize_;
+    size_t maxChunks_;
+    bool unordered_;
+    OutputWriter* out_;
+    std::vector<std::unique_ptr<LineFilter>> lineFilters_;
+    std::vector<std::thread> workers_;
+    std::vector<std::unique_ptr<Chunk>> chunks_;
+    std::vector<Chunk*> freeChunks_;
+    std::deque<Chunk*> inFlight_;
+    std::deque<Chunk*> queue_;
+    Chunk* lastResolved_;
+    RecordScanner::State nextState_;
+    bool stop_;
+    std::mutex mutex_;
+    std::condition_variable queued_;
+    std::condition_variable finished_;
+    std::mutex outMutex_;
+    std::vector<int> chunkLines_;
+    std::string errText_;
+};
+
+#endif // CSVFILTER_PARALLEL_FILTER_H
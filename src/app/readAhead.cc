@@ -0,0 +1,240 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#include "readAhead.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+/**
+ * @brief Constructor
+ *
+ * Allocate the buffers and start the background thread, which immediately
+ * starts filling them.
+ *
+ * @param fd          The file descriptor to read from. This is not closed by
+ *                    this class.
+ * @param bufferSize  The size of each buffer in the ring.
+ * @param queueDepth  The number of buffers in the ring. One of these is held by
+ *                    the consumer while it is working on it, so this must be
+ *                    at least two for any reading ahead to take place.
+ *
+ */
+ReadAhead::ReadAhead(int fd, size_t bufferSize, size_t queueDepth)
+    :state_(new State(fd, bufferSize, queueDepth)),
+     thread_(run, state_),
+     holding_(false),
+     error_(0) {
+
+}
+
+/**
+ * @brief Destructor
+ *
+ * Stop the background thread and wait for it to finish. If it is waiting for
+ * data it is woken through the wake pipe, so it is never left running once the
+ * caller goes on to close the file descriptor.
+ *
+ */
+ReadAhead::~ReadAhead() {
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex_);
+        state_->stop_ = true;
+        state_->changed_.notify_all();
+    }
+    if (state_->wake_[1] >= 0) {
+        char wake = 0;
+        ssize_t count = 0;
+        do {
+            count = write(state_->wake_[1], &wake, 1);
+        } while (count < 0 && errno == EINTR);
+    }
+    thread_.join();
+}
+
+/**
+ * @brief Take the next filled buffer.
+ *
+ * Wait until the next buffer has been filled, and return it. The buffer belongs
+ * to the caller until ReadAhead::release is called, which must be done before
+ * the next call to acquire.
+ *
+ * @param data    Set to the start of the data in the buffer.
+ * @param length  Set to the amount of data in the buffer. This is zero once the
+ *                end of the file has been reached.
+ *
+ * @return  true if the read succeeded, false if it failed (in which case
+ *          ReadAhead::error returns the errno from the failed read).
+ *
+ */
+bool ReadAhead::acquire(char*& data, size_t& length) {
+    assert(!holding_);
+    std::unique_lock<std::mutex> lock(state_->mutex_);
+    while (state_->ready_ == 0 && !state_->done_) {
+        state_->changed_.wait(lock);
+    }
+
+    bool ok = true;
+    data = nullptr;
+    length = 0;
+    if (state_->ready_ > 0) {
+        size_t index = state_->readIndex_;
+        ssize_t count = state_->lengths_[index];
+        state_->readIndex_ = (index + 1) % state_->buffers_.size();
+        state_->ready_--;
+        holding_ = true;
+
+        if (count < 0) {
+            ok = false;
+            error_ = state_->errno_;
+        } else {
+            data = state_->buffers_[index];
+            length = count;
+        }
+    }
+    return ok;
+}
+
+/**
+ * @brief Hand the last acquired buffer back to the background thread.
+ *
+ */
+void ReadAhead::release() {
+    if (holding_) {
+        std::lock_guard<std::mutex> lock(state_->mutex_);
+        state_->inUse_--;
+        holding_ = false;
+        state_->changed_.notify_all();
+    }
+}
+
+/**
+ * @brief The error from a failed read.
+ *
+ * @return  The errno from the read that failed, if ReadAhead::acquire has
+ *          returned false, or zero otherwise.
+ *
+ */
+int ReadAhead::error() const {
+    return error_;
+}
+
+/**
+ * @brief The background thread.
+ *
+ * Fill buffers in turn until the end of the file is reached, a read fails, or
+ * we are asked to stop. Each read is a single call to read(2), so data
+ * arriving slowly through a pipe is passed on as soon as it is available.
+ *
+ * @param state  The state shared with the consumer.
+ *
+ */
+void ReadAhead::run(std::shared_ptr<State> state) {
+    bool finished = false;
+    while (!finished) {
+        size_t index = 0;
+        {
+            std::unique_lock<std::mutex> lock(state->mutex_);
+            while (!state->stop_ && state->inUse_ == state->buffers_.size()) {
+                state->changed_.wait(lock);
+            }
+            if (state->stop_) {
+                finished = true;
+            } else {
+                index = state->writeIndex_;
+                state->inUse_++;
+            }
+        }
+
+        if (!finished && !waitForData(*state)) {
+            finished = true;
+        } else if (!finished) {
+            ssize_t count = 0;
+            do {
+                count = read(state->fd_, state->buffers_[index],
+                             state->bufferSize_);
+            } while (count < 0 && errno == EINTR);
+            int err = errno;
+
+            std::lock_guard<std::mutex> lock(state->mutex_);
+            state->lengths_[index] = count;
+            if (count < 0) {
+                state->errno_ = err;
+            }
+            state->writeIndex_ = (index + 1) % state->buffers_.size();
+            state->ready_++;
+            finished = (count <= 0);
+            state->changed_.notify_all();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(state->mutex_);
+    state->done_ = true;
+    state->changed_.notify_all();
+}
+
+/**
+ * @brief Wait until the file descriptor can be read without blocking.
+ *
+ * @param state  The state shared with the consumer.
+ *
+ * @return  true if the file descriptor is ready to read, or false if the
+ *          consumer has asked the thread to stop.
+ *
+ */
+bool ReadAhead::waitForData(State& state) {
+    struct pollfd fds[2];
+    fds[0].fd = state.fd_;
+    fds[0].events = POLLIN;
+    fds[1].fd = state.wake_[0]; // ignored by poll if the pipe failed
+    fds[1].events = POLLIN;
+
+    int rc = 0;
+    do {
+        fds[0].revents = 0;
+        fds[1].revents = 0;
+        rc = poll(fds, 2, -1);
+    } while (rc < 0 && errno == EINTR);
+
+    // if poll fails, leave it to the read to report the problem
+    return rc < 0 || fds[1].revents == 0;
+}
+
+ReadAhead::State::State(int fd, size_t bufferSize, size_t queueDepth)
+    :fd_(fd),
+     bufferSize_(bufferSize),
+     buffers_(),
+     lengths_(queueDepth, 0),
+     readIndex_(0),
+     writeIndex_(0),
+     ready_(0),
+     inUse_(0),
+     stop_(false),
+     done_(false),
+     errno_(0),
+     wake_(),
+     mutex_(),
+     changed_() {
+    assert(queueDepth > 0);
+    if (pipe(wake_) != 0) {
+        // the thread can then only be stopped between reads
+        wake_[0] = -1;
+        wake_[1] = -1;
+    }
+    for (size_t i = 0; i < queueDepth; i++) {
+        buffers_.push_back(new char[bufferSize]);
+    }
+}
+
+ReadAhead::State::~State() {
+    for (size_t i = 0; i < buffers_.size(); i++) {
+        delete[] buffers_[i];
+    }
+    if (wake_[0] >= 0) {
+        close(wake_[0]);
+        close(wake_[1]);
+    }
+}
@@ -0,0 +1,78 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#ifndef CSVFILTER_READ_AHEAD_H
+#define CSVFILTER_READ_AHEAD_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <vector>
+#include <stddef.h>
+
+/**
+ * @brief Reads a file descriptor ahead of its consumer.
+ *
+ * This class starts a background thread that reads from a file descriptor into
+ * a bounded ring of buffers. The consumer takes filled buffers from the ring
+ * one at a time with ReadAhead::acquire, and hands each one back with
+ * ReadAhead::release once it has finished with it, at which point the
+ * background thread is free to fill it again.
+ *
+ * This lets the reads overlap with the work done on the data, which hides the
+ * latency of slow devices such as network volumes.
+ *
+ */
+class ReadAhead {
+public:
+    ReadAhead(int fd, size_t bufferSize, size_t queueDepth);
+    ~ReadAhead();
+
+    bool acquire(char*& data, size_t& length);
+    void release();
+
+    int error() const;
+
+private:
+    ReadAhead(const ReadAhead& other);
+    ReadAhead& operator=(const ReadAhead& other);
+
+    /**
+     * @brief State shared with the background thread.
+     *
+     * The thread waits for the file descriptor and the read end of wake_
+     * together, so that the consumer can stop it by writing to wake_ even
+     * while it is waiting for data that may never arrive.
+     */
+    typedef struct State {
+        State(int fd, size_t bufferSize, size_t queueDepth);
+        ~State();
+
+        int fd_;
+        size_t bufferSize_;
+        std::vector<char*> buffers_;
+        std::vector<ssize_t> lengths_;
+        size_t readIndex_;
+        size_t writeIndex_;
+        size_t ready_;
+        size_t inUse_;
+        bool stop_;
+        bool done_;
+        int errno_;
+        int wake_[2];
+        std::mutex mutex_;
+        std::condition_variable changed_;
+    } State;
+
+    static void run(std::shared_ptr<State> state);
+    static bool waitForData(State& state);
+
+    std::shared_ptr<State> state_;
+    std::thread thread_;
+    bool holding_;
+    int error_;
+};
+
+#endif // CSVFILTER_READ_AHEAD_H
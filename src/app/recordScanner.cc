@@ -0,0 +1,48 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#include "recordScanner.h"
+
+#include <string.h>
+
+/**
+ * @brief Find the state at the end of a line.
+ *
+ * Only the quotes in the line are looked at, so lines without any quotes are
+ * skipped over with a single memchr.
+ *
+ * @param start  The start of the line. If state is OUTSIDE_QUOTES this must be
+ *               the start of a field.
+ * @param end    The end of the line (the newline, which is not examined).
+ * @param state  The state at the start of the line.
+ *
+ * @return  The state at the end of the line.
+ *
+ */
+RecordScanner::State RecordScanner::scanLine(const char* start,
+                                             const char* end,
+                                             State state) {
+    bool inQuotes = (state == INSIDE_QUOTES);
+    const char* pos = start;
+    while (pos < end) {
+        const char* quote =
+            static_cast<const char*>(memchr(pos, '"', end - pos));
+        if (quote == nullptr) {
+            pos = end;
+        } else if (inQuotes) {
+            if (quote + 1 < end && quote[1] == '"') {
+                // escaped quote
+                pos = quote + 2;
+            } else {
+                inQuotes = false;
+                pos = quote + 1;
+            }
+        } else {
+            // quotes in the middle of an unquoted field are just characters
+            inQuotes = (quote == start || quote[-1] == ',');
+            pos = quote + 1;
+        }
+    }
+    return inQuotes ? INSIDE_QUOTES : OUTSIDE_QUOTES;
+}
@@ -0,0 +1,37 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#ifndef CSVFILTER_RECORD_SCANNER_H
+#define CSVFILTER_RECORD_SCANNER_H
+
+/**
+ * @brief Find where csv records end.
+ *
+ * A record normally ends at a newline, but a quoted field may contain
+ * newlines, in which case the record carries on over the following lines.
+ * This class tracks whether the end of a line is inside a quoted field, using
+ * the same rules as LineParser: a quote only starts a quoted field if it is
+ * the first character of the field, and inside a quoted field two quotes are
+ * an escaped quote.
+ *
+ */
+class RecordScanner {
+public:
+    /**
+     * @brief Whether a position in the file is inside a quoted field.
+     */
+    typedef enum {
+        OUTSIDE_QUOTES, /**< Not in a quoted field, so a newline here ends
+                         *   the record */
+        INSIDE_QUOTES   /**< In a quoted field, so a newline here is part of
+                         *   the field */
+    } State;
+
+    static State scanLine(const char* start, const char* end, State state);
+
+private:
+    RecordScanner();
+};
+
+#endif // CSVFILTER_RECORD_SCANNER_H
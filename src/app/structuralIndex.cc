@@ -0,0 +1,216 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#include "structuralIndex.h"
+
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CSVFILTER_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+static void scanScalar(const char* data,
+                       size_t blocks,
+                       uint64_t* commas,
+                       uint64_t* quotes) {
+    for (size_t block = 0; block < blocks; block++) {
+        uint64_t comma = 0;
+        uint64_t quote = 0;
+        for (int i = 0; i < 64; i++) {
+            uint64_t bit = static_cast<uint64_t>(1) << i;
+            char c = data[i];
+            if (c == ',') {
+                comma |= bit;
+            } else if (c == '"') {
+                quote |= bit;
+            }
+        }
+        commas[block] = comma;
+        quotes[block] = quote;
+        data += 64;
+    }
+}
+
+#ifdef CSVFILTER_X86_KERNELS
+
+__attribute__((target("sse2")))
+static void scanSse2(const char* data,
+                     size_t blocks,
+                     uint64_t* commas,
+                     uint64_t* quotes) {
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i quote = _mm_set1_epi8('"');
+    for (size_t block = 0; block < blocks; block++) {
+        uint64_t commaBits = 0;
+        uint64_t quoteBits = 0;
+        for (int i = 0; i < 4; i++) {
+            __m128i bytes = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(data + i * 16));
+            uint64_t c = static_cast<uint16_t>(
+                _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, comma)));
+            uint64_t q = static_cast<uint16_t>(
+                _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, quote)));
+            commaBits |= c << (i * 16);
+            quoteBits |= q << (i * 16);
+        }
+        commas[block] = commaBits;
+        quotes[block] = quoteBits;
+        data += 64;
+    }
+}
+
+__attribute__((target("avx2")))
+static void scanAvx2(const char* data,
+                     size_t blocks,
+                     uint64_t* commas,
+                     uint64_t* quotes) {
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i quote = _mm256_set1_epi8('"');
+    for (size_t block = 0; block < blocks; block++) {
+        __m256i lo = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(data));
+        __m256i hi = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(data + 32));
+        uint64_t cLo = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, comma)));
+        uint64_t cHi = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, comma)));
+        uint64_t qLo = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, quote)));
+        uint64_t qHi = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, quote)));
+        commas[block] = cLo | (cHi << 32);
+        quotes[block] = qLo | (qHi << 32);
+        data += 64;
+    }
+}
+
+#endif // CSVFILTER_X86_KERNELS
+
+/**
+ * @brief Constructor
+ *
+ * @param kernel  The implementation to use. This should be left as
+ *                KERNEL_AUTO other than for testing, and must be supported by
+ *                the host (see StructuralIndex::supported).
+ *
+ */
+StructuralIndex::StructuralIndex(Kernel kernel)
+    :scan_(scanFunction(kernel == KERNEL_AUTO ? bestKernel() : kernel)),
+     commas_(),
+     quotes_(),
+     length_(0) {
+
+}
+
+/**
+ * @brief Index a line.
+ *
+ * The data is not copied, and is not needed once this returns, so it can be
+ * modified afterwards without affecting the index.
+ *
+ * @param data    The line.
+ * @param length  The length of the line.
+ *
+ */
+void StructuralIndex::build(const char* data, size_t length) {
+    size_t blocks = (length + 63) / 64;
+    size_t whole = length / 64;
+    commas_.resize(blocks);
+    quotes_.resize(blocks);
+    length_ = length;
+
+    if (whole > 0) {
+        scan_(data, whole, &commas_[0], &quotes_[0]);
+    }
+    if (whole < blocks) {
+        // pad the last partial block, so the kernels never read past the end
+        // of the line
+        char last[64];
+        size_t tail = length - whole * 64;
+        memcpy(last, data + whole * 64, tail);
+        memset(last + tail, 0, sizeof(last) - tail);
+        scan_(last, 1, &commas_[whole], &quotes_[whole]);
+    }
+}
+
+/**
+ * @brief Count the commas.
+ *
+ * @param pos  Where to start counting.
+ *
+ * @return  The number of commas at or after pos.
+ *
+ */
+size_t StructuralIndex::countCommas(size_t pos) const {
+    size_t ret = 0;
+    size_t word = pos / 64;
+    if (word < commas_.size()) {
+        uint64_t mask = ~static_cast<uint64_t>(0) << (pos % 64);
+        ret = __builtin_popcountll(commas_[word] & mask);
+        for (word++; word < commas_.size(); word++) {
+            ret += __builtin_popcountll(commas_[word]);
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Can the host run a kernel?
+ *
+ */
+bool StructuralIndex::supported(Kernel kernel) {
+    bool ret = false;
+    switch (kernel) {
+    case KERNEL_AUTO:
+    case KERNEL_SCALAR:
+        ret = true;
+        break;
+#ifdef CSVFILTER_X86_KERNELS
+    case KERNEL_SSE2:
+        __builtin_cpu_init();
+        ret = __builtin_cpu_supports("sse2");
+        break;
+    case KERNEL_AVX2:
+        __builtin_cpu_init();
+        ret = __builtin_cpu_supports("avx2");
+        break;
+#endif
+    default:
+        break;
+    }
+    return ret;
+}
+
+/**
+ * @brief The fastest kernel the host supports.
+ *
+ * This is only worked out once.
+ *
+ */
+StructuralIndex::Kernel StructuralIndex::bestKernel() {
+    static const Kernel best =
+        supported(KERNEL_AVX2) ? KERNEL_AVX2 :
+        supported(KERNEL_SSE2) ? KERNEL_SSE2 :
+        KERNEL_SCALAR;
+    return best;
+}
+
+StructuralIndex::ScanFunction StructuralIndex::scanFunction(Kernel kernel) {
+    ScanFunction ret = scanScalar;
+    switch (kernel) {
+#ifdef CSVFILTER_X86_KERNELS
+    case KERNEL_SSE2:
+        ret = scanSse2;
+        break;
+    case KERNEL_AVX2:
+        ret = scanAvx2;
+        break;
+#endif
+    default:
+        break;
+    }
+    return ret;
+}
@@ -0,0 +1,109 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#ifndef CSVFILTER_STRUCTURAL_INDEX_H
+#define CSVFILTER_STRUCTURAL_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/**
+ * @brief Find the commas and quotes in a line.
+ *
+ * The line is scanned 64 bytes at a time, producing a bitmask of the commas
+ * and a bitmask of the quotes in each block. Finding the end of a field is
+ * then a matter of finding the next set bit, rather than looking at each
+ * character in turn.
+ *
+ * The masks are built with SIMD instructions where the host supports them.
+ * The best kernel is picked the first time an index is built, and there is a
+ * portable scalar kernel for other hosts.
+ *
+ */
+class StructuralIndex {
+public:
+    /**
+     * @brief The implementations of the scan.
+     */
+    typedef enum {
+        KERNEL_AUTO,   /**< The best one supported by the host */
+        KERNEL_SCALAR, /**< A byte at a time */
+        KERNEL_SSE2,   /**< 16 bytes at a time */
+        KERNEL_AVX2    /**< 32 bytes at a time */
+    } Kernel;
+
+    explicit StructuralIndex(Kernel kernel = KERNEL_AUTO);
+
+    void build(const char* data, size_t length);
+    size_t nextComma(size_t pos) const;
+    size_t nextQuote(size_t pos) const;
+    size_t countCommas(size_t pos) const;
+
+    static bool supported(Kernel kernel);
+    static Kernel bestKernel();
+
+private:
+    StructuralIndex(const StructuralIndex& other);
+    StructuralIndex& operator=(const StructuralIndex& other);
+
+    typedef void (*ScanFunction)(const char* data,
+                                 size_t blocks,
+                                 uint64_t* commas,
+                                 uint64_t* quotes);
+
+    static ScanFunction scanFunction(Kernel kernel);
+    size_t nextBit(const std::vector<uint64_t>& masks, size_t pos) const;
+
+    ScanFunction scan_;
+    std::vector<uint64_t> commas_;
+    std::vector<uint64_t> quotes_;
+    size_t length_;
+};
+
+/**
+ * @brief Find the next comma.
+ *
+ * @param pos  Where to start looking.
+ *
+ * @return  The position of the first comma at or after pos, or the length of
+ *          the line if there isn't one.
+ *
+ */
+inline size_t StructuralIndex::nextComma(size_t pos) const {
+    return nextBit(commas_, pos);
+}
+
+/**
+ * @brief Find the next quote.
+ *
+ * @param pos  Where to start looking.
+ *
+ * @return  The position of the first quote at or after pos, or the length of
+ *          the line if there isn't one.
+ *
+ */
+inline size_t StructuralIndex::nextQuote(size_t pos) const {
+    return nextBit(quotes_, pos);
+}
+
+inline size_t StructuralIndex::nextBit(const std::vector<uint64_t>& masks,
+                                       size_t pos) const {
+    size_t word = pos / 64;
+    if (word >= masks.size()) {
+        return length_;
+    }
+    uint64_t bits = masks[word] & (~static_cast<uint64_t>(0) << (pos % 64));
+    while (bits == 0) {
+        word++;
+        if (word == masks.size()) {
+            return length_;
+        }
+        bits = masks[word];
+    }
+    // bits past the end of the line are never set
+    return word * 64 + __builtin_ctzll(bits);
+}
+
+#endif // CSVFILTER_STRUCTURAL_INDEX_H
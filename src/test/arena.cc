@@ -0,0 +1,81 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#include <app/arena.h>
+#include <app/lineParser.h>
+
+#include "test.h"
+
+#include <string.h>
+#include <string>
+
+static void testBlockAllocation() {
+    Test::beginGroup("Allocating from the block");
+
+    Arena arena(16);
+    char* a = arena.alloc(8);
+    char* b = arena.alloc(8);
+    Test::that(b == a + 8, "Allocations are consecutive");
+
+    arena.reset();
+    Test::that(arena.alloc(4) == a, "Reset starts from the beginning");
+    Test::eq(arena.capacity(), static_cast<size_t>(16), "Block did not grow");
+
+    Test::endGroup();
+}
+
+static void testOverflow() {
+    Test::beginGroup("Overflowing the block");
+
+    Arena arena(16);
+    char* a = arena.alloc(10);
+    char* b = arena.alloc(10);
+    char* c = arena.alloc(100);
+    memset(a, 'a', 10);
+    memset(b, 'b', 10);
+    memset(c, 'c', 100);
+    Test::eq(std::string(a, 10), std::string(10, 'a'), "First is intact");
+    Test::eq(std::string(b, 10), std::string(10, 'b'), "Second is intact");
+    Test::eq(std::string(c, 100), std::string(100, 'c'), "Third is intact");
+
+    arena.reset();
+    Test::that(arena.capacity() >= 120, "Block grew to fit the line");
+    char* d = arena.alloc(120);
+    Test::that(arena.alloc(0) == d + 120, "Line now fits in the block");
+
+    Test::endGroup();
+}
+
+static void testUnescapedFields() {
+    Test::beginGroup("Unescaped fields");
+
+    std::string quoted = "\"" + std::string(3000, 'x') + "\"\"\"";
+    std::string line = quoted + "," + quoted + ",plain";
+    LineParser parser;
+    Test::that(parser.parse(line.c_str()), "Line parsed");
+
+    const char* first = parser.field(0).asString();
+    const char* second = parser.field(1).asString();
+    const char* third = parser.field(2).asString();
+    std::string expected = std::string(3000, 'x') + "\"";
+    Test::eq(first, expected.c_str(), "First field is intact");
+    Test::eq(second, expected.c_str(), "Second field is intact");
+    Test::eq(third, "plain", "Third field is intact");
+    Test::that(parser.field(0).asString() == first, "Value is cached");
+
+    Test::that(parser.parse("a,\"b\"\"\",c"), "Next line parsed");
+    Test::eq(parser.field(1).asString(), "b\"", "Next line unescaped");
+
+    Test::endGroup();
+}
+
+void arenaTests() {
+    Test::beginSuite("Arena");
+
+    testBlockAllocation();
+    testOverflow();
+    testUnescapedFields();
+
+    Test::endSuite();
+}
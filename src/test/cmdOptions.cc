@@ -13,12 +13,24 @@ public:
     ExpectedVals()
         :help(false),
          version(false),
+         useMmap(false),
+         readAhead(0),
+         bufferSize(4 * 1024 * 1024),
+         jobs(1),
+         unordered(false),
+         lineBuffered(false),
          file(""),
          filter("")
     {}
     
     bool help;
     bool version;
+    bool useMmap;
+    int readAhead;
+    size_t bufferSize;
+    int jobs;
+    bool unordered;
+    bool lineBuffered;
     std::string file;
     std::string filter;
     std::vector<std::string> columns;
@@ -26,6 +38,16 @@ public:
     void check(const CmdOptions& o) {
         Test::eq(o.help(), help, "Help option registered correctly");
         Test::eq(o.version(), version, "Version option registered correctly");
+        Test::eq(o.useMmap(), useMmap, "Mmap option registered correctly");
+        Test::eq(o.readAhead(), readAhead,
+                 "Read-ahead option registered correctly");
+        Test::eq(o.bufferSize(), bufferSize,
+                 "Buffer size option registered correctly");
+        Test::eq(o.jobs(), jobs, "Jobs option registered correctly");
+        Test::eq(o.unordered(), unordered,
+                 "Unordered option registered correctly");
+        Test::eq(o.lineBuffered(), lineBuffered,
+                 "Line-buffered option registered correctly");
         Test::eq(o.file(), file, "File argument registered correctly");
         Test::eq(o.filter(), filter, "Filter argument registered correctly");
 
@@ -89,5 +111,98 @@ void cmdOptionsTests() {
     filterExpected.filter = "2 + 3 / 4";
     testValidCmdLine(filterArgs, filterExpected);
 
+    const char* mmapArgs[] = {"exe", "--mmap", "filename", nullptr};
+    ExpectedVals mmapExpected;
+    mmapExpected.useMmap = true;
+    mmapExpected.file = "filename";
+    testValidCmdLine(mmapArgs, mmapExpected);
+
+    const char* readAheadArgs[] = {"exe", "-r", "4", "-b", "512k", nullptr};
+    ExpectedVals readAheadExpected;
+    readAheadExpected.readAhead = 4;
+    readAheadExpected.bufferSize = 512 * 1024;
+    testValidCmdLine(readAheadArgs, readAheadExpected);
+
+    const char* bufferArgs[] = {"exe", "--buffer-size=1M", nullptr};
+    ExpectedVals bufferExpected;
+    bufferExpected.bufferSize = 1024 * 1024;
+    testValidCmdLine(bufferArgs, bufferExpected);
+
+    const char* jobsArgs[] = {"exe", "-j", "8", "filename", nullptr};
+    ExpectedVals jobsExpected;
+    jobsExpected.jobs = 8;
+    jobsExpected.file = "filename";
+    testValidCmdLine(jobsArgs, jobsExpected);
+
+    const char* unorderedArgs[] = {"exe", "-j", "2", "--unordered", nullptr};
+    ExpectedVals unorderedExpected;
+    unorderedExpected.jobs = 2;
+    unorderedExpected.unordered = true;
+    testValidCmdLine(unorderedArgs, unorderedExpected);
+
+    const char* lineBufferedArgs[] = {"exe", "--line-buffered", nullptr};
+    ExpectedVals lineBufferedExpected;
+    lineBufferedExpected.lineBuffered = true;
+    testValidCmdLine(lineBufferedArgs, lineBufferedExpected);
+
+    const char* badJobsArgs[] = {"exe", "-j", "0", nullptr};
+    CmdOptions badJobs(3, badJobsArgs);
+    Test::that(!badJobs.ok(), "Zero jobs are rejected");
+
+    const char* tooManyJobsArgs[] = {"exe", "-j", "100000000", nullptr};
+    CmdOptions tooManyJobs(3, tooManyJobsArgs);
+    Test::that(!tooManyJobs.ok(), "More than 256 jobs are rejected");
+
+    const char* maxJobsArgs[] = {"exe", "-j", "256", nullptr};
+    ExpectedVals maxJobsExpected;
+    maxJobsExpected.jobs = 256;
+    testValidCmdLine(maxJobsArgs, maxJobsExpected);
+
+    const char* unorderedOnlyArgs[] = {"exe", "-u", nullptr};
+    CmdOptions unorderedOnly(2, unorderedOnlyArgs);
+    Test::that(!unorderedOnly.ok(), "Unordered output without -j is rejected");
+
+    const char* unorderedOneJobArgs[] = {"exe", "-j", "1", "-u", nullptr};
+    CmdOptions unorderedOneJob(4, unorderedOneJobArgs);
+    Test::that(!unorderedOneJob.ok(),
+               "Unordered output on one job is rejected");
+
+    const char* badBufferArgs[] = {"exe", "-b", "12q", nullptr};
+    CmdOptions badBuffer(3, badBufferArgs);
+    Test::that(!badBuffer.ok(), "An invalid buffer size is rejected");
+
+    const char* negativeBufferArgs[] = {"exe", "-b", "-1", nullptr};
+    CmdOptions negativeBuffer(3, negativeBufferArgs);
+    Test::that(!negativeBuffer.ok(), "A negative buffer size is rejected");
+
+    const char* overflowBufferArgs[] = {"exe", "-b", "99999999999999g",
+                                        nullptr};
+    CmdOptions overflowBuffer(3, overflowBufferArgs);
+    Test::that(!overflowBuffer.ok(),
+               "A buffer size that overflows is rejected");
+
+    const char* hugeBufferArgs[] = {"exe", "-b", "2g", nullptr};
+    CmdOptions hugeBuffer(3, hugeBufferArgs);
+    Test::that(!hugeBuffer.ok(), "A buffer size over 1g is rejected");
+
+    const char* maxBufferArgs[] = {"exe", "-b", "1g", nullptr};
+    ExpectedVals maxBufferExpected;
+    maxBufferExpected.bufferSize = 1024 * 1024 * 1024;
+    testValidCmdLine(maxBufferArgs, maxBufferExpected);
+
+    const char* negativeReadAheadArgs[] = {"exe", "-r", "-1", nullptr};
+    CmdOptions negativeReadAhead(3, negativeReadAheadArgs);
+    Test::that(!negativeReadAhead.ok(),
+               "A negative read-ahead depth is rejected");
+
+    const char* hugeReadAheadArgs[] = {"exe", "-r", "2000000000", nullptr};
+    CmdOptions hugeReadAhead(3, hugeReadAheadArgs);
+    Test::that(!hugeReadAhead.ok(), "A read-ahead depth over 64 is rejected");
+
+    const char* maxReadAheadArgs[] = {"exe", "-r", "64", nullptr};
+    ExpectedVals maxReadAheadExpected;
+    maxReadAheadExpected.readAhead = 64;
+    testValidCmdLine(maxReadAheadArgs, maxReadAheadExpected);
+
     Test::endSuite();
 }
@@ -3,12 +3,34 @@
 //
 
 #include <app/field.h>
+#include <app/lineParser.h>
 #include "test.h"
 
+#include <stdlib.h>
+#include <string.h>
 #include <sstream>
+#include <vector>
+
+/**
+ * @brief A line holding a single field.
+ */
+class SingleField {
+public:
+    SingleField(const char* raw)
+        :line_(raw, raw + strlen(raw) + 1), parser_() {
+        parser_.parse(&line_[0]);
+    }
+    Field field() const {
+        return parser_.field(0);
+    }
+private:
+    std::vector<char> line_;
+    LineParser parser_;
+};
 
 void testStringVal(const char* raw, const char* result) {
-    Field f(raw);
+    SingleField line(raw);
+    Field f = line.field();
 
     std::stringstream msg;
 
@@ -19,7 +41,8 @@ void testStringVal(const char* raw, const char* result) {
 
 
 static void testNumberVal(const char* raw, double result) {
-    Field f(raw);
+    SingleField line(raw);
+    Field f = line.field();
     double val = 0.0;
 
     std::stringstream msg;
@@ -33,8 +56,29 @@ static void testNumberVal(const char* raw, double result) {
     Test::endGroup();
 }
 
+static void testIntegerVal(const char* raw, bool isInteger) {
+    SingleField line(raw);
+    Field f = line.field();
+    Number val;
+
+    std::stringstream msg;
+    msg << "Field value " << raw;
+    Test::beginGroup(msg.str());
+
+    if (Test::that(f.asNumber(val), "field is number")) {
+        Test::eq(val.isInteger(), isInteger, "Integer if written as one");
+        if (isInteger) {
+            Test::that(val.integerVal() == strtoll(raw, nullptr, 10),
+                       "Integer is exact");
+        }
+    }
+
+    Test::endGroup();
+}
+
 static void testNotNumber(const char* raw) {
-    Field f(raw);
+    SingleField line(raw);
+    Field f = line.field();
 
     std::stringstream msg;
     msg << "Field value " << raw;
@@ -52,6 +96,7 @@ void fieldTests() {
     testStringVal("abc", "abc");
     testStringVal("\"abc\"", "abc");
     testStringVal("\"ab\"\"c\"", "ab\"c");
+    testStringVal("\"\"", "");
 
     testNumberVal("321", 321);
     testNumberVal("321.321", 321.321);
@@ -60,11 +105,41 @@ void fieldTests() {
     testNumberVal("013", 13);
     testNumberVal("0x5", 5);
 
+    testIntegerVal("321", true);
+    testIntegerVal("-9007199254740993", true);
+    testIntegerVal("321.0", false);
+    testIntegerVal("1e3", false);
+    testIntegerVal(" 32", false);
+
     testNotNumber("\"123\"");
     testNotNumber("123a");
     testNotNumber(" 123 ");
     testNotNumber("0xabz");
     testNotNumber("123.21.1");
+
+    // values are cached in the span, so repeated calls agree
+    SingleField cached("\"a\"\"b\"");
+    Test::eq(cached.field().asString(), "a\"b", "Unescaped once");
+    Test::eq(cached.field().asString(), "a\"b", "Unescaped value is cached");
+    Test::eq(cached.field().raw(), "\"a\"\"b\"", "Raw value is unchanged");
+    Test::eq(cached.field().length(), static_cast<size_t>(6), "Raw length");
+    Test::that(cached.field().asString() == cached.field().asString(),
+               "Every view of the field shares the cached string");
+
+    // a number is only worked out once per span
+    const char* line = "12,x";
+    Arena arena(64);
+    FieldSpan span;
+    span.offset = 0;
+    span.length = 2;
+    span.flags = 0;
+    span.value = nullptr;
+    Number val;
+    Test::that(Field(line, span, arena).asNumber(val), "Field is number");
+    Test::that((span.flags & FieldSpan::NUMBER_KNOWN) != 0, "Number is cached");
+    span.number = Number::integer(7);
+    Test::that(Field(line, span, arena).asNumber(val) && val.integerVal() == 7,
+               "Cached number is used");
     
     Test::endSuite();
 }
@@ -7,7 +7,11 @@
 #include <app/filterExpression/expression.h>
 #include <app/headers.h>
 
+#include <cstdarg>
 #include <string.h>
+#include <unistd.h>
+#include <memory>
+#include <vector>
 
 static void testFailedParse(const std::string& expression,
                             const std::string& headerLine,
@@ -42,54 +46,261 @@ static void testParse(const std::string input,
     Expression e(input, h);
     Test::eq(e.ok(), true, "Expression parser is ok");
     Test::eq(e.treeString(), expectedTree, "tree is ok");
+
+    std::unique_ptr<Expression> copy(e.clone());
+    Test::eq(copy->ok(), true, "Cloned expression is ok");
+    Test::eq(copy->treeString(), expectedTree, "Cloned tree is ok");
     Test::endGroup();
     free(line);
 }
 
-static void testEval(const std::string expr,
-                     const std::string headerStr,
-                     const std::string lineStr,
-                     VariantRef result) {
-    std::stringstream group;
-    group << "Eval " << expr;
-    Test::beginGroup(group.str());
-
+static void testHighestColumn(const std::string input,
+                              const std::string headerLine,
+                              int expected) {
     LineParser l;
-    char* headers = strdup(headerStr.c_str());
-    l.parse(headers);
+    char* line = strdup(headerLine.c_str());
+    l.parse(line);
     Headers h(l, std::vector<std::string>() );
 
-    Expression e(expr, h);
-    Test::eq(e.ok(), true, "Expression parser is ok");
+    Expression e(input, h);
+    std::stringstream msg;
+    msg << "Highest column used by " << input << " is " << expected;
+    Test::eq(e.highestColumn(), expected, msg.str());
+    free(line);
+}
 
-    char* line = strdup(lineStr.c_str());
+static void testRequiredText(const std::string input,
+                             const std::string headerLine,
+                             const std::string& expected) {
+    LineParser l;
+    char* line = strdup(headerLine.c_str());
     l.parse(line);
+    Headers h(l, std::vector<std::string>() );
 
-    VariantRef v = e.eval(l);
+    Expression e(input, h);
+    std::string needles;
+    for (size_t i = 0; i < e.requiredText().size(); i++) {
+        needles += (i == 0 ? "" : "|") + e.requiredText()[i];
+    }
+    std::stringstream msg;
+    msg << "Text required by " << input << " is \"" << expected << "\"";
+    Test::eq(needles, expected, msg.str());
+    free(line);
+}
 
-    if (Test::eq(v->type(), result->type(), "Result is the correct type")) {
+static void checkResult(VariantRef v,
+                        VariantRef result,
+                        const std::string& how) {
+    if (Test::eq(v->type(), result->type(),
+                 how + " result is the correct type")) {
         switch (result->type()) {
         case Variant::NUMBER:
             Test::eq(v->numberVal(),
                      result->numberVal(),
-                     "double value is correct");
+                     how + " double value is correct");
+            break;
+        case Variant::INTEGER:
+            Test::that(v->integerVal() == result->integerVal(),
+                       how + " integer value is correct");
             break;
         case Variant::BOOLEAN:
             Test::eq(v->booleanVal(),
                      result->booleanVal(),
-                     "boolean value is correct");
+                     how + " boolean value is correct");
             break;
         case Variant::STRING:
         case Variant::ERROR:
             Test::eq(v->charVal(),
                      result->charVal(),
-                     "char value is correct");
+                     how + " char value is correct");
             break;
         default:
             Test::that(false, "Unrecognised type");
             break;
         };
     }
+}
+
+static void testEval(const std::string expr,
+                     const std::string headerStr,
+                     const std::string lineStr,
+                     VariantRef result) {
+    std::stringstream group;
+    group << "Eval " << expr;
+    Test::beginGroup(group.str());
+
+    LineParser l;
+    char* headers = strdup(headerStr.c_str());
+    l.parse(headers);
+    Headers h(l, std::vector<std::string>() );
+
+    Expression e(expr, h);
+    Test::eq(e.ok(), true, "Expression parser is ok");
+
+    char* line = strdup(lineStr.c_str());
+    l.parse(line);
+
+    // the compiled program and the parse tree must agree
+    checkResult(e.eval(l), result, "Compiled");
+    checkResult(e.evalTree(l), result, "Tree");
+
+    Test::endGroup();
+    free(headers);
+    free(line);
+}
+
+/**
+ * @brief Evaluate an expression for a batch of lines.
+ *
+ * @param expected  '1' or '0' for whether each line matches, up to the first
+ *                  line the expression fails for.
+ *
+ */
+static void checkBatch(Expression& e,
+                       const std::vector<std::string>& lines,
+                       const std::string& expected) {
+    LineBatch batch;
+    batch.setFieldLimit(e.highestColumn() + 1);
+    for (size_t i = 0; i < lines.size(); i++) {
+        batch.add(lines[i].data(), lines[i].size());
+    }
+    std::vector<unsigned char> matches;
+    size_t filtered = e.evalBatch(batch, matches);
+
+    std::string actual;
+    for (size_t row = 0; row < filtered; row++) {
+        actual += matches[row] ? '1' : '0';
+    }
+    Test::eq(actual, expected, "Lines that match");
+
+    // every line, including the one that failed, must agree with the line by
+    // line evaluation
+    LineParser l;
+    for (size_t row = 0; row < lines.size() && row <= filtered; row++) {
+        char* line = strdup(lines[row].c_str());
+        l.parse(line);
+        VariantRef v = e.eval(l);
+        if (row < filtered) {
+            // only a boolean true is a match
+            bool match = (v->type() == Variant::BOOLEAN && v->booleanVal());
+            Test::eq(match, matches[row] != 0,
+                     "Line by line result is the same");
+        } else {
+            Test::eq(v->type(), Variant::ERROR, "Line by line also fails");
+            Test::eq(e.evalErrText(), v->charVal(), "Error text is the same");
+        }
+        free(line);
+    }
+}
+
+static void testEvalBatch(const std::string expr,
+                          const std::string headerStr,
+                          const std::vector<std::string>& lines,
+                          const std::string& expected) {
+    std::stringstream group;
+    group << "Eval batch " << expr;
+    Test::beginGroup(group.str());
+
+    LineParser l;
+    char* headers = strdup(headerStr.c_str());
+    l.parse(headers);
+    Headers h(l, std::vector<std::string>() );
+
+    Expression e(expr, h);
+    Test::eq(e.ok(), true, "Expression parser is ok");
+    checkBatch(e, lines, expected);
+
+    Test::endGroup();
+    free(headers);
+}
+
+/**
+ * @brief Evaluate an expression for a batch of lines, after it has been
+ *        profiled on other lines.
+ *
+ * @param profiled  Lines that are filtered repeatedly first, which decide the
+ *                  order the terms of an '&&' or '||' are run in.
+ *
+ */
+static void testReorderedBatch(const std::string expr,
+                               const std::string headerStr,
+                               const std::vector<std::string>& profiled,
+                               const std::vector<std::string>& lines,
+                               const std::string& expected) {
+    std::stringstream group;
+    group << "Eval reordered batch " << expr;
+    Test::beginGroup(group.str());
+
+    LineParser l;
+    char* headers = strdup(headerStr.c_str());
+    l.parse(headers);
+    Headers h(l, std::vector<std::string>() );
+
+    Expression e(expr, h);
+    Test::eq(e.ok(), true, "Expression parser is ok");
+
+    LineBatch batch;
+    batch.setFieldLimit(e.highestColumn() + 1);
+    for (size_t i = 0; i < profiled.size(); i++) {
+        batch.add(profiled[i].data(), profiled[i].size());
+    }
+    std::vector<unsigned char> matches;
+    bool ok = true;
+    for (int i = 0; i < 16; i++) {
+        ok = ok && (e.evalBatch(batch, matches) == batch.size());
+    }
+    Test::that(ok, "Profiled lines are filtered");
+    checkBatch(e, lines, expected);
+
+    Test::endGroup();
+    free(headers);
+}
+
+static std::vector<std::string> makeLines(const char* line, ...) {
+    std::vector<std::string> lines;
+    va_list va;
+    va_start(va, line);
+    while (line != nullptr) {
+        lines.push_back(line);
+        line = va_arg(va, const char*);
+    }
+    va_end(va);
+    return lines;
+}
+
+/**
+ * @brief Read a set of values from a pipe, which can only be read once.
+ *
+ * The clone of the expression must share the set rather than read the pipe
+ * again.
+ *
+ */
+static void testSetFromPipe() {
+    Test::beginGroup("Sets read from a pipe");
+
+    int fds[2];
+    Test::that(pipe(fds) == 0, "Pipe created");
+    Test::eq(static_cast<size_t>(write(fds[1], "x\ny\n", 4)),
+             static_cast<size_t>(4), "Set written");
+    close(fds[1]);
+
+    LineParser l;
+    char* headers = strdup("a");
+    l.parse(headers);
+    Headers h(l, std::vector<std::string>() );
+
+    std::stringstream expr;
+    expr << "a in @/dev/fd/" << fds[0];
+    Expression e(expr.str(), h);
+    Test::eq(e.ok(), true, "Expression parser is ok");
+    std::unique_ptr<Expression> copy(e.clone());
+    Test::eq(copy->ok(), true, "Cloned expression is ok");
+    close(fds[0]);
+
+    char* line = strdup("y");
+    l.parse(line);
+    checkResult(e.eval(l), Variant::boolean(true), "Original");
+    checkResult(copy->eval(l), Variant::boolean(true), "Cloned");
 
     Test::endGroup();
     free(headers);
@@ -100,14 +311,16 @@ void expressionParserTests() {
     Test::beginSuite("Expression parsing");
     testParse("token", "token", "token~0:unknown"); // simple token
     testParse("t1 + t3", "t1,t2,t3", "(+ t1~0:unknown t3~2:unknown):unknown");
-    testParse("1-2+3", "a", "(+ (- 1:number 2:number):number 3:number):number");
-    testParse("1*3", "a", "(* 1:number 3:number):number");
-    testParse("1-2*3", "a", "(- 1:number (* 2:number 3:number):number):number");
-    testParse(
-        "1/2+3*4",
-        "a",
-        "(+ (/ 1:number 2:number):number (* 3:number 4:number):number):number");
-    testParse("1-2*3", "a", "(- 1:number (* 2:number 3:number):number):number");
+    // constant parts of the tree are worked out up front
+    testParse("1-2+3", "a", "2:number");
+    testParse("1*3", "a", "3:number");
+    testParse("1-2*3", "a", "-5:number");
+    testParse("1/2+3*4", "a", "12.5:number");
+    testParse("0.1+0.2", "a", "0.30000000000000004:number");
+    testParse("\"a\"+\"b\"", "a", "ab:string");
+    testParse("a-2*3", "a", "(- a~0:number 6:number):number");
+    testParse("a*(1+2)-b", "a,b",
+              "(- (* a~0:number 3:number):number b~1:number):number");
 
     // this error is passed up from the lexer
     testFailedParse("\"an incomplete ", "a",
@@ -126,6 +339,38 @@ void expressionParserTests() {
                     ParseError("Identifier \"col\" not found in headers",
                                Range(4, 7)));
 
+    // the fields the expression reads
+    testHighestColumn("1 + 2 == 3", "a,b,c", -1);
+    testHighestColumn("b == 3", "a,b,c", 1);
+    testHighestColumn("a == 1 || -c < b", "a,b,c", 2);
+
+    // the text a line must contain to match, with alternatives separated by
+    // '|'
+    testRequiredText("a == \"fred\"", "a,b", "fred");
+    testRequiredText("\"fred\" == a", "a,b", "fred");
+    testRequiredText("a == \"\"", "a,b", "");
+    testRequiredText("a != \"fred\"", "a,b", "");
+    testRequiredText("a < \"fred\"", "a,b", "");
+    testRequiredText("a + \"x\" == \"fredx\"", "a,b", "");
+    testRequiredText("a == b", "a,b", "");
+    testRequiredText("a == \"x\" && b == \"fred\"", "a,b", "fred");
+    testRequiredText("a == \"fred\" && b == \"x\"", "a,b", "fred");
+    testRequiredText("a == \"x\" && b != \"y\"", "a,b", "x");
+    testRequiredText("a == \"x\" || b == \"fred\"", "a,b", "x|fred");
+    testRequiredText("a == \"x\" || b == \"x\"", "a,b", "x");
+    testRequiredText("a == \"x\" || b != \"y\"", "a,b", "");
+    testRequiredText("a == \"1\" || a == \"2\" || a == \"3\" || "
+                     "a == \"4\"", "a,b", "1|2|3|4");
+    testRequiredText("a == \"1\" || a == \"2\" || a == \"3\" || "
+                     "a == \"4\" || a == \"5\"", "a,b", "");
+    testRequiredText("a == \"1\" || a == \"2\" || a == \"3\" || "
+                     "a == \"4\" || a == \"5\" || a == \"6\"", "a,b", "");
+    testRequiredText("a != \"y\" || b == \"x\"", "a,b", "");
+    // fields that are not numbers would make these fail, which skipping the
+    // line would hide
+    testRequiredText("a == \"fred\" && b == 1", "a,b", "");
+    testRequiredText("b > 1 || a == \"fred\"", "a,b", "");
+
     // Tests for type detection
 
     // * can only be applied to numbers
@@ -142,12 +387,37 @@ void expressionParserTests() {
     testParse("a<1", "a,b", "(< a~0:number 1:number):boolean");
     testParse("a<\"b\"", "a,b", "(< a~0:string b:string):boolean");
 
-    testParse("-1", "a,b", "(- 1:number):number");
-    testParse("--1", "a,b", "(- (- 1:number):number):number");
-    testParse("3 + -1", "a,b", "(+ 3:number (- 1:number):number):number");
-    testParse("3 - -1", "a,b", "(- 3:number (- 1:number):number):number");
-    testParse("3 - --1", "a,b",
-              "(- 3:number (- (- 1:number):number):number):number");
+    testParse("-1", "a,b", "-1:number");
+    testParse("--1", "a,b", "1:number");
+    testParse("3 + -1", "a,b", "2:number");
+    testParse("3 - -1", "a,b", "4:number");
+    testParse("3 - --1", "a,b", "2:number");
+    testParse("-a", "a,b", "(- a~0:number):number");
+    testParse("--(a * 2)", "a,b", "(* a~0:number 2:number):number");
+    // the minus checks that a field is a number, so must be kept
+    testParse("--a", "a,b", "(- (- a~0:number):number):number");
+
+    // arithmetic is moved to the constant side of comparisons, where that
+    // gives the same result for every value of the field
+    testParse("- a < - 0.5", "a", "(> a~0:number 0.5:number):boolean");
+    testParse("0.5 > -a", "a", "(> a~0:number -0.5:number):boolean");
+    testParse("a * 2 + 1 >= 7", "a", "(>= a~0:number 3:number):boolean");
+    testParse("10 - a == 4", "a", "(== a~0:number 6:number):boolean");
+    testParse("a / 4 != 2", "a", "(!= a~0:number 8:number):boolean");
+    // rounding means that a + 1 < 1.5 for values of a just below 0.5
+    testParse("1 + a < 1.5", "a",
+              "(< a~0:number 0.4999999999999999:number):boolean");
+    // only one value of a gives a * 0.1 == 0.3, but many give a + 2^53 == 2^53
+    testParse("a * 0.1 == 0.3", "a",
+              "(== a~0:number 2.9999999999999996:number):boolean");
+    testParse("a + 9007199254740992 == 9007199254740992", "a",
+              "(== (+ a~0:number 9007199254740992:number):number "
+                  "9007199254740992:number):boolean");
+    // not monotonic
+    testParse("1 / a < 2", "a",
+              "(< (/ 1:number a~0:number):number 2:number):boolean");
+    testParse("a * 0 < 2", "a",
+              "(< (* a~0:number 0:number):number 2:number):boolean");
 
     testFailedParse("-", "nocol",
                     ParseError("Unexpected end of expression", Range(1, 2)));
@@ -159,6 +429,10 @@ void expressionParserTests() {
               "a,b",
               "(|| (< 1:number 2:number):boolean (< a~0:unknown b~1:unknown)"
                   ":boolean):boolean");
+    testParse("1+1<2 || a<b+\"c\"",
+              "a,b",
+              "(|| (< 2:number 2:number):boolean (< a~0:string (+ b~1:string "
+                  "c:string):string):boolean):boolean");
     
     // mismatched types
     testFailedParse(
@@ -189,9 +463,8 @@ void expressionParserTests() {
 
 
     // braces
-    testParse("1 * (3 + 5)",
-              "a,b",
-              "(* 1:number (+ 3:number 5:number):number):number");
+    testParse("1 * (3 + 5)", "a,b", "8:number");
+    testParse("a * (3 + 5)", "a,b", "(* a~0:number 8:number):number");
            
     testFailedParse(
         "(1 + 2", "a",
@@ -250,7 +523,7 @@ void expressionParserTests() {
         "10",
         Variant::string("10"));
 
-    testEval("a + 10", "a", "20", Variant::number(30));
+    testEval("a + 10", "a", "20", Variant::integer(30));
     testEval("a + \"end\"", "a", "abcdef", Variant::string("abcdefend"));
     testEval("a + \"end\"", "a", "123", Variant::string("123end"));
     
@@ -268,8 +541,8 @@ void expressionParserTests() {
         Variant::error("Left hand side of operator at 2: expected number, got "
                        "string"));
     
-    testEval("a - 10", "a", "5", Variant::number(-5));
-    testEval("a * 10", "a", "7", Variant::number(70));
+    testEval("a - 10", "a", "5", Variant::integer(-5));
+    testEval("a * 10", "a", "7", Variant::integer(70));
     testEval("a / 10", "a", "3", Variant::number(0.3));
     
     testEval("a < 10", "a", "3", Variant::boolean(true));
@@ -278,6 +551,13 @@ void expressionParserTests() {
     testEval("a < 10", "a","blah",  Variant::error("Left hand side of operator "
                                                    "at 2: expected number, got "
                                                    "string"));
+    testEval("b < 10 - a",
+             "a,b",
+             "abc,1",
+             Variant::error("Right hand side of operator at 7: expected number,"
+                            " got string"));
+    // simplified to a comparison of a with a constant, which reports a as the
+    // subtraction would have
     testEval("10 < 10 - a",
              "a",
              "abc",
@@ -303,6 +583,11 @@ void expressionParserTests() {
     testEval("a >= 10", "a", "3", Variant::boolean(false));
     testEval("a >= 10", "a", "12", Variant::boolean(true));
     testEval("a >= 10", "a", "10", Variant::boolean(true));
+    testEval("a + b >= 10",
+             "a,b",
+             "abc,10",
+             Variant::error("Left hand side of operator at 2: expected number, "
+                            "got string"));
     testEval("a + 10 >= 10",
              "a",
              "abc",
@@ -360,11 +645,204 @@ void expressionParserTests() {
     testEval("8 < 12 || a < 4", "a", "notused", Variant::boolean(true));
 
     // unary minus
-    testEval("-3", "a", "1", Variant::number(-3));
-    testEval("--3", "a", "1", Variant::number(3));
-    testEval("1 - -3", "a", "1", Variant::number(4));
-    testEval("1 + -7", "a", "1", Variant::number(-6));
-    testEval("-a", "a", "1", Variant::number(-1));
+    testEval("-3", "a", "1", Variant::integer(-3));
+    testEval("--3", "a", "1", Variant::integer(3));
+    testEval("1 - -3", "a", "1", Variant::integer(4));
+    testEval("1 + -7", "a", "1", Variant::integer(-6));
+    testEval("-a", "a", "1", Variant::integer(-1));
+
+    // the type of fields compared with each other depends on the line
+    testEval("a < b", "a,b", "9,10", Variant::boolean(true));
+    testEval("a < b", "a,b", "x9,10", Variant::boolean(false));
+    testEval("a + b", "a,b", "1,2", Variant::integer(3));
+    testEval("a + b", "a,b", "1,x", Variant::string("1x"));
+    testEval("a + b < c", "a,b,c", "1,2,4", Variant::boolean(true));
+    testEval("a + b < c", "a,b,c", "1,2,2", Variant::boolean(false));
+    testEval("a + b < c", "a,b,c", "1,x,12", Variant::boolean(false));
+    testEval("a + b < c", "a,b,c", "1,2,x",
+             Variant::error("Left hand side of operator at 6: expected "
+                            "string, got number"));
+    testEval("a + b + c == \"123\"", "a,b,c", "1,2,3",
+             Variant::boolean(true));
+    testEval("-a < b || b == \"x\"", "a,b", "y,x",
+             Variant::error("The unary operator at 0 expects arguments of "
+                            "type number (got string)"));
+    testEval("b == \"x\" || -a < b", "a,b", "y,x", Variant::boolean(true));
+    testEval("b == \"y\" || -a < b", "a,b", "y,x",
+             Variant::error("The unary operator at 12 expects arguments of "
+                            "type number (got string)"));
+
+    // comparisons of a field with a constant are a single instruction
+    testEval("a == \"x,y\"", "a", "\"x,y\"", Variant::boolean(true));
+    testEval("a > \"x\"", "a", "\"x\"\"\"", Variant::boolean(true));
+    testEval("a >= 2.5", "a", "2.5", Variant::boolean(true));
+    testEval("a >= 2.5", "a", "\"2.5\"",
+             Variant::error("Left hand side of operator at 2: expected number, "
+                            "got string"));
+
+    // simplified comparisons give the same results
+    testEval("1 + a < 1.5", "a", "0.4999999999999999", Variant::boolean(false));
+    testEval("1 + a < 1.5", "a", "0.49999999999999983",
+             Variant::boolean(true));
+    testEval("a * 0.1 == 0.3", "a", "3", Variant::boolean(false));
+    testEval("a * 0.1 == 0.3", "a", "2.9999999999999996",
+             Variant::boolean(true));
+    testEval("- a < - 0.5", "a", "0.5", Variant::boolean(false));
+    testEval("- a < - 0.5", "a", "0.6", Variant::boolean(true));
+    testEval("3 - --a", "a", "1", Variant::integer(2));
+    testEval("1 / (a * -1) < 0", "a", "0", Variant::boolean(true));
+    testEval("1 / -a < 0", "a", "0", Variant::boolean(true));
+    // when both sides of a comparison fail, the left hand side is reported
+    testEval("(a * b) < ((0 + b) + (b * a))", "a,b", "x,y",
+             Variant::error("Left hand side of operator at 3: expected number, "
+                            "got string"));
+    testEval("- - c == b", "c,b", "x,x",
+             Variant::error("The unary operator at 2 expects arguments of type "
+                            "number (got string)"));
+    testEval("-a < 0", "a", "y",
+             Variant::error("The unary operator at 0 expects arguments of type "
+                            "number (got string)"));
+
+    // a failing simplified comparison gives the same error as one that cannot
+    // be simplified, because it is compared with a field
+    testEval("mix + 1 >= 4", "mix,b", "abc,4",
+             Variant::error("Left hand side of operator at 4: expected number, "
+                            "got string"));
+    testEval("mix + 1 >= b", "mix,b", "abc,4",
+             Variant::error("Left hand side of operator at 4: expected number, "
+                            "got string"));
+    testEval("3 < 2 * (a - 1) + 1", "a,b", "x,3",
+             Variant::error("Left hand side of operator at 11: expected "
+                            "number, got string"));
+    testEval("b < 2 * (a - 1) + 1", "a,b", "x,3",
+             Variant::error("Left hand side of operator at 11: expected "
+                            "number, got string"));
+    testEvalBatch("a * 2 > 4", "a,b", makeLines("3,5", "x,5", nullptr), "1");
+    testEvalBatch("a * 2 > b", "a,b", makeLines("3,5", "x,5", nullptr), "1");
+
+    // integers are exact, even past 2^53
+    testEval("a == 9007199254740993", "a", "9007199254740992",
+             Variant::boolean(false));
+    testEval("a > 9007199254740992", "a", "9007199254740993",
+             Variant::boolean(true));
+    testEval("a + 1 == 9223372036854775807", "a", "9223372036854775806",
+             Variant::boolean(true));
+    testEval("a - b", "a,b", "1700000000000000001,1700000000000000000",
+             Variant::integer(1));
+    testEval("a == 1.0", "a", "1", Variant::boolean(true));
+    testEval("a < 0.5", "a", "0", Variant::boolean(true));
+    testEval("a < b", "a,b", "9007199254740993,9007199254740992.5",
+             Variant::boolean(false));
+    testEval("a / 2", "a", "7", Variant::number(3.5));
+    testEval("a * 2", "a", "9223372036854775807",
+             Variant::number(18446744073709551614.0));
+    testEval("-a", "a", "-9223372036854775808",
+             Variant::number(9223372036854775808.0));
+    testEval("a - 1 < 9007199254740992", "a", "9007199254740993",
+             Variant::boolean(false));
+    testEval("a + 1 < 5", "a", "3", Variant::boolean(true));
+    testEval("a + 1 < 5", "a", "4", Variant::boolean(false));
+
+    // a batch of lines gives the same results as each line on its own
+    testEvalBatch("a < 5", "a,b", makeLines("1,x", "7,y", "4,z", nullptr),
+                  "101");
+    testEvalBatch("b == \"y\" && a * 2 > 4", "a,b",
+                  makeLines("1,y", "3,y", "9,n", "x,n", "5,y", nullptr),
+                  "01001");
+    testEvalBatch("a < 0.5 || b < 3", "a,b",
+                  makeLines("0.1,x", "0.9,2", "0.9,4", nullptr), "110");
+    // evaluation stops at the first line that fails
+    testEvalBatch("a * 2 > 4", "a", makeLines("1", "3", "x", "5", nullptr),
+                  "01");
+    testEvalBatch("a > 4", "a,b", makeLines("5,p", "x,q", "6,r", nullptr),
+                  "1");
+    testEvalBatch("a == \"x\"", "a", makeLines(nullptr), "");
+    testEvalBatch("a", "a", makeLines("1", "2", nullptr), "00");
+    testEvalBatch("a < 5 && c == \"z\" && b > 1", "a,b,c",
+                  makeLines("9,x,z", "1,2,z", "1,2,\"z\"", "4,x,y",
+                            "2,x,z", nullptr),
+                  "0110");
+
+    // chains of '&&' and '||' are compiled as a list of terms
+    testEval("a == \"x\" && (b == \"y\" || c == \"z\") && c != \"q\"",
+             "a,b,c", "x,n,z", Variant::boolean(true));
+    testEval("a == \"x\" || b == \"y\" || c == \"z\"", "a,b,c", "n,n,n",
+             Variant::boolean(false));
+
+    // the terms are run in a better order once the expression has been
+    // profiled, without changing the results or the errors
+    testReorderedBatch("b == \"y\" && c == \"z\" && a < 5", "a,b,c",
+                       makeLines("9,y,z", "8,y,z", nullptr),
+                       makeLines("3,y,z", "1,n,z", "7,y,z", nullptr), "100");
+    testReorderedBatch("b == \"y\" && a < 5", "a,b",
+                       makeLines("9,y", "8,y", nullptr),
+                       makeLines("3,y", "x,n", "4,n", "x,y", "1,y", nullptr),
+                       "100");
+    testReorderedBatch("a < 5 && b == \"y\"", "a,b",
+                       makeLines("1,n", "2,n", nullptr),
+                       makeLines("3,y", "x,n", "4,n", nullptr), "1");
+    testReorderedBatch("b == \"y\" || a < 5", "a,b",
+                       makeLines("1,n", "2,n", nullptr),
+                       makeLines("3,n", "x,y", "7,n", "x,n", nullptr),
+                       "110");
+    testReorderedBatch("(a == \"p\" || a == \"q\") && b == \"y\"", "a,b",
+                       makeLines("p,n", "q,n", "r,n", nullptr),
+                       makeLines("p,y", "q,n", "r,y", nullptr), "100");
+
+    // sets
+    testParse("a in (\"x\", \"y\")", "a",
+              "(in a~0:string {x, y}):boolean");
+    testParse("a + 1 in (2, -3.5)", "a",
+              "(in (+ a~0:number 1:number):number {2, -3.5}):boolean");
+    testParse("_in in (1)", "in", "(in _in~0:number {1}):boolean");
+    testFailedParse("a in (\"x\", 1)", "a",
+                    ParseError("The values in a set must all be strings, or "
+                               "all be numbers", Range(11, 12)));
+    testFailedParse("a in ()", "a",
+                    ParseError("Expected a string or number constant",
+                               Range(6, 7)));
+    testFailedParse("a in (\"x\" \"y\")", "a",
+                    ParseError("Expected ',' or ')'", Range(10, 13)));
+    testFailedParse("a in b", "a,b",
+                    ParseError("Expected a bracketed list of values, or a "
+                               "file, after 'in'", Range(5, 6)));
+    testFailedParse("a, b", "a,b",
+                    ParseError("Unexpected operator", Range(1, 2)));
+    testFailedParse("a + \"x\" in (1)", "a",
+                    ParseError("'in' expects a number to look up in a set of "
+                               "numbers (got a string)",
+                               Range(8, 10),
+                               Range(0, 7)));
+    testFailedParse("a in @no/such/file", "a",
+                    ParseError("Could not read \"no/such/file\"",
+                               Range(5, 18)));
+    testSetFromPipe();
+
+    testEval("a in (\"x\", \"y\")", "a", "y", Variant::boolean(true));
+    testEval("a in (\"x\", \"y\")", "a", "z", Variant::boolean(false));
+    testEval("a in (\"x\", \"y\")", "a", "\"x\"", Variant::boolean(true));
+    testEval("a in (\"x\", \"x\", \"\")", "a,b", ",1", Variant::boolean(true));
+    // numbers are looked up the way '==' compares them
+    testEval("a in (3, -7)", "a", "3.0", Variant::boolean(true));
+    testEval("a in (3.0)", "a", "3", Variant::boolean(true));
+    testEval("a in (-7)", "a", "-7", Variant::boolean(true));
+    testEval("a in (9007199254740993)", "a", "9007199254740992",
+             Variant::boolean(false));
+    testEval("a in (0.5, 2)", "a", "0.25", Variant::boolean(false));
+    testEval("a in (3)", "a", "abc",
+             Variant::error("Left hand side of operator at 2: expected number, "
+                            "got string"));
+    testEval("a in (\"x\") || b in (1, 2)", "a,b", "y,2",
+             Variant::boolean(true));
+    testEvalBatch("a in (1, 3, 5) && b in (\"x\")", "a,b",
+                  makeLines("1,x", "2,x", "3,y", "5,x", "y,x", nullptr),
+                  "1001");
+
+    testRequiredText("a in (\"fred\", \"joe\")", "a,b", "fred|joe");
+    testRequiredText("a in (\"fred\", \"\")", "a,b", "");
+    testRequiredText("a in (1, 2)", "a,b", "");
+    testRequiredText("a in (\"1\", \"2\", \"3\", \"4\", \"5\")", "a,b", "");
+    testHighestColumn("b in (1)", "a,b,c", 1);
 
     Test::endSuite();
 }
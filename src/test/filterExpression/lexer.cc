@@ -82,6 +82,25 @@ static void testStringToken(const std::string& input,
     Test::endGroup();
 }
 
+static void testFileToken(const std::string& input,
+                          const std::string& path) {
+    std::stringstream group;
+    group << "File token " << input;
+    Test::beginGroup(group.str());
+    Lexer l(input);
+    if (Test::that(l.ok(), "Lexer is ok")) {
+        testToken(l.pop(),
+                  LexToken::TYPE_FILE,
+                  path,
+                  Range(0, input.length()));
+        testToken(l.pop(),
+                  LexToken::TYPE_EOF,
+                  "",
+                  Range(input.length(), input.length() + 1));
+    }
+    Test::endGroup();
+}
+
 static void testMultipleTokens() {
     Test::beginGroup("Multiple tokens");
     Lexer l("  1 + 2 - \"abc\"\t/\n7  ");
@@ -135,6 +154,7 @@ static void testIdentifierFunctions() {
     testNotIdentifier("a ");
     testNotIdentifier("1");
     testNotIdentifier("-a");
+    testNotIdentifier("in");
     Test::endGroup();
 
     Test::beginGroup("Identifier creation");
@@ -143,6 +163,7 @@ static void testIdentifierFunctions() {
     testCreateIdentifier("1b", "_1b");
     testCreateIdentifier(" ", "_");
     testCreateIdentifier("a heading", "a_heading");
+    testCreateIdentifier("in", "_in");
     Test::endGroup();
 
 }
@@ -164,6 +185,8 @@ void lexerTests() {
     testSimpleToken(">=", LexToken::TYPE_GTE);
     testSimpleToken("&&", LexToken::TYPE_AND);
     testSimpleToken("||", LexToken::TYPE_OR);
+    testSimpleToken("in", LexToken::TYPE_IN);
+    testSimpleToken(",", LexToken::TYPE_COMMA);
     testForError("=",
                  ParseError("Unrecognised token. Did you mean  '=='?",
                             Range(0, 1)));
@@ -194,6 +217,10 @@ void lexerTests() {
                  ParseError("Unterminated string constant", Range(0, 5)));
     testSimpleToken("1234", LexToken::TYPE_NUMBER);
     testSimpleToken("12.324", LexToken::TYPE_NUMBER);
+    testFileToken("@codes.txt", "codes.txt");
+    testFileToken("@\"a file.txt\"", "a file.txt");
+    testForError("@", ParseError("Expected a file name after '@'",
+                                 Range(0, 1)));
 
     testMultipleTokens();
 
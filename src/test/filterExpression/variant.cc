@@ -0,0 +1,112 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#include <app/filterExpression/variant.h>
+
+#include "../test.h"
+
+#include <string>
+#include <math.h>
+
+static void testOwnedStrings() {
+    Test::beginGroup("Owned strings");
+
+    std::string src = "fred";
+    VariantRef v = Variant::string(src);
+    src[0] = 'b';
+    Test::eq(v->charVal(), "fred", "Created string is a copy");
+
+    v->resetToString(src);
+    src[0] = 'x';
+    Test::eq(v->charVal(), "bred", "Reset string is a copy");
+
+    v->resetToString("a much longer string than before");
+    Test::eq(v->charVal(), "a much longer string than before",
+             "Reset to a longer string");
+
+    v->resetToString(v->charVal() + 2);
+    Test::eq(v->charVal(), "much longer string than before",
+             "Reset to part of its own value");
+
+    v->resetToNumber(3.0);
+    v->resetToError("oops");
+    Test::eq(v->type() == Variant::ERROR, true, "Reset to error");
+    Test::eq(v->charVal(), "oops", "Error message");
+
+    Test::endGroup();
+}
+
+static void testStringViews() {
+    Test::beginGroup("String views");
+
+    char buf[] = "fred";
+    VariantRef v = Variant::string("owned");
+    v->resetToStringView(buf);
+    Test::eq(v->type() == Variant::STRING, true, "View is a string");
+    Test::that(v->charVal() == buf, "View is not copied");
+
+    buf[0] = 'b';
+    Test::eq(v->charVal(), "bred", "View follows its storage");
+
+    v->resetToString("owned again");
+    buf[0] = 'f';
+    Test::eq(v->charVal(), "owned again", "Owned again after a view");
+
+    Test::endGroup();
+}
+
+static void testIntegers() {
+    Test::beginGroup("Integers");
+
+    VariantRef v = Variant::integer(9007199254740993LL);
+    Test::eq(v->type() == Variant::INTEGER, true, "Integer type");
+    Test::eq(v->isNumber(), true, "Integers are numbers");
+    Test::that(v->integerVal() == 9007199254740993LL, "Integer is exact");
+    Test::that(v->asNumber().isInteger(), "Integer as a number");
+
+    v->resetToNumber(Number::real(2.5));
+    Test::eq(v->type() == Variant::NUMBER, true, "Reset to a double");
+    Test::eq(v->numberVal(), 2.5, "Double value");
+
+    v->resetToNumber(Number::integer(-3));
+    Test::eq(v->type() == Variant::INTEGER, true, "Reset to an integer");
+    Test::eq(v->numberVal(), -3.0, "Integer as a double");
+
+    Test::endGroup();
+}
+
+static void testNegativeZero() {
+    Test::beginGroup("Negative zero");
+
+    Number zero = Number::integer(0);
+    Number minusOne = Number::integer(-1);
+
+    Number negated = zero.negate();
+    Test::that(!negated.isInteger(), "Negated zero is a double");
+    Test::that(signbit(negated.doubleVal()), "Negated zero is negative");
+
+    Number product = zero.multiply(minusOne);
+    Test::that(!product.isInteger(), "Zero times a negative is a double");
+    Test::that(signbit(product.doubleVal()), "Zero times a negative is -0");
+    Test::that(signbit(minusOne.multiply(zero).doubleVal()),
+               "A negative times zero is -0");
+    Test::that(zero.multiply(zero).isInteger(), "Zero times zero is 0");
+    Test::that(zero.multiply(Number::integer(2)).isInteger(),
+               "Zero times a positive is 0");
+    Test::that(Number::integer(1).divide(product).doubleVal() < 0,
+               "Dividing by -0 gives -inf");
+
+    Test::endGroup();
+}
+
+void variantTests() {
+    Test::beginSuite("Variant");
+
+    testOwnedStrings();
+    testStringViews();
+    testIntegers();
+    testNegativeZero();
+
+    Test::endSuite();
+}
@@ -41,7 +41,7 @@ static void testValidHeaderLine() {
 static void testRepeatedHeaders() {
     Test::beginGroup("Header with repeating heading");
 
-    char* lineStr = strdup("a,b,a,s p a c e");
+    char* lineStr = strdup("a,b,a,s p a c e,in");
     LineParser line;
     std::vector<std::string> outCols;
 
@@ -55,6 +55,10 @@ static void testRepeatedHeaders() {
     Test::eq(headers.indexOf("a1"), 2, "Index of a1");
     Test::eq(headers.indexOf("s p a c e"), 3, "Index of s p a c e");
     Test::eq(headers.indexOf("s_p_a_c_e"), 3, "Index of s_p_a_c_e");
+    Test::eq(headers.indexOf("in"), 4, "Index of in");
+    Test::eq(headers.indexOf("_in"), 4, "Index of _in");
+    // the aliases are not output as extra columns
+    Test::eq(headers.outColCount(), 5, "5 output cols");
 
     free(lineStr);
 
@@ -81,6 +85,7 @@ static void testDefaultOutputCols() {
             
         }
     }
+    Test::that(headers.outputsAllCols(), "All cols are output");
     free(lineStr);
 
     Test::endGroup();
@@ -128,6 +133,11 @@ static void testValidOutputCols() {
     Test::eq(headers.outColIdx(2), 0, "Index 2 is correct");
     Test::eq(headers.outColIdx(3), 3, "Index 3 is correct");
     Test::eq(headers.outColIdx(4), 6, "Index 4 is correct");
+    Test::eq(headers.outputsAllCols(), false, "Not all cols are output");
+
+    std::vector<std::string> allCols{"a", "b", "c", "d", "e", "f", "g"};
+    Headers all(line, allCols);
+    Test::that(all.outputsAllCols(), "Listing every col outputs all cols");
 
     free(lineStr);
 
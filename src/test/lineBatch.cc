@@ -0,0 +1,140 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#include <app/lineBatch.h>
+
+#include "test.h"
+
+#include <sstream>
+#include <string>
+#include <string.h>
+
+static std::string rawVal(const Field& f) {
+    return std::string(f.raw(), f.length());
+}
+
+static void testFields() {
+    Test::beginGroup("Fields are stored for each line");
+
+    const char* lines[] = { "a,b,c", "1,\"x,y\",3", "d,,f" };
+    LineBatch batch;
+    batch.setFieldLimit(3);
+    for (size_t i = 0; i < 3; i++) {
+        Test::that(batch.add(lines[i], strlen(lines[i])), "Line added");
+    }
+    Test::eq(batch.size(), static_cast<size_t>(3), "Batch has three lines");
+
+    Test::eq(rawVal(batch.field(0, 0)), "a", "First field of first line");
+    Test::eq(rawVal(batch.field(2, 0)), "c", "Last field of first line");
+    Test::eq(rawVal(batch.field(1, 1)), "\"x,y\"", "Quoted field");
+    Test::eq(batch.field(1, 1).asString(), "x,y", "Quoted field unescaped");
+    Test::eq(rawVal(batch.field(1, 2)), "", "Empty field");
+    Test::eq(rawVal(batch.row(2).field(2)), "f", "Field from a row");
+    Test::that(batch.line(1) == lines[1], "Line is not copied");
+    Test::eq(batch.length(1), strlen(lines[1]), "Line length");
+
+    Test::endGroup();
+}
+
+static void testLazyFields() {
+    Test::beginGroup("Fields are found when they are used");
+
+    const char* lines[] = { "a,bb,ccc,d", "\"e\",\"f,g\",h,i", "j,k,,l" };
+    LineBatch batch;
+    batch.setFieldLimit(3);
+    for (size_t i = 0; i < 3; i++) {
+        Test::that(batch.add(lines[i], strlen(lines[i])), "Line added");
+        Test::eq(batch.fieldCount(i), static_cast<size_t>(4), "Fields counted");
+    }
+
+    Test::eq(rawVal(batch.field(2, 0)), "ccc", "Later field first");
+    Test::eq(rawVal(batch.field(0, 0)), "a", "Then an earlier one");
+    Test::eq(rawVal(batch.field(1, 0)), "bb", "Then the one in between");
+    Test::eq(rawVal(batch.field(1, 1)), "\"f,g\"", "Quoted line");
+    Test::eq(rawVal(batch.field(2, 2)), "", "Empty field");
+    Test::eq(rawVal(batch.field(1, 2)), "k", "Field before it");
+
+    Test::endGroup();
+}
+
+static void testFieldLimit() {
+    Test::beginGroup("Fields after the limit are counted");
+
+    const char* line = "a,b,c,d";
+    LineBatch batch;
+    batch.setFieldLimit(2);
+    Test::that(batch.add(line, strlen(line)), "Line added");
+    Test::eq(batch.fieldCount(0), static_cast<size_t>(4), "All fields counted");
+    Test::eq(rawVal(batch.field(1, 0)), "b", "Last field kept");
+
+    LineBatch none;
+    Test::that(none.add(line, strlen(line)), "Line added with no fields kept");
+    Test::eq(none.fieldCount(0), static_cast<size_t>(4), "Fields counted");
+
+    Test::endGroup();
+}
+
+static void testBadLine() {
+    Test::beginGroup("Lines that do not parse are not added");
+
+    const char* good = "a,b";
+    const char* bad = "a,\"b";
+    LineBatch batch;
+    batch.setFieldLimit(2);
+    Test::that(batch.add(good, strlen(good)), "Good line added");
+    Test::eq(batch.add(bad, strlen(bad)), false, "Bad line not added");
+    Test::eq(batch.errText(), "Unterminated string field", "Error text");
+    Test::eq(batch.size(), static_cast<size_t>(1), "Batch has one line");
+
+    Test::endGroup();
+}
+
+static void testFillAndClear() {
+    Test::beginGroup("Filling and clearing the batch");
+
+    std::vector<std::string> lines;
+    for (size_t i = 0; i < LineBatch::CAPACITY; i++) {
+        std::stringstream line;
+        line << i << ",x" << i;
+        lines.push_back(line.str());
+    }
+
+    LineBatch batch;
+    batch.setFieldLimit(2);
+    for (size_t i = 0; i < lines.size(); i++) {
+        if (i == lines.size() - 1) {
+            Test::that(!batch.full(), "Batch is not full");
+        }
+        batch.add(lines[i].data(), lines[i].size());
+    }
+    Test::that(batch.full(), "Batch is full");
+    Test::eq(rawVal(batch.field(1, LineBatch::CAPACITY - 1)),
+             lines.back().substr(lines.back().find(',') + 1),
+             "Last line is intact");
+    Number first;
+    Test::that(batch.field(0, 0).asNumber(first) && first.isInteger() &&
+               first.integerVal() == 0, "First line is intact");
+
+    batch.removeLast();
+    Test::eq(batch.size(), LineBatch::CAPACITY - 1, "Last line removed");
+
+    batch.clear();
+    Test::eq(batch.size(), static_cast<size_t>(0), "Batch is empty");
+    Test::that(batch.add(lines[5].data(), lines[5].size()), "Line re-added");
+    Test::eq(rawVal(batch.field(0, 0)), "5", "Batch reused from the start");
+
+    Test::endGroup();
+}
+
+void lineBatchTests() {
+    Test::beginSuite("Batches of lines");
+
+    testFields();
+    testLazyFields();
+    testFieldLimit();
+    testBadLine();
+    testFillAndClear();
+
+    Test::endSuite();
+}
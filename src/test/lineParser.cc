@@ -12,6 +12,10 @@
 #include <string.h>
 #include <stdlib.h>
 
+static std::string rawVal(const Field& f) {
+    return std::string(f.raw(), f.length());
+}
+
 void testLine(const char* line, ...) {
     va_list va;
     va_start(va, line);
@@ -41,7 +45,7 @@ void testLine(const char* line, ...) {
     for (int i = 0; i < minLen; i++) {
         std::stringstream valMsg;
         valMsg << "Field " << i << ", raw value is " << expectedVals[i];
-        Test::eq(p.field(i)->raw(), expectedVals[i], valMsg.str());
+        Test::eq(rawVal(p.field(i)), expectedVals[i], valMsg.str());
     }
 
     free(lineCpy);
@@ -73,9 +77,71 @@ void lineParserTests() {
     testLine("\"a,b\"", "\"a,b\"", NULL);
     testLine("\"a,b\",abc", "\"a,b\"", "abc", NULL);
     testLine("\"a\"\"b\"", "\"a\"\"b\"", NULL);
+    testLine("\"a\nb\",c", "\"a\nb\"", "c", NULL);
 
     testBadLine("\"abc", "Unterminated string field");
     testBadLine("\"abc\"a", "Unexpected characters after string field");
+
+    // fields and quotes either side of the 64 byte blocks the line is
+    // indexed in
+    std::string wide;
+    for (int i = 0; i < 30; i++) {
+        wide += "abc,\"d,\"\"e\",";
+    }
+    wide += "end";
+    LineParser p;
+    std::vector<char> wideCpy(wide.begin(), wide.end());
+    wideCpy.push_back('\0');
+    Test::that(p.parse(&wideCpy[0]), "Wide line parses");
+    Test::eq(p.fieldCount(), static_cast<size_t>(61), "Wide line field count");
+    Test::eq(rawVal(p.field(57)), "\"d,\"\"e\"", "Wide line quoted field");
+    Test::eq(rawVal(p.field(60)), "end", "Wide line last field");
+
+    testBadLine((wide + ",\"abc").c_str(), "Unterminated string field");
+
+    // fields after the limit are counted but not split out
+    LineParser limited;
+    limited.setFieldLimit(2);
+    char unquoted[] = "a,b,c,d";
+    Test::that(limited.parse(unquoted), "Line with a field limit parses");
+    Test::eq(limited.fieldCount(), static_cast<size_t>(4),
+             "All fields are counted");
+    Test::eq(rawVal(limited.field(1)), "b", "Last field before the limit");
+    char quoted[] = "a,b,\"c,d\",e";
+    Test::that(limited.parse(quoted), "Quoted line with a field limit parses");
+    Test::eq(limited.fieldCount(), static_cast<size_t>(4),
+             "Commas in quoted fields after the limit are not counted");
+    char badQuote[] = "a,b,c,\"d";
+    Test::eq(limited.parse(badQuote), false,
+             "Bad fields after the limit are still found");
+    Test::eq(limited.errText(), std::string("Unterminated string field"),
+             "Error text for a bad field after the limit");
+
+    LineParser none;
+    none.setFieldLimit(0);
+    Test::that(none.parse("a,b,c"), "Line with no fields needed parses");
+    Test::eq(none.fieldCount(), static_cast<size_t>(3),
+             "Fields are counted when none are needed");
+
+    // the line is left as it was, and does not need to be terminated
+    const char record[] = "a,\"b,c\",d,e";
+    Test::that(p.parse(record, 9), "Part of a line parses");
+    Test::eq(std::string(record), "a,\"b,c\",d,e", "Line is not modified");
+    Test::eq(p.fieldCount(), static_cast<size_t>(3), "Part of a line count");
+    Test::eq(rawVal(p.field(2)), "d", "Last field stops at the length");
+    Test::eq(p.field(2).asString(), "d", "Last field string is terminated");
+
+    // lines without quotes can be counted without splitting them
+    LineParser counter;
+    Test::that(counter.countFields("a,b,,c", 6), "Line without quotes counted");
+    Test::eq(counter.fieldCount(), static_cast<size_t>(4),
+             "Fields counted without splitting");
+    Test::eq(counter.countFields("a,\"b,c\"", 7), false,
+             "Line with quotes needs splitting");
+    Test::that(counter.split(nullptr, 0), "Line with quotes splits");
+    Test::eq(counter.fieldCount(), static_cast<size_t>(2),
+             "Fields counted once split");
+    Test::eq(rawVal(counter.field(1)), "\"b,c\"", "Quoted field split");
         
     Test::endSuite();
 }
@@ -8,17 +8,31 @@
 
 void cmdOptionsTests();
 void lineParserTests();
+void lineBatchTests();
+void readAheadTests();
+void recordScannerTests();
+void structuralIndexTests();
 void fieldTests();
+void arenaTests();
+void numberParserTests();
 void headersTests();
 void lexerTests();
+void variantTests();
 void expressionParserTests();
 
 int main(int argc, char* argv[]) {
     cmdOptionsTests();
     lineParserTests();
+    lineBatchTests();
+    readAheadTests();
+    recordScannerTests();
+    structuralIndexTests();
     fieldTests();
+    arenaTests();
+    numberParserTests();
     headersTests();
     lexerTests();
+    variantTests();
     expressionParserTests();
     
     Test::printSummary();
@@ -0,0 +1,237 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#include <app/numberParser.h>
+
+#include "test.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Check that a string converts exactly as strtod would.
+ *
+ * @return  An empty string if it does, or a description of the difference.
+ */
+static std::string compareWithStrtod(const std::string& str) {
+    char* end = nullptr;
+    double expected = strtod(str.c_str(), &end);
+    bool expectedIsNumber = (end == str.c_str() + str.size());
+
+    // parse must not look past the end, so give it an unterminated copy
+    std::vector<char> copy(str.begin(), str.end());
+    copy.push_back('9');
+    Number number;
+    NumberParser::Result result =
+        NumberParser::parse(copy.data(), str.size(), number);
+    double val = number.doubleVal();
+
+    std::string error;
+    if (result == NumberParser::NUMBER) {
+        if (!expectedIsNumber) {
+            error = "\"" + str + "\" should not be a number";
+        } else if (memcmp(&val, &expected, sizeof(val)) != 0) {
+            char buf[100];
+            snprintf(buf, sizeof(buf), "%.17g instead of %.17g", val, expected);
+            error = "\"" + str + "\" gave " + buf;
+        } else if (number.isInteger() &&
+                   number.integerVal() != strtoll(str.c_str(), nullptr, 10)) {
+            error = "\"" + str + "\" is the wrong integer";
+        }
+    } else if (result == NumberParser::NOT_NUMBER && expectedIsNumber) {
+        error = "\"" + str + "\" should be a number";
+    }
+
+    double converted = 0.0;
+    bool isNumber = NumberParser::toDouble(str.c_str(), str.size(), converted);
+    if (error.empty() && isNumber != expectedIsNumber) {
+        error = "\"" + str + "\" was not converted correctly";
+    }
+    if (error.empty() && isNumber &&
+        memcmp(&converted, &expected, sizeof(converted)) != 0) {
+        error = "\"" + str + "\" did not convert to the same value";
+    }
+    return error;
+}
+
+static void checkCorpus(const std::vector<std::string>& corpus,
+                        const std::string& description) {
+    std::string firstError;
+    for (size_t i = 0; i < corpus.size() && firstError.empty(); i++) {
+        firstError = compareWithStrtod(corpus[i]);
+    }
+    if (!Test::that(firstError.empty(), description)) {
+        printf("           %s\n", firstError.c_str());
+    }
+}
+
+static void testFastPath() {
+    Test::beginGroup("Fast path");
+
+    const char* numbers[] = {
+        "0", "1", "-1", "+1", "42", "0.5", "-0.25", ".5", "5.", "3.14159",
+        "1e10", "1E-5", "2.5e+3", "0.1", "0.3", "123456789012345678",
+        "9007199254740993", "4.35", "1e22", "1e30"
+    };
+    for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+        Number val;
+        Test::that(NumberParser::parse(numbers[i], strlen(numbers[i]), val) ==
+                       NumberParser::NUMBER,
+                   std::string("\"") + numbers[i] + "\" is converted");
+    }
+
+    const char* words[] = { "fred", "A", "12abc", "1.5.5", "1-2", "1e5e5" };
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+        Number val;
+        Test::that(NumberParser::parse(words[i], strlen(words[i]), val) ==
+                       NumberParser::NOT_NUMBER,
+                   std::string("\"") + words[i] + "\" is not a number");
+    }
+
+    Number val = Number::real(1.0);
+    Test::that(NumberParser::parse("", 0, val) == NumberParser::NUMBER,
+               "Empty string is a number");
+    Test::eq(val.doubleVal(), 0.0, "Empty string is zero");
+
+    Test::endGroup();
+}
+
+static void testIntegers() {
+    Test::beginGroup("Integers");
+
+    const char* integers[] = {
+        "0", "42", "-7", "+7", "007", "9007199254740993",
+        "9223372036854775807", "-9223372036854775807"
+    };
+    for (size_t i = 0; i < sizeof(integers) / sizeof(integers[0]); i++) {
+        Number val;
+        NumberParser::parse(integers[i], strlen(integers[i]), val);
+        if (Test::that(val.isInteger(),
+                       std::string("\"") + integers[i] + "\" is an integer")) {
+            Test::that(val.integerVal() == strtoll(integers[i], nullptr, 10),
+                       std::string("\"") + integers[i] + "\" is exact");
+        }
+    }
+
+    const char* doubles[] = {
+        "-0", "1.0", "1.", "1e3", "9223372036854775808", "12345678901234567890"
+    };
+    for (size_t i = 0; i < sizeof(doubles) / sizeof(doubles[0]); i++) {
+        Number val;
+        NumberParser::toNumber(doubles[i], strlen(doubles[i]), val);
+        Test::that(!val.isInteger(),
+                   std::string("\"") + doubles[i] + "\" is a double");
+    }
+
+    Test::endGroup();
+}
+
+static void testEdgeCases() {
+    Test::beginGroup("Edge cases");
+
+    std::vector<std::string> corpus = {
+        "", "0", "-0", "+0", "0.0", "-0.0", "00", "007", "0.000", ".", "-",
+        "+", "-.", ".e1", "e1", "1e", "1e+", "1e-", "1e+x", "1ex", "1.e1",
+        "-.5e-1", "0x1A", "0X1a", "-0x10", "0x", "0x1p3", " 12", "\t12",
+        "12 ", "inf", "-inf", "INFINITY", "nan", "NaN", "-nan", "in", "nope",
+        "1,5", "1e400", "-1e400", "1e-400", "4.9e-324",
+        "2.2250738585072014e-308",
+        "1.7976931348623157e308", "1.7976931348623159e308",
+        "9007199254740991", "9007199254740992", "9007199254740993",
+        "9007199254740994", "9007199254740995", "18014398509481985",
+        "9999999999999999999", "10000000000000000000",
+        "18446744073709551615", "18446744073709551616",
+        "123456789012345678901234567890", "0.1234567890123456789",
+        "0.12345678901234567890", "1e22", "1e23", "9e37", "9007199254740992e15",
+        "9007199254740993e15", "1e37", "1e38", "1e-22", "1e-23",
+        "0.000000000000000000000000000001", "1e0000000000000000000001",
+        "1e-99999999999", "0e99999999999", "89255.0e-22",
+        "2.5", "3.5", "0.5e1", "123.456e-2", "1000000000000000000000000e-24",
+        "1.00000000000000011102230246251565404236316680908203125",
+        "1.00000000000000011102230246251565404236316680908203124",
+        "1.00000000000000011102230246251565404236316680908203126"
+    };
+    checkCorpus(corpus, "Edge cases match strtod");
+
+    Test::endGroup();
+}
+
+static void testRandom() {
+    Test::beginGroup("Random numbers");
+
+    srand(1234);
+
+    std::vector<std::string> decimals;
+    for (int i = 0; i < 200000; i++) {
+        std::string str;
+        if (rand() % 4 == 0) {
+            str += '-';
+        }
+        int intDigits = rand() % 12;
+        for (int d = 0; d < intDigits; d++) {
+            str += static_cast<char>('0' + rand() % 10);
+        }
+        if (rand() % 2 == 0) {
+            str += '.';
+            int fracDigits = rand() % 20;
+            for (int d = 0; d < fracDigits; d++) {
+                str += static_cast<char>('0' + rand() % 10);
+            }
+        }
+        if (rand() % 4 == 0) {
+            str += (rand() % 2 == 0) ? 'e' : 'E';
+            if (rand() % 2 == 0) {
+                str += (rand() % 2 == 0) ? '-' : '+';
+            }
+            char buf[10];
+            snprintf(buf, sizeof(buf), "%d", rand() % 60);
+            str += buf;
+        }
+        decimals.push_back(str);
+    }
+    checkCorpus(decimals, "Random decimals match strtod");
+
+    std::vector<std::string> printed;
+    for (int i = 0; i < 200000; i++) {
+        uint64_t bits = (static_cast<uint64_t>(rand()) << 33) ^
+                        (static_cast<uint64_t>(rand()) << 11) ^
+                        static_cast<uint64_t>(rand());
+        double val = 0.0;
+        memcpy(&val, &bits, sizeof(val));
+        char buf[40];
+        snprintf(buf, sizeof(buf), "%.*g", 1 + rand() % 17, val);
+        printed.push_back(buf);
+    }
+    checkCorpus(printed, "Printed doubles match strtod");
+
+    std::vector<std::string> integers;
+    for (int i = 0; i < 200000; i++) {
+        uint64_t val = (static_cast<uint64_t>(rand()) << 33) ^
+                       (static_cast<uint64_t>(rand()) << 11) ^
+                       static_cast<uint64_t>(rand());
+        val >>= rand() % 64;
+        char buf[40];
+        snprintf(buf, sizeof(buf), "%llu",
+                 static_cast<unsigned long long>(val));
+        integers.push_back(buf);
+    }
+    checkCorpus(integers, "Integers match strtod");
+
+    Test::endGroup();
+}
+
+void numberParserTests() {
+    Test::beginSuite("Number parser");
+
+    testFastPath();
+    testIntegers();
+    testEdgeCases();
+    testRandom();
+
+    Test::endSuite();
+}
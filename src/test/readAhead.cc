@@ -0,0 +1,73 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#include <app/readAhead.h>
+
+#include "test.h"
+
+#include <string>
+#include <unistd.h>
+
+static void testReadPipe() {
+    Test::beginGroup("Data is read ahead from a pipe");
+
+    int fds[2];
+    Test::that(pipe(fds) == 0, "Pipe created");
+    Test::eq(static_cast<size_t>(write(fds[1], "abc", 3)),
+             static_cast<size_t>(3), "Data written");
+    close(fds[1]);
+
+    std::string data;
+    {
+        ReadAhead readAhead(fds[0], 2, 2);
+        char* block = nullptr;
+        size_t length = 0;
+        bool ok = true;
+        do {
+            ok = readAhead.acquire(block, length);
+            data.append(block == nullptr ? "" : block, length);
+            readAhead.release();
+        } while (ok && length > 0);
+        Test::that(ok, "Reads succeeded");
+    }
+    Test::eq(data, "abc", "All of the data was read");
+    close(fds[0]);
+
+    Test::endGroup();
+}
+
+static void testStopWhileWaiting() {
+    Test::beginGroup("Stopping while waiting for data");
+
+    int fds[2];
+    Test::that(pipe(fds) == 0, "Pipe created");
+    Test::eq(static_cast<size_t>(write(fds[1], "abc", 3)),
+             static_cast<size_t>(3), "Data written");
+
+    {
+        // nothing more is written, so the background thread is left waiting
+        // for data when the consumer stops
+        ReadAhead readAhead(fds[0], 16, 2);
+        char* block = nullptr;
+        size_t length = 0;
+        Test::that(readAhead.acquire(block, length), "First read succeeded");
+        Test::eq(length, static_cast<size_t>(3), "First block read");
+        readAhead.release();
+    }
+    // the destructor has joined the thread, so nothing can still read fds[0]
+    Test::that(true, "The background thread stopped");
+    close(fds[0]);
+    close(fds[1]);
+
+    Test::endGroup();
+}
+
+void readAheadTests() {
+    Test::beginSuite("Reading ahead");
+
+    testReadPipe();
+    testStopWhileWaiting();
+
+    Test::endSuite();
+}
@@ -0,0 +1,52 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#include "test.h"
+
+#include <app/recordScanner.h>
+
+#include <sstream>
+#include <string.h>
+
+static void testScan(const char* line,
+                     RecordScanner::State start,
+                     RecordScanner::State expected) {
+    std::stringstream msg;
+    msg << "Line '" << line << "' starting "
+        << (start == RecordScanner::INSIDE_QUOTES ? "inside" : "outside")
+        << " quotes ends "
+        << (expected == RecordScanner::INSIDE_QUOTES ? "inside" : "outside");
+    RecordScanner::State state =
+        RecordScanner::scanLine(line, line + strlen(line), start);
+    Test::that(state == expected, msg.str());
+}
+
+void recordScannerTests() {
+    Test::beginSuite("Record boundary scanning");
+
+    const RecordScanner::State out = RecordScanner::OUTSIDE_QUOTES;
+    const RecordScanner::State in = RecordScanner::INSIDE_QUOTES;
+
+    testScan("", out, out);
+    testScan("", in, in);
+    testScan("a,b,c", out, out);
+    testScan("a,b,c", in, in);
+    testScan("\"a,b\",c", out, out);
+    testScan("a,\"b", out, in);
+    testScan("\"a\"\"", out, in);
+    testScan("\"a\"\"\"", out, out);
+    testScan("\"", out, in);
+
+    // a quote within an unquoted field does not start a quoted field
+    testScan("5\" screen,a", out, out);
+    testScan("a,b\"c", out, out);
+
+    // continuing a quoted field from the previous line
+    testScan("end of field\",a", in, out);
+    testScan("\"\"still quoted", in, in);
+    testScan("\",\"next", in, in);
+    testScan("\"", in, out);
+
+    Test::endSuite();
+}
@@ -0,0 +1,83 @@
+//
+// csvfilter, Copyright (c) 2015, plnu
+//
+
+#include "test.h"
+
+#include <app/structuralIndex.h>
+
+#include <sstream>
+#include <string>
+#include <stdlib.h>
+
+static const char* kernelName(StructuralIndex::Kernel kernel) {
+    const char* ret = "scalar";
+    if (kernel == StructuralIndex::KERNEL_SSE2) {
+        ret = "SSE2";
+    } else if (kernel == StructuralIndex::KERNEL_AVX2) {
+        ret = "AVX2";
+    }
+    return ret;
+}
+
+static void testKernel(StructuralIndex::Kernel kernel) {
+    Test::beginGroup(kernelName(kernel));
+    StructuralIndex index(kernel);
+
+    std::string line = "ab,\"c\",d";
+    index.build(line.data(), line.size());
+    Test::eq(index.nextComma(0), static_cast<size_t>(2), "First comma");
+    Test::eq(index.nextComma(3), static_cast<size_t>(6), "Second comma");
+    Test::eq(index.nextComma(7), line.size(), "No more commas");
+    Test::eq(index.nextQuote(0), static_cast<size_t>(3), "First quote");
+    Test::eq(index.nextQuote(4), static_cast<size_t>(5), "Second quote");
+    Test::eq(index.nextQuote(6), line.size(), "No more quotes");
+
+    index.build("", 0);
+    Test::eq(index.nextComma(0), static_cast<size_t>(0), "Empty line");
+
+    // compare every position against a byte at a time search, over lines
+    // that end either side of the block boundaries
+    srand(1);
+    bool same = true;
+    for (size_t length = 1; length < 300 && same; length++) {
+        std::string random;
+        for (size_t i = 0; i < length; i++) {
+            const char chars[] = "a,\"\n";
+            random += chars[rand() % 4];
+        }
+        index.build(random.data(), random.size());
+
+        size_t comma = random.size();
+        size_t quote = random.size();
+        for (size_t pos = random.size() + 1; pos-- > 0 && same; ) {
+            if (pos < random.size() && random[pos] == ',') {
+                comma = pos;
+            } else if (pos < random.size() && random[pos] == '"') {
+                quote = pos;
+            }
+            same = (index.nextComma(pos) == comma &&
+                    index.nextQuote(pos) == quote);
+        }
+    }
+    Test::that(same, "Random lines are indexed correctly");
+
+    Test::endGroup();
+}
+
+void structuralIndexTests() {
+    Test::beginSuite("Structural indexing");
+
+    StructuralIndex::Kernel kernels[] = {StructuralIndex::KERNEL_SCALAR,
+                                         StructuralIndex::KERNEL_SSE2,
+                                         StructuralIndex::KERNEL_AVX2};
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        if (StructuralIndex::supported(kernels[i])) {
+            testKernel(kernels[i]);
+        }
+    }
+    Test::that(StructuralIndex::supported(StructuralIndex::bestKernel()),
+               "The best kernel is supported");
+
+    Test::endSuite();
+}